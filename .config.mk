@@ -0,0 +1,49 @@
+# Automatically generated by configure - DO NOT EDIT!
+CONFIGURE_ARGS = --python=python3 --disable-dvbscan
+ROOTDIR  ?= /root/repo
+BUILDDIR ?= /root/repo/build.linux
+OSENV    ?= posix
+ARCH     ?= x86_64
+CPU      ?= generic
+ifeq ($(origin CC),default)
+CC        = cc
+endif
+PYTHON   ?= python3
+CFLAGS   += 
+LDFLAGS  += 
+prefix    = /usr/local
+bindir    = ${prefix}/bin
+mandir    = ${datadir}/man
+datadir   = ${prefix}/share
+libdir    = ${prefix}/lib
+LDFLAGS += -lssl -lcrypto 
+CFLAGS  += 
+LDFLAGS += -lz 
+CFLAGS  += 
+LDFLAGS += -lcurl 
+CFLAGS  += -I/usr/include/x86_64-linux-gnu 
+CONFIG_CWC = yes
+CONFIG_V4L = yes
+CONFIG_LINUXDVB = yes
+CONFIG_DVBSCAN = no
+CONFIG_TIMESHIFT = yes
+CONFIG_TRACE = yes
+CONFIG_IMAGECACHE = yes
+CONFIG_AVAHI = no
+CONFIG_ZLIB = yes
+CONFIG_LIBAV = no
+CONFIG_INOTIFY = yes
+CONFIG_BUNDLE = no
+CONFIG_DVBCSA = no
+CONFIG_EPOLL = yes
+CONFIG_KQUEUE = no
+CONFIG_EXECINFO = yes
+CONFIG_MMX = yes
+CONFIG_SSE2 = yes
+CONFIG_AVX2 = yes
+CONFIG_GETLOADAVG = yes
+CONFIG_ATOMIC64 = yes
+CONFIG_PY_GZIP = yes
+CONFIG_BIN_BZIP2 = yes
+CONFIG_SSL = yes
+CONFIG_INOTIFY_H = yes
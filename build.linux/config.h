@@ -0,0 +1,46 @@
+#define PLATFORM_LINUX 1
+#define ENABLE_CWC 1
+#define CONFIG_CWC 1
+#define ENABLE_V4L 1
+#define CONFIG_V4L 1
+#define ENABLE_LINUXDVB 1
+#define CONFIG_LINUXDVB 1
+#define ENABLE_DVBSCAN 0
+#define ENABLE_TIMESHIFT 1
+#define CONFIG_TIMESHIFT 1
+#define ENABLE_TRACE 1
+#define CONFIG_TRACE 1
+#define ENABLE_IMAGECACHE 1
+#define CONFIG_IMAGECACHE 1
+#define ENABLE_AVAHI 0
+#define ENABLE_ZLIB 1
+#define CONFIG_ZLIB 1
+#define ENABLE_LIBAV 0
+#define ENABLE_INOTIFY 1
+#define CONFIG_INOTIFY 1
+#define ENABLE_BUNDLE 0
+#define ENABLE_DVBCSA 0
+#define ENABLE_EPOLL 1
+#define CONFIG_EPOLL 1
+#define ENABLE_KQUEUE 0
+#define ENABLE_EXECINFO 1
+#define CONFIG_EXECINFO 1
+#define ENABLE_MMX 1
+#define CONFIG_MMX 1
+#define ENABLE_SSE2 1
+#define CONFIG_SSE2 1
+#define ENABLE_AVX2 1
+#define CONFIG_AVX2 1
+#define ENABLE_GETLOADAVG 1
+#define CONFIG_GETLOADAVG 1
+#define ENABLE_ATOMIC64 1
+#define CONFIG_ATOMIC64 1
+#define ENABLE_PY_GZIP 1
+#define CONFIG_PY_GZIP 1
+#define ENABLE_BIN_BZIP2 1
+#define CONFIG_BIN_BZIP2 1
+#define ENABLE_SSL 1
+#define CONFIG_SSL 1
+#define ENABLE_INOTIFY_H 1
+#define CONFIG_INOTIFY_H 1
+#define TVHEADEND_DATADIR "/usr/local/share/tvheadend"
@@ -177,36 +177,51 @@ isom_write_avcc(sbuf_t *sb, const uint8_t *data, int len)
 
 
 
+/**
+ *
+ */
+static pktbuf_t *
+avc_convert_header(const pktbuf_t *pb, const pktbuf_t *hdr)
+{
+  sbuf_t headers;
+
+  sbuf_init(&headers);
+  isom_write_avcc(&headers, pktbuf_ptr(pb), pktbuf_len(pb));
+  return pktbuf_make(headers.sb_data, headers.sb_ptr);
+}
+
+/**
+ *
+ */
+static pktbuf_t *
+avc_convert_payload(const pktbuf_t *pb, const pktbuf_t *hdr)
+{
+  sbuf_t payload;
+
+  sbuf_init(&payload);
+  if(hdr)
+    avc_parse_nal_units(&payload, pktbuf_ptr(hdr), pktbuf_len(hdr));
+  avc_parse_nal_units(&payload, pktbuf_ptr(pb), pktbuf_len(pb));
+  return pktbuf_make(payload.sb_data, payload.sb_ptr);
+}
+
+/**
+ * The converted buffers are shared by all subscribers of the packet
+ */
 th_pkt_t *
 avc_convert_pkt(th_pkt_t *src)
 {
-  th_pkt_t *pkt = malloc(sizeof(th_pkt_t));
+  th_pkt_t *pkt = pkt_alloc(NULL, 0, 0, 0);
   *pkt = *src;
   pkt->pkt_refcount = 1;
   pkt->pkt_header = NULL;
-  pkt->pkt_payload = NULL;
-
-  if (src->pkt_header) {
-    sbuf_t headers;
-    sbuf_init(&headers);
-    
-    isom_write_avcc(&headers, pktbuf_ptr(src->pkt_header),
-		    pktbuf_len(src->pkt_header));
-    pkt->pkt_header = pktbuf_make(headers.sb_data, headers.sb_ptr);
-  }
 
-  sbuf_t payload;
-  sbuf_init(&payload);
+  if (src->pkt_header)
+    pkt->pkt_header = pktbuf_derive(src->pkt_header, NULL, PKTBUF_AVCC,
+                                    avc_convert_header);
 
-  if(src->pkt_header)
-    avc_parse_nal_units(&payload, pktbuf_ptr(src->pkt_header),
-			pktbuf_len(src->pkt_header));
-
-  avc_parse_nal_units(&payload, pktbuf_ptr(src->pkt_payload),
-		      pktbuf_len(src->pkt_payload));
-  
-  pkt->pkt_payload = pktbuf_make(payload.sb_data, payload.sb_ptr);
+  pkt->pkt_payload = pktbuf_derive(src->pkt_payload, src->pkt_header,
+                                   PKTBUF_AVCC, avc_convert_payload);
   pkt_ref_dec(src);
   return pkt;
 }
-
@@ -35,6 +35,7 @@
 #include "epg.h"
 #include "epggrab.h"
 #include "channels.h"
+#include "service.h"
 #include "dtable.h"
 #include "notify.h"
 #include "dvr/dvr.h"
@@ -275,6 +276,8 @@ channel_load_one(htsmsg_t *c, int id)
   htsmsg_get_s32(c, "dvr_extra_time_pre",  &ch->ch_dvr_extra_time_pre);
   htsmsg_get_s32(c, "dvr_extra_time_post", &ch->ch_dvr_extra_time_post);
   htsmsg_get_s32(c, "channel_number", &ch->ch_number);
+  htsmsg_get_s32(c, "gop_cache", &ch->ch_gop_cache);
+  ch->ch_gop_cache = MAX(0, MIN(CHANNEL_GOP_CACHE_MAX, ch->ch_gop_cache));
 
   if((tags = htsmsg_get_list(c, "tags")) != NULL) {
     HTSMSG_FOREACH(f, tags) {
@@ -335,6 +338,7 @@ channel_save(channel_t *ch)
   htsmsg_add_u32(m, "dvr_extra_time_pre",  ch->ch_dvr_extra_time_pre);
   htsmsg_add_u32(m, "dvr_extra_time_post", ch->ch_dvr_extra_time_post);
   htsmsg_add_s32(m, "channel_number", ch->ch_number);
+  htsmsg_add_s32(m, "gop_cache", ch->ch_gop_cache);
 
   hts_settings_save(m, "channels/%d", ch->ch_id);
   htsmsg_destroy(m);
@@ -509,6 +513,25 @@ channel_set_number(channel_t *ch, int number)
   htsp_channel_update(ch);
 }
 
+/**
+ * Set the size of the GOP cache kept by services of the channel
+ */
+void
+channel_set_gop_cache(channel_t *ch, int kb)
+{
+  service_t *t;
+
+  lock_assert(&global_lock);
+
+  kb = MAX(0, MIN(CHANNEL_GOP_CACHE_MAX, kb));
+  if(ch->ch_gop_cache == kb)
+    return;
+  ch->ch_gop_cache = kb;
+  LIST_FOREACH(t, &ch->ch_services, s_ch_link)
+    service_gop_set_max(t, kb * 1024);
+  channel_save(ch);
+}
+
 /**
  *
  */
@@ -47,6 +47,7 @@ typedef struct channel {
 
   /* EPG fields */
   epg_broadcast_tree_t  ch_epg_schedule;
+  epg_broadcast_list_t  ch_epg_eid[EPG_EID_HASH_WIDTH];
   epg_broadcast_t      *ch_epg_now;
   epg_broadcast_t      *ch_epg_next;
   gtimer_t              ch_epg_timer;
@@ -56,6 +57,7 @@ typedef struct channel {
   int ch_dvr_extra_time_pre;
   int ch_dvr_extra_time_post;
   int ch_number;  // User configurable number
+  int ch_gop_cache; // GOP cache size per service in kB, 0 = disabled
   char *ch_icon;
 
   struct dvr_entry_list ch_dvrs;
@@ -124,6 +126,10 @@ void channel_set_epg_postpre_time(channel_t *ch, int pre, int mins);
 
 void channel_set_number(channel_t *ch, int number);
 
+#define CHANNEL_GOP_CACHE_MAX 65536 // kB
+
+void channel_set_gop_cache(channel_t *ch, int kb);
+
 void channel_set_icon(channel_t *ch, const char *icon);
 
 void channel_set_tags_from_list(channel_t *ch, const char *maplist);
@@ -54,7 +54,6 @@ static int _config_set_str ( const char *fld, const char *val )
   return 0;
 }
 
-#if 0
 static int _config_set_u32 ( const char *fld, uint32_t val )
 {
   uint32_t u32;
@@ -66,7 +65,6 @@ static int _config_set_u32 ( const char *fld, uint32_t val )
   }
   return 0;
 }
-#endif
 
 const char *config_get_language ( void )
 {
@@ -87,3 +85,27 @@ int config_set_muxconfpath ( const char *path )
 {
   return _config_set_str("muxconfpath", path);
 }
+
+uint32_t config_get_descrambler_threads ( void )
+{
+  uint32_t u32 = 0;
+  htsmsg_get_u32(config, "descrambler_threads", &u32);
+  return u32;
+}
+
+int config_set_descrambler_threads ( uint32_t threads )
+{
+  return _config_set_u32("descrambler_threads", threads);
+}
+
+uint32_t config_get_descrambler_ecm_parallel ( void )
+{
+  uint32_t u32 = 1;
+  htsmsg_get_u32(config, "descrambler_ecm_parallel", &u32);
+  return u32;
+}
+
+int config_set_descrambler_ecm_parallel ( uint32_t on )
+{
+  return _config_set_u32("descrambler_ecm_parallel", on);
+}
@@ -36,4 +36,12 @@ const char *config_get_language    ( void );
 int         config_set_language    ( const char *str )
   __attribute__((warn_unused_result));
 
+uint32_t    config_get_descrambler_threads ( void );
+int         config_set_descrambler_threads ( uint32_t threads )
+  __attribute__((warn_unused_result));
+
+uint32_t    config_get_descrambler_ecm_parallel ( void );
+int         config_set_descrambler_ecm_parallel ( uint32_t on )
+  __attribute__((warn_unused_result));
+
 #endif /* __TVH_CONFIG__H__ */
@@ -41,12 +41,7 @@
 #include "dtable.h"
 #include "subscriptions.h"
 #include "service.h"
-
-#if ENABLE_DVBCSA
-#include <dvbcsa/dvbcsa.h>
-#else
-#include "ffdecsa/FFdecsa.h"
-#endif
+#include "tvhcsa.h"
 
 /**
  *
@@ -57,6 +52,12 @@
 #define CWS_NETMSGSIZE 362
 #define CWS_FIRSTCMDNO 0xe0
 
+#define ECM_CACHE_SIZE 256
+#define ECM_CACHE_TTL  (30 * 1000000LL) // keys stay valid for a crypto period
+#define ECM_CACHE_WAIT (3 * 1000000LL)  // max. wait for another request
+
+#define CWC_HIST_BUCKETS 9
+
 /**
  * cards for which emm updates are handled
  */
@@ -120,6 +121,8 @@ typedef struct ecm_section {
   char es_nok;
   char es_pending;
   int64_t es_time;  // time request was sent
+  char es_wait;     // identical request pending on another server
+  uint32_t es_provider;
   size_t es_ecmsize;
   uint8_t es_ecm[4070];
 
@@ -172,28 +175,13 @@ typedef struct cwc_service {
     CS_IDLE
   } cs_keystate;
 
-#if ENABLE_DVBCSA
-  struct dvbcsa_bs_key_s *cs_key_even;
-  struct dvbcsa_bs_key_s *cs_key_odd;
-#else
-  void *cs_keys;
-#endif
-
   uint8_t cs_cw[16];
   int cs_pending_cw_update;
 
   /**
    * CSA
    */
-  int cs_cluster_size;
-  uint8_t *cs_tsbcluster;
-  int cs_fill;
-#if ENABLE_DVBCSA
-  struct dvbcsa_bs_batch_s *cs_tsbbatch_even;
-  struct dvbcsa_bs_batch_s *cs_tsbbatch_odd;
-  int cs_fill_even;
-  int cs_fill_odd;
-#endif
+  tvhcsa_t *cs_csa;
 
   LIST_HEAD(, ecm_pid) cs_pids;
 
@@ -257,6 +245,11 @@ typedef struct cwc {
   /* Emm forwarding */
   int cwc_forward_emm;
 
+  /* ECM reply stats, latency histogram in ms (see cwc_hist_limits) */
+  uint32_t cwc_ecm_ok;
+  uint32_t cwc_ecm_nok;
+  uint32_t cwc_ecm_hist[CWC_HIST_BUCKETS];
+
   /* Emm duplicate cache */
   struct {
 #define EMM_CACHE_SIZE (1<<5)
@@ -303,6 +296,40 @@ typedef struct cwc {
 } cwc_t;
 
 
+/**
+ * ECM -> control word cache, shared by all servers and services
+ *
+ * An entry without a key is a request in flight, identical ECMs from
+ * other services wait for its reply (unless requests are parallel)
+ */
+typedef struct ecm_cache_entry {
+  uint16_t ce_caid;
+  uint32_t ce_provider;
+  uint32_t ce_crc;
+  size_t   ce_len;
+  uint8_t *ce_ecm;
+  int      ce_valid;
+  int64_t  ce_time;
+  uint8_t  ce_cw[16];
+} ecm_cache_entry_t;
+
+enum {
+  ECM_CACHE_MISS,
+  ECM_CACHE_HIT,
+  ECM_CACHE_PENDING
+};
+
+static pthread_mutex_t   ecm_cache_mutex;
+static ecm_cache_entry_t ecm_cache[ECM_CACHE_SIZE];
+static uint32_t          ecm_cache_hits;
+static uint32_t          ecm_cache_waits;
+static uint32_t          ecm_cache_misses;
+static int               cwc_ecm_parallel = 1;
+
+static const int cwc_hist_limits[CWC_HIST_BUCKETS - 1] = {
+  25, 50, 100, 200, 400, 800, 1600, 3200
+};
+
 /**
  *
  */
@@ -773,6 +800,158 @@ cwc_send_login(cwc_t *cwc)
 
 
 
+/**
+ * ecm_cache_mutex is held
+ */
+static ecm_cache_entry_t *
+ecm_cache_find(uint16_t caid, uint32_t provider, const uint8_t *ecm,
+               size_t len, uint32_t *crc)
+{
+  ecm_cache_entry_t *ce;
+
+  *crc = tvh_crc32((uint8_t *)ecm, len, caid ^ provider);
+  ce   = &ecm_cache[*crc % ECM_CACHE_SIZE];
+  if(ce->ce_ecm && ce->ce_crc == *crc && ce->ce_caid == caid &&
+     ce->ce_provider == provider && ce->ce_len == len &&
+     !memcmp(ce->ce_ecm, ecm, len))
+    return ce;
+  return NULL;
+}
+
+/**
+ * Look up an ECM, on a miss it is marked as pending (the caller sends it)
+ */
+static int
+ecm_cache_lookup(uint16_t caid, uint32_t provider, const uint8_t *ecm,
+                 size_t len, uint8_t *cw)
+{
+  ecm_cache_entry_t *ce;
+  uint32_t crc;
+  int64_t now = getmonoclock();
+  int r = ECM_CACHE_MISS;
+
+  pthread_mutex_lock(&ecm_cache_mutex);
+  ce = ecm_cache_find(caid, provider, ecm, len, &crc);
+  if(ce && ce->ce_valid && now - ce->ce_time < ECM_CACHE_TTL) {
+    memcpy(cw, ce->ce_cw, 16);
+    ecm_cache_hits++;
+    r = ECM_CACHE_HIT;
+  } else if(ce && !ce->ce_valid && now - ce->ce_time < ECM_CACHE_WAIT) {
+    ecm_cache_waits++;
+    r = ECM_CACHE_PENDING;
+  } else {
+    ce = &ecm_cache[crc % ECM_CACHE_SIZE];
+    ce->ce_ecm      = realloc(ce->ce_ecm, len);
+    memcpy(ce->ce_ecm, ecm, len);
+    ce->ce_len      = len;
+    ce->ce_crc      = crc;
+    ce->ce_caid     = caid;
+    ce->ce_provider = provider;
+    ce->ce_valid    = 0;
+    ce->ce_time     = now;
+    ecm_cache_misses++;
+  }
+  pthread_mutex_unlock(&ecm_cache_mutex);
+  return r;
+}
+
+/**
+ * Store the reply to a pending ECM, cw NULL drops it (NOK) unless another
+ * server already answered it
+ */
+static void
+ecm_cache_update(uint16_t caid, uint32_t provider, const uint8_t *ecm,
+                 size_t len, const uint8_t *cw)
+{
+  ecm_cache_entry_t *ce;
+  uint32_t crc;
+
+  pthread_mutex_lock(&ecm_cache_mutex);
+  if((ce = ecm_cache_find(caid, provider, ecm, len, &crc)) != NULL) {
+    if(cw) {
+      memcpy(ce->ce_cw, cw, 16);
+      ce->ce_valid = 1;
+      ce->ce_time  = getmonoclock();
+    } else if(!ce->ce_valid) {
+      free(ce->ce_ecm);
+      memset(ce, 0, sizeof(ecm_cache_entry_t));
+    }
+  }
+  pthread_mutex_unlock(&ecm_cache_mutex);
+}
+
+/**
+ * Use a key which was not requested by this service
+ */
+static void
+cwc_ecm_resolved(cwc_service_t *ct, ecm_section_t *es, const uint8_t *cw)
+{
+  es->es_pending = 0;
+  es->es_wait    = 0;
+  es->es_nok     = 0;
+
+  ct->cs_channel = es->es_channel;
+  ct->ecm_state  = ECM_VALID;
+
+  if(ct->cs_keystate != CS_RESOLVED)
+    tvhlog(LOG_DEBUG, "cwc",
+           "Obtained key for service \"%s\" from ECM cache",
+           ct->cs_service->s_svcname);
+
+  ct->cs_keystate = CS_RESOLVED;
+  memcpy(ct->cs_cw, cw, 16);
+  ct->cs_pending_cw_update = 1;
+}
+
+/**
+ * A reply arrived for the ECM in es, pass the key (or the NOK) on to the
+ * services waiting for the same ECM, on NOK they send it themselves
+ *
+ * cwc_mutex is held
+ */
+static void
+cwc_ecm_wakeup(cwc_service_t *ct, ecm_section_t *es, const uint8_t *cw)
+{
+  cwc_t *cwc2;
+  cwc_service_t *ct2;
+  ecm_pid_t *ep;
+  ecm_section_t *es2;
+  int i;
+
+  TAILQ_FOREACH(cwc2, &cwcs, cwc_link) {
+    if(cwc2->cwc_caid != ct->cs_cwc->cwc_caid)
+      continue;
+    LIST_FOREACH(ct2, &cwc2->cwc_services, cs_link) {
+      LIST_FOREACH(ep, &ct2->cs_pids, ep_link) {
+        for(i = 0; i <= ep->ep_last_section; i++) {
+          es2 = ep->ep_sections[i];
+          if(es2 == NULL || es2 == es || !es2->es_wait ||
+             es2->es_provider != es->es_provider ||
+             es2->es_ecmsize != es->es_ecmsize ||
+             memcmp(es2->es_ecm, es->es_ecm, es->es_ecmsize))
+            continue;
+          if(cw) {
+            cwc_ecm_resolved(ct2, es2, cw);
+          } else if(cwc2->cwc_fd != -1) {
+            es2->es_wait = 0;
+            es2->es_time = getmonoclock();
+            es2->es_seq  = cwc_send_msg(cwc2, es2->es_ecm, es2->es_ecmsize,
+                                        ct2->cs_service->s_dvb_service_id, 1);
+            tvhlog(LOG_DEBUG, "cwc",
+                   "Sending ECM for service \"%s\" after NOK from %s:%i "
+                   "(seqno: %d)", ct2->cs_service->s_svcname,
+                   ct->cs_cwc->cwc_hostname, ct->cs_cwc->cwc_port,
+                   es2->es_seq);
+          }
+        }
+      }
+    }
+  }
+}
+
+/**
+ *
+ */
 static void
 handle_ecm_reply(cwc_service_t *ct, ecm_section_t *es, uint8_t *msg,
 		 int len, int seq)
@@ -788,10 +967,20 @@ handle_ecm_reply(cwc_service_t *ct, ecm_section_t *es, uint8_t *msg,
 
   snprintf(chaninfo, sizeof(chaninfo), " (PID %d)", es->es_channel);
 
+  for(i = 0; i < CWC_HIST_BUCKETS - 1; i++)
+    if(delay < cwc_hist_limits[i])
+      break;
+  ct->cs_cwc->cwc_ecm_hist[i]++;
+
   if(len < 19) {
     
     /* ERROR */
 
+    ct->cs_cwc->cwc_ecm_nok++;
+    ecm_cache_update(ct->cs_cwc->cwc_caid, es->es_provider,
+                     es->es_ecm, es->es_ecmsize, NULL);
+    cwc_ecm_wakeup(ct, es, NULL);
+
     if (es->es_nok < 3)
       es->es_nok++;
 
@@ -847,6 +1036,11 @@ forbid:
 
   } else {
 
+    ct->cs_cwc->cwc_ecm_ok++;
+    ecm_cache_update(ct->cs_cwc->cwc_caid, es->es_provider,
+                     es->es_ecm, es->es_ecmsize, msg + 3);
+    cwc_ecm_wakeup(ct, es, msg + 3);
+
     es->es_nok = 0;
     ct->cs_channel = es->es_channel;
     ct->ecm_state = ECM_VALID;
@@ -935,7 +1129,7 @@ cwc_running_reply(cwc_t *cwc, uint8_t msgtype, uint8_t *msg, int len)
 	for(i = 0; i <= ep->ep_last_section; i++) {
 	  es = ep->ep_sections[i];
 	  if(es != NULL) {
-	    if(es->es_seq == seq && es->es_pending) {
+	    if(es->es_seq == seq && es->es_pending && !es->es_wait) {
 	      handle_ecm_reply(ct, es, msg, len, seq);
 	      return 0;
 	    }
@@ -1624,6 +1818,7 @@ cwc_table_input(struct th_descrambler *td, struct service *t,
   ecm_section_t *es;
   char chaninfo[32];
   caid_t *c;
+  uint8_t cw[16];
 
   if (ct->cs_keystate == CS_IDLE)
     return;
@@ -1710,8 +1905,9 @@ cwc_table_input(struct th_descrambler *td, struct service *t,
     if (es->es_nok > 2)
       break; /* too many NOK responses in a row */
 
-    if(es->es_ecmsize == len && !memcmp(es->es_ecm, data, len))
-      break; /* key already sent */
+    if(es->es_ecmsize == len && !memcmp(es->es_ecm, data, len) &&
+       !(es->es_wait && getmonoclock() - es->es_time > ECM_CACHE_WAIT))
+      break; /* key already sent (or waiting for another request) */
 
     if(cwc->cwc_fd == -1) {
       // New key, but we are not connected (anymore), can not descramble
@@ -1722,6 +1918,8 @@ cwc_table_input(struct th_descrambler *td, struct service *t,
     es->es_channel = channel;
     es->es_section = section;
     es->es_pending = 1;
+    es->es_wait = 0;
+    es->es_provider = c->providerid;
 
     memcpy(es->es_ecm, data, len);
     es->es_ecmsize = len;
@@ -1732,12 +1930,27 @@ cwc_table_input(struct th_descrambler *td, struct service *t,
       return;
     }
 
+    es->es_time = getmonoclock();
+
+    switch(ecm_cache_lookup(cwc->cwc_caid, c->providerid, data, len, cw)) {
+    case ECM_CACHE_HIT:
+      cwc_ecm_resolved(ct, es, cw);
+      return;
+    case ECM_CACHE_PENDING:
+      if(cwc_ecm_parallel)
+        break;
+      es->es_wait = 1;
+      tvhlog(LOG_DEBUG, "cwc",
+             "Waiting for pending ECM%s section=%d/%d, for service \"%s\"",
+             chaninfo, section, ep->ep_last_section, t->s_svcname);
+      return;
+    }
+
     es->es_seq = cwc_send_msg(cwc, data, len, sid, 1);
 
     tvhlog(LOG_DEBUG, "cwc", 
 	   "Sending ECM%s section=%d/%d, for service \"%s\" (seqno: %d)",
 	   chaninfo, section, ep->ep_last_section, t->s_svcname, es->es_seq);
-    es->es_time = getmonoclock();
     break;
 
   default:
@@ -1914,42 +2127,27 @@ update_keys(cwc_service_t *ct)
   ct->cs_pending_cw_update = 0;
   for(i = 0; i < 8; i++)
     if(ct->cs_cw[i]) {
-#if ENABLE_DVBCSA
-      dvbcsa_bs_key_set(ct->cs_cw, ct->cs_key_even);
-#else
-      set_even_control_word(ct->cs_keys, ct->cs_cw);
-#endif
+      tvhcsa_set_key_even(ct->cs_csa, ct->cs_cw);
       break;
     }
   
   for(i = 0; i < 8; i++)
     if(ct->cs_cw[8 + i]) {
-#if ENABLE_DVBCSA
-      dvbcsa_bs_key_set(ct->cs_cw + 8, ct->cs_key_odd);
-#else
-      set_odd_control_word(ct->cs_keys, ct->cs_cw + 8);
-#endif
+      tvhcsa_set_key_odd(ct->cs_csa, ct->cs_cw + 8);
       break;
     }
 }
 
 
 /**
- *
+ * Scrambled packets are handed over to the CSA worker pool which
+ * re-injects them via ts_recv_packet2() once decrypted
  */
-#if ENABLE_DVBCSA
 static int
 cwc_descramble(th_descrambler_t *td, service_t *t, struct elementary_stream *st,
 	       const uint8_t *tsb)
 {
   cwc_service_t *ct = (cwc_service_t *)td;
-  uint8_t *pkt;
-  int xc0;
-  int ev_od;
-  int len;
-  int offset;
-  int n;
-  // FIXME: //int residue;
 
   if(ct->cs_keystate == CS_FORBIDDEN)
     return 1;
@@ -1957,140 +2155,12 @@ cwc_descramble(th_descrambler_t *td, service_t *t, struct elementary_stream *st,
   if(ct->cs_keystate != CS_RESOLVED)
     return -1;
 
-  if(ct->cs_fill == 0 && ct->cs_pending_cw_update)
-    update_keys(ct);
-
-  pkt = ct->cs_tsbcluster + ct->cs_fill * 188;
-  memcpy(pkt, tsb, 188);
-  ct->cs_fill++;
-
-  do { // handle this packet
-    xc0 = pkt[3] & 0xc0;
-    if(xc0 == 0x00) { // clear
-      break;
-    }
-    if(xc0 == 0x40) { // reserved
-      break;
-    }
-    if(xc0 == 0x80 || xc0 == 0xc0) { // encrypted
-      ev_od = (xc0 & 0x40) >> 6; // 0 even, 1 odd
-      pkt[3] &= 0x3f;  // consider it decrypted now
-      if(pkt[3] & 0x20) { // incomplete packet
-        offset = 4 + pkt[4] + 1;
-        len = 188 - offset;
-        n = len >> 3;
-        // FIXME: //residue = len - (n << 3);
-        if(n == 0) { // decrypted==encrypted!
-          break; // this doesn't need more processing
-        }
-      } else {
-        len = 184;
-        offset = 4;
-        // FIXME: //n = 23;
-        // FIXME: //residue = 0;
-      }
-      if(ev_od == 0) {
-        ct->cs_tsbbatch_even[ct->cs_fill_even].data = pkt + offset;
-        ct->cs_tsbbatch_even[ct->cs_fill_even].len = len;
-        ct->cs_fill_even++;
-      } else {
-        ct->cs_tsbbatch_odd[ct->cs_fill_odd].data = pkt + offset;
-        ct->cs_tsbbatch_odd[ct->cs_fill_odd].len = len;
-        ct->cs_fill_odd++;
-      }
-    }
-  } while(0);
-
-  if(ct->cs_fill != ct->cs_cluster_size)
-    return 0;
-
-  if(ct->cs_fill_even) {
-    ct->cs_tsbbatch_even[ct->cs_fill_even].data = NULL;
-    dvbcsa_bs_decrypt(ct->cs_key_even, ct->cs_tsbbatch_even, 184);
-    ct->cs_fill_even = 0;
-  }
-  if(ct->cs_fill_odd) {
-    ct->cs_tsbbatch_odd[ct->cs_fill_odd].data = NULL;
-    dvbcsa_bs_decrypt(ct->cs_key_odd, ct->cs_tsbbatch_odd, 184);
-    ct->cs_fill_odd = 0;
-  }
-
-  {
-      int i;
-      const uint8_t *t0 = ct->cs_tsbcluster;
-
-      for(i = 0; i < ct->cs_fill; i++) {
-	ts_recv_packet2(t, t0);
-	t0 += 188;
-      }
-  }
-  ct->cs_fill = 0;
-
   if(ct->cs_pending_cw_update)
     update_keys(ct);
 
+  tvhcsa_descramble(ct->cs_csa, tsb);
   return 0;
 }
-#else
-static int
-cwc_descramble(th_descrambler_t *td, service_t *t, struct elementary_stream *st,
-	       const uint8_t *tsb)
-{
-  cwc_service_t *ct = (cwc_service_t *)td;
-  int r;
-  unsigned char *vec[3];
-
-  if(ct->cs_keystate == CS_FORBIDDEN)
-    return 1;
-
-  if(ct->cs_keystate != CS_RESOLVED)
-    return -1;
-
-  if(ct->cs_fill == 0 && ct->cs_pending_cw_update)
-    update_keys(ct);
-
-  memcpy(ct->cs_tsbcluster + ct->cs_fill * 188, tsb, 188);
-  ct->cs_fill++;
-
-  if(ct->cs_fill != ct->cs_cluster_size)
-    return 0;
-
-  while(1) {
-
-    vec[0] = ct->cs_tsbcluster;
-    vec[1] = ct->cs_tsbcluster + ct->cs_fill * 188;
-    vec[2] = NULL;
-    
-    r = decrypt_packets(ct->cs_keys, vec);
-    if(r > 0) {
-      int i;
-      const uint8_t *t0 = ct->cs_tsbcluster;
-
-      for(i = 0; i < r; i++) {
-	ts_recv_packet2(t, t0);
-	t0 += 188;
-      }
-
-      r = ct->cs_fill - r;
-      assert(r >= 0);
-
-      if(r > 0)
-	memmove(ct->cs_tsbcluster, t0, r * 188);
-      ct->cs_fill = r;
-
-      if(ct->cs_pending_cw_update && r > 0)
-	continue;
-    } else {
-      ct->cs_fill = 0;
-    }
-    break;
-  }
-  if(ct->cs_pending_cw_update)
-    update_keys(ct);
-
-  return 0;
-}
-#endif
 
 /**
  * cwc_mutex is held
@@ -2114,15 +2184,7 @@ cwc_service_destroy(th_descrambler_t *td)
 
   LIST_REMOVE(ct, cs_link);
 
-#if ENABLE_DVBCSA
-  dvbcsa_bs_key_free(ct->cs_key_odd);
-  dvbcsa_bs_key_free(ct->cs_key_even);
-  free(ct->cs_tsbbatch_odd);
-  free(ct->cs_tsbbatch_even);
-#else
-  free_key_struct(ct->cs_keys);
-#endif
-  free(ct->cs_tsbcluster);
+  tvhcsa_destroy(ct->cs_csa);
   free(ct);
 }
 
@@ -2166,22 +2228,7 @@ cwc_service_start(service_t *t)
       continue;
 
     ct                   = calloc(1, sizeof(cwc_service_t));
-#if ENABLE_DVBCSA
-    ct->cs_cluster_size  = dvbcsa_bs_batch_size();
-#else
-    ct->cs_cluster_size  = get_suggested_cluster_size();
-#endif
-    ct->cs_tsbcluster    = malloc(ct->cs_cluster_size * 188);
-#if ENABLE_DVBCSA
-    ct->cs_tsbbatch_even = malloc((ct->cs_cluster_size + 1) *
-                                   sizeof(struct dvbcsa_bs_batch_s));
-    ct->cs_tsbbatch_odd  = malloc((ct->cs_cluster_size + 1) *
-                                   sizeof(struct dvbcsa_bs_batch_s));
-    ct->cs_key_even      = dvbcsa_bs_key_alloc();
-    ct->cs_key_odd       = dvbcsa_bs_key_alloc();
-#else
-    ct->cs_keys          = get_key_struct();
-#endif
+    ct->cs_csa           = tvhcsa_create(t);
     ct->cs_cwc           = cwc;
     ct->cs_service       = t;
     ct->cs_channel       = -1;
@@ -2488,6 +2535,7 @@ cwc_init(void)
 
   TAILQ_INIT(&cwcs);
   pthread_mutex_init(&cwc_mutex, NULL);
+  pthread_mutex_init(&ecm_cache_mutex, NULL);
   pthread_cond_init(&cwc_config_changed, NULL);
 
   dt = dtable_create(&cwc_dtc, "cwc", NULL);
@@ -2495,6 +2543,53 @@ cwc_init(void)
 }
 
 
+/**
+ *
+ */
+void
+cwc_set_ecm_parallel(int on)
+{
+  cwc_ecm_parallel = !!on;
+}
+
+/**
+ * Dump cache and server stats (for statedump)
+ */
+void
+cwc_dump(htsbuf_queue_t *hq)
+{
+  cwc_t *cwc;
+  int i, used = 0;
+
+  pthread_mutex_lock(&ecm_cache_mutex);
+  for(i = 0; i < ECM_CACHE_SIZE; i++)
+    if(ecm_cache[i].ce_valid)
+      used++;
+  htsbuf_qprintf(hq, "ECM cache: %d of %d keys, %u hits, %u waits, "
+                 "%u misses, parallel requests %s\n",
+                 used, ECM_CACHE_SIZE, ecm_cache_hits, ecm_cache_waits,
+                 ecm_cache_misses, cwc_ecm_parallel ? "on" : "off");
+  pthread_mutex_unlock(&ecm_cache_mutex);
+
+  htsbuf_qprintf(hq, "\n%-30s %6s %8s %8s  Reply latency (ms)\n%55s",
+                 "Server", "CAID", "OK", "NOK", "");
+  for(i = 0; i < CWC_HIST_BUCKETS - 1; i++)
+    htsbuf_qprintf(hq, " <%-5d", cwc_hist_limits[i]);
+  htsbuf_qprintf(hq, " >=%-4d\n", cwc_hist_limits[CWC_HIST_BUCKETS - 2]);
+
+  pthread_mutex_lock(&cwc_mutex);
+  TAILQ_FOREACH(cwc, &cwcs, cwc_link) {
+    htsbuf_qprintf(hq, "%-24s:%-5d %04x   %8u %8u  ",
+                   cwc->cwc_hostname ?: "", cwc->cwc_port, cwc->cwc_caid,
+                   cwc->cwc_ecm_ok, cwc->cwc_ecm_nok);
+    for(i = 0; i < CWC_HIST_BUCKETS; i++)
+      htsbuf_qprintf(hq, " %-6u", cwc->cwc_ecm_hist[i]);
+    htsbuf_qprintf(hq, "\n");
+  }
+  pthread_mutex_unlock(&cwc_mutex);
+}
+
+
 #include <openssl/md5.h>
 
 /*
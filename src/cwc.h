@@ -19,10 +19,19 @@
 #ifndef CWC_H_
 #define CWC_H_
 
+#include "htsbuf.h"
+
 void cwc_init(void);
 
 void cwc_service_start(struct service *t);
 
 void cwc_emm(uint8_t *data, int len, uint16_t caid, void *ca_update_id);
 
+/**
+ * Send ECMs to every server even if an identical request is pending
+ */
+void cwc_set_ecm_parallel(int on);
+
+void cwc_dump(htsbuf_queue_t *hq);
+
 #endif /* CWC_H_ */
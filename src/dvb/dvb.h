@@ -169,14 +169,33 @@ typedef struct th_dvb_mux_instance {
 /**
  * When in raw mode we need to enqueue raw TS packet
  * to a different thread because we need to hold
- * global_lock when doing delivery of the tables
+ * global_lock when doing delivery of the tables.
+ *
+ * This is done via a single producer (DVR thread) single consumer
+ * (table thread) ring of TS packets, size must be a power of two.
  */
-TAILQ_HEAD(dvb_table_feed_queue, dvb_table_feed);
+#define TDA_TABLE_FEED_SIZE 2048
+
 
-typedef struct dvb_table_feed {
-  TAILQ_ENTRY(dvb_table_feed) dtf_link;
-  uint8_t dtf_tsb[188];
-} dvb_table_feed_t;
+/**
+ * PID -> (service, elementary stream) dispatch table used by the DVR
+ * input thread. Rebuilt (by the DVR thread, with tda_delivery_mutex held)
+ * whenever the set of bound transports or their components change, so
+ * each TS packet is only handed to the services that carry its PID.
+ */
+LIST_HEAD(dvb_pid_dispatch_list, dvb_pid_dispatch);
+
+typedef struct dvb_pid_dispatch {
+  LIST_ENTRY(dvb_pid_dispatch) dpd_link;
+  struct dvb_pid_dispatch *dpd_next;  // Next entry for the same PID
+  struct service *dpd_service;
+  struct elementary_stream *dpd_stream;
+  int dpd_gen;                        // s_components_gen when built
+} dvb_pid_dispatch_t;
+
+#define TDA_DVR_BUFSIZE_DEF  64       // KB
+#define TDA_DVR_BUFSIZE_MIN  4
+#define TDA_DVR_BUFSIZE_MAX  1024
 
 
 
@@ -228,6 +247,7 @@ typedef struct th_dvb_adapter {
   uint32_t tda_disable_pmt_monitor;
   int32_t  tda_full_mux_rx;
   uint32_t tda_grace_period;
+  uint32_t tda_dvr_bufsize; // DVR read buffer in KB
   char *tda_displayname;
 
   char *tda_fe_path;
@@ -275,24 +295,45 @@ typedef struct th_dvb_adapter {
   int tda_rawmode;
 
   int tda_bytes;
+  int tda_packets;
+  int tda_reads;
 
   // Full mux streaming, protected via the delivery mutex
 
   streaming_pad_t tda_streaming_pad;
 
 
-  struct dvb_table_feed_queue tda_table_feed;
+  uint8_t *tda_table_feed;
+  volatile unsigned int tda_table_feed_head; // Written by DVR thread
+  volatile unsigned int tda_table_feed_tail; // Written with global_lock held
+  int tda_table_feed_overflow;
   pthread_cond_t tda_table_feed_cond;  // Bound to tda_delivery_mutex
 
   // PIDs that needs to be requeued and processed as tables
   uint8_t tda_table_filter[8192];
 
+  // PID dispatch table, only accessed from the DVR thread
+  int tda_pid_map_dirty;  // Protected via the delivery mutex
+  dvb_pid_dispatch_t *tda_pid_map[8192];
+  struct dvb_pid_dispatch_list tda_pid_map_entries;
+  struct dvb_pid_dispatch_list tda_pid_map_services;
+
 
 } th_dvb_adapter_t;
 
 /**
  * DVB table
  */
+/**
+ * A section already handled, see TDT_DEDUP
+ */
+typedef struct th_dvb_section {
+  uint32_t tds_key;      // table_id, table_id_extension, section_number
+  uint32_t tds_crc;
+  uint8_t  tds_version;  // including current_next_indicator
+  uint8_t  tds_used;
+} th_dvb_section_t;
+
 typedef struct th_dvb_table {
   /**
    * Flags, must never be changed after creation.
@@ -336,6 +377,15 @@ typedef struct th_dvb_table {
 
   psi_section_t tdt_sect; // Manual reassembly
 
+  /**
+   * Open addressed hash of handled sections (TDT_DEDUP)
+   */
+  th_dvb_section_t *tdt_sections;
+  int tdt_sections_size;
+  int tdt_sections_used;
+  uint32_t tdt_dedup_hits;
+  uint32_t tdt_dedup_misses;
+
 } th_dvb_table_t;
 
 
@@ -388,6 +438,8 @@ void dvb_adapter_set_full_mux_rx(th_dvb_adapter_t *tda, int r);
 
 void dvb_adapter_set_grace_period(th_dvb_adapter_t *tda, uint32_t p);
 
+void dvb_adapter_set_dvr_bufsize(th_dvb_adapter_t *tda, uint32_t kb);
+
 void dvb_adapter_clone(th_dvb_adapter_t *dst, th_dvb_adapter_t *src);
 
 void dvb_adapter_clean(th_dvb_adapter_t *tda);
@@ -535,6 +587,7 @@ int dvb_pidx11_callback
 #define TDT_QUICKREQ      0x2
 #define TDT_CA		        0x4
 #define TDT_TDT           0x8
+#define TDT_DEDUP         0x10  // Drop repeated sections (same version+CRC)
 
 void dvb_table_dispatch(uint8_t *sec, int r, th_dvb_table_t *tdt);
 
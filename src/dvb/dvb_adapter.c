@@ -86,6 +86,7 @@ tda_alloc(void)
   TAILQ_INIT(&tda->tda_initial_scan_queue);
   TAILQ_INIT(&tda->tda_satconfs);
   streaming_pad_init(&tda->tda_streaming_pad);
+  tda->tda_dvr_bufsize = TDA_DVR_BUFSIZE_DEF;
   return tda;
 }
 
@@ -124,6 +125,7 @@ tda_save(th_dvb_adapter_t *tda)
   htsmsg_add_u32(m, "disable_pmt_monitor", tda->tda_disable_pmt_monitor);
   htsmsg_add_s32(m, "full_mux_rx", tda->tda_full_mux_rx);
   htsmsg_add_u32(m, "grace_period", tda->tda_grace_period);
+  htsmsg_add_u32(m, "dvr_bufsize", tda->tda_dvr_bufsize);
   hts_settings_save(m, "dvbadapters/%s", tda->tda_identifier);
   htsmsg_destroy(m);
 }
@@ -458,6 +460,28 @@ dvb_adapter_set_grace_period(th_dvb_adapter_t *tda, uint32_t p)
   tda_save(tda);
 }
 
+/**
+ *
+ */
+void
+dvb_adapter_set_dvr_bufsize(th_dvb_adapter_t *tda, uint32_t kb)
+{
+  if (kb < TDA_DVR_BUFSIZE_MIN) kb = TDA_DVR_BUFSIZE_MIN;
+  if (kb > TDA_DVR_BUFSIZE_MAX) kb = TDA_DVR_BUFSIZE_MAX;
+
+  if (tda->tda_dvr_bufsize == kb)
+    return;
+
+  lock_assert(&global_lock);
+
+  tvhlog(LOG_NOTICE, "dvb",
+         "Adapter \"%s\" DVR buffer size set to %dKB (applied on next tune)",
+         tda->tda_displayname, kb);
+
+  tda->tda_dvr_bufsize = kb;
+  tda_save(tda);
+}
+
 
 /**
  *
@@ -825,6 +849,7 @@ dvb_adapter_init(uint32_t adapter_mask, const char *rawfile)
       htsmsg_get_u32(c, "disable_pmt_monitor", &tda->tda_disable_pmt_monitor);
       if (htsmsg_get_u32(c, "grace_period",        &tda->tda_grace_period))
         tda->tda_grace_period = 10;
+      htsmsg_get_u32(c, "dvr_bufsize",         &tda->tda_dvr_bufsize);
       if (htsmsg_get_s32(c, "full_mux_rx", &tda->tda_full_mux_rx))
         if (!htsmsg_get_u32(c, "disable_full_mux_rx", &u32) && u32)
           tda->tda_full_mux_rx = 0;
@@ -1025,6 +1050,100 @@ dvb_adapter_raw_filter(th_dvb_adapter_t *tda)
   return dmx;
 }
 
+/**
+ * Release the PID dispatch table
+ */
+static void
+dvb_adapter_pid_map_flush(th_dvb_adapter_t *tda)
+{
+  dvb_pid_dispatch_t *dpd;
+
+  /* Don't touch dpd_stream here, it may already be gone */
+  memset(tda->tda_pid_map, 0, sizeof(tda->tda_pid_map));
+  while((dpd = LIST_FIRST(&tda->tda_pid_map_entries)) != NULL) {
+    LIST_REMOVE(dpd, dpd_link);
+    free(dpd);
+  }
+  while((dpd = LIST_FIRST(&tda->tda_pid_map_services)) != NULL) {
+    LIST_REMOVE(dpd, dpd_link);
+    free(dpd);
+  }
+}
+
+/**
+ * Rebuild the PID dispatch table from the currently bound transports
+ *
+ * tda_delivery_mutex must be held
+ */
+static void
+dvb_adapter_pid_map_build(th_dvb_adapter_t *tda)
+{
+  service_t *t;
+  elementary_stream_t *st;
+  dvb_pid_dispatch_t *dpd;
+
+  dvb_adapter_pid_map_flush(tda);
+
+  LIST_FOREACH(t, &tda->tda_transports, s_active_link) {
+    pthread_mutex_lock(&t->s_stream_mutex);
+
+    dpd = calloc(1, sizeof(dvb_pid_dispatch_t));
+    dpd->dpd_service = t;
+    dpd->dpd_gen     = t->s_components_gen;
+    LIST_INSERT_HEAD(&tda->tda_pid_map_services, dpd, dpd_link);
+
+    TAILQ_FOREACH(st, &t->s_components, es_link) {
+      if(st->es_pid < 0 || st->es_pid >= 0x2000)
+        continue;
+      dpd = malloc(sizeof(dvb_pid_dispatch_t));
+      dpd->dpd_service = t;
+      dpd->dpd_stream  = st;
+      dpd->dpd_gen     = t->s_components_gen;
+      dpd->dpd_next    = tda->tda_pid_map[st->es_pid];
+      tda->tda_pid_map[st->es_pid] = dpd;
+      LIST_INSERT_HEAD(&tda->tda_pid_map_entries, dpd, dpd_link);
+    }
+
+    pthread_mutex_unlock(&t->s_stream_mutex);
+  }
+
+  tda->tda_pid_map_dirty = 0;
+}
+
+/**
+ * Check the PID dispatch table against the bound transports and flag
+ * services that have not seen any input yet
+ *
+ * tda_delivery_mutex must be held
+ */
+static void
+dvb_adapter_pid_map_check(th_dvb_adapter_t *tda)
+{
+  dvb_pid_dispatch_t *dpd;
+  service_t *t;
+
+  if(!tda->tda_pid_map_dirty)
+    LIST_FOREACH(dpd, &tda->tda_pid_map_services, dpd_link)
+      if(dpd->dpd_service->s_components_gen != dpd->dpd_gen) {
+        tda->tda_pid_map_dirty = 1;
+        break;
+      }
+
+  if(tda->tda_pid_map_dirty)
+    dvb_adapter_pid_map_build(tda);
+
+  /* Packets are only dispatched to services carrying the PID, so raise
+     the hardware input flag here for services that got nothing yet */
+  LIST_FOREACH(t, &tda->tda_transports, s_active_link)
+    if(t->s_dvb_mux_instance == tda->tda_mux_current &&
+       t->s_status == SERVICE_RUNNING &&
+       !(t->s_streaming_status & TSS_INPUT_HARDWARE)) {
+      pthread_mutex_lock(&t->s_stream_mutex);
+      service_set_streaming_status_flags(t, TSS_INPUT_HARDWARE);
+      pthread_mutex_unlock(&t->s_stream_mutex);
+    }
+}
+
 /**
  *
  */
@@ -1032,9 +1151,9 @@ static void *
 dvb_adapter_input_dvr(void *aux)
 {
   th_dvb_adapter_t *tda = aux;
-  int fd = -1, i, r, c, nfds, dmx = -1;
-  uint8_t tsb[188 * 10];
-  service_t *t;
+  int fd = -1, i, r, c, nfds, dmx = -1, npkt, bufsize;
+  uint8_t *tsb;
+  dvb_pid_dispatch_t *dpd;
   tvhpoll_t *pd;
   tvhpoll_event_t ev[2];
 
@@ -1052,6 +1171,15 @@ dvb_adapter_input_dvr(void *aux)
     return NULL;
   }
 
+  /* Read buffer, a whole number of TS packets */
+  bufsize = tda->tda_dvr_bufsize * 1024;
+  bufsize = MAX(bufsize - (bufsize % 188), 188 * 10);
+  tsb = malloc(bufsize);
+
+  pthread_mutex_lock(&tda->tda_delivery_mutex);
+  tda->tda_pid_map_dirty = 1;
+  pthread_mutex_unlock(&tda->tda_delivery_mutex);
+
   pd = tvhpoll_create(2);
   memset(ev, 0, sizeof(ev));
   ev[0].data.fd = ev[0].fd = tda->tda_dvr_pipe.rd;
@@ -1073,7 +1201,7 @@ dvb_adapter_input_dvr(void *aux)
     if (ev[0].data.fd != fd) break;
 
     /* Read data */
-    c = read(fd, tsb+r, sizeof(tsb)-r);
+    c = read(fd, tsb+r, bufsize-r);
     if (c < 0) {
       if (errno == EAGAIN || errno == EINTR)
         continue;
@@ -1090,14 +1218,18 @@ dvb_adapter_input_dvr(void *aux)
     }
     r += c;
     atomic_add(&tda->tda_bytes, c);
+    atomic_add(&tda->tda_reads, 1);
 
     /* not enough data */
     if (r < 188) continue;
 
     int wakeup_table_feed = 0;  // Just wanna wakeup once
+    npkt = 0;
 
     pthread_mutex_lock(&tda->tda_delivery_mutex);
 
+    dvb_adapter_pid_map_check(tda);
+
     if(LIST_FIRST(&tda->tda_streaming_pad.sp_targets) != NULL) {
       streaming_message_t sm;
       pktbuf_t *pb = pktbuf_alloc(tsb, r);
@@ -1117,19 +1249,32 @@ dvb_adapter_input_dvr(void *aux)
 
 	      if(tda->tda_table_filter[pid]) {
 	        if(!(tsb[i+1] & 0x80)) { // Only dispatch to table parser if not error
-	          dvb_table_feed_t *dtf = malloc(sizeof(dvb_table_feed_t));
-	          memcpy(dtf->dtf_tsb, tsb + i, 188);
-	          TAILQ_INSERT_TAIL(&tda->tda_table_feed, dtf, dtf_link);
-	          wakeup_table_feed = 1;
+	          unsigned int head = tda->tda_table_feed_head;
+	          if(head - tda->tda_table_feed_tail >= TDA_TABLE_FEED_SIZE) {
+	            atomic_add(&tda->tda_table_feed_overflow, 1);
+	          } else {
+	            memcpy(tda->tda_table_feed +
+	                   (head & (TDA_TABLE_FEED_SIZE - 1)) * 188, tsb + i, 188);
+	            __sync_synchronize();
+	            tda->tda_table_feed_head = head + 1;
+	            wakeup_table_feed = 1;
+	          }
 	        }
 	      } else {
-          LIST_FOREACH(t, &tda->tda_transports, s_active_link)
-            if(t->s_dvb_mux_instance == tda->tda_mux_current)
-              ts_recv_packet1(t, tsb + i, NULL);
+          for(dpd = tda->tda_pid_map[pid]; dpd != NULL; dpd = dpd->dpd_next)
+            if(dpd->dpd_service->s_dvb_mux_instance == tda->tda_mux_current)
+              tda->tda_pid_map_dirty |=
+                ts_recv_packet1_st(dpd->dpd_service, dpd->dpd_stream,
+                                   dpd->dpd_gen, tsb + i);
+
+          /* Components changed underneath us (PMT update) */
+          if(tda->tda_pid_map_dirty)
+            dvb_adapter_pid_map_build(tda);
         }
 
         i += 188;
         r -= 188;
+        npkt++;
 
       /* no sync */
       } else {
@@ -1144,15 +1289,22 @@ dvb_adapter_input_dvr(void *aux)
 
     pthread_mutex_unlock(&tda->tda_delivery_mutex);
 
+    atomic_add(&tda->tda_packets, npkt);
+
     /* reset buffer */
     if (r) memmove(tsb, tsb+i, r);
     i = 0;
   }
 
+  pthread_mutex_lock(&tda->tda_delivery_mutex);
+  dvb_adapter_pid_map_flush(tda);
+  pthread_mutex_unlock(&tda->tda_delivery_mutex);
+
   if(dmx != -1)
     close(dmx);
   tvhpoll_destroy(pd);
   close(fd);
+  free(tsb);
   return NULL;
 }
 
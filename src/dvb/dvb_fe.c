@@ -91,7 +91,7 @@ dvb_fe_monitor(void *aux)
 {
   th_dvb_adapter_t *tda = aux;
   fe_status_t fe_status;
-  int status, v, vv, i, fec, q, bw;
+  int status, v, vv, i, fec, q, bw, pps, reads;
   th_dvb_mux_instance_t *tdmi = tda->tda_mux_current;
   char buf[50];
   signal_status_t sigstat;
@@ -246,7 +246,13 @@ dvb_fe_monitor(void *aux)
     }
   }
 
-  bw = atomic_exchange(&tda->tda_bytes, 0);
+  bw    = atomic_exchange(&tda->tda_bytes, 0);
+  pps   = atomic_exchange(&tda->tda_packets, 0);
+  reads = atomic_exchange(&tda->tda_reads, 0);
+
+  if((v = atomic_exchange(&tda->tda_table_feed_overflow, 0)) != 0)
+    tvhlog(LOG_WARNING, "dvb", "\"%s\" table feed overflow, %d packets dropped",
+           tda->tda_identifier, v);
 
   if(notify) {
     htsmsg_t *m = htsmsg_create_map();
@@ -269,6 +275,8 @@ dvb_fe_monitor(void *aux)
     htsmsg_add_u32(m, "unc", tdmi->tdmi_unc);
     htsmsg_add_dbl(m, "uncavg", tdmi->tdmi_unc_avg);
     htsmsg_add_u32(m, "bw", bw);
+    htsmsg_add_u32(m, "pps", pps);
+    htsmsg_add_u32(m, "reads", reads);
     notify_by_msg("tvAdapter", m);
   }
 
@@ -300,7 +308,6 @@ void
 dvb_fe_stop(th_dvb_mux_instance_t *tdmi, int retune)
 {
   th_dvb_adapter_t *tda = tdmi->tdmi_adapter;
-  dvb_table_feed_t *dtf;
 
   lock_assert(&global_lock);
 
@@ -314,12 +321,8 @@ dvb_fe_stop(th_dvb_mux_instance_t *tdmi, int retune)
   }
 
   dvb_adapter_stop(tda, TDA_OPT_DVR);
-  pthread_mutex_lock(&tda->tda_delivery_mutex);
-  while((dtf = TAILQ_FIRST(&tda->tda_table_feed))) {
-    TAILQ_REMOVE(&tda->tda_table_feed, dtf, dtf_link);
-    free(dtf);
-  }
-  pthread_mutex_unlock(&tda->tda_delivery_mutex);
+  /* The table thread only consumes with global_lock held */
+  tda->tda_table_feed_tail = tda->tda_table_feed_head;
   dvb_table_flush_all(tdmi);
   tda->tda_locked      = 0;
 
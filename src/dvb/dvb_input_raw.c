@@ -23,6 +23,7 @@
 #include <assert.h>
 #include <sys/ioctl.h>
 #include <unistd.h>
+#include <stdlib.h>
 #include <string.h>
 #include <errno.h>
 #include <fcntl.h>
@@ -98,10 +99,9 @@ got_section(const uint8_t *data, size_t len, void *opaque)
  * so we need to be a bit careful here
  */
 static void
-dvb_table_raw_dispatch(th_dvb_mux_instance_t *tdmi,
-		       const dvb_table_feed_t *dtf)
+dvb_table_raw_dispatch(th_dvb_mux_instance_t *tdmi, const uint8_t *tsb)
 {
-  int pid = (dtf->dtf_tsb[1] & 0x1f) << 8 | dtf->dtf_tsb[2];
+  int pid = (tsb[1] & 0x1f) << 8 | tsb[2];
   th_dvb_table_t *vec[tdmi->tdmi_num_tables], *tdt;
   int i = 0;
   LIST_FOREACH(tdt, &tdmi->tdmi_tables, tdt_link) {
@@ -114,7 +114,7 @@ dvb_table_raw_dispatch(th_dvb_mux_instance_t *tdmi,
     tdt = vec[i];
     if(!tdt->tdt_destroyed) {
       if(tdt->tdt_pid == pid)
-	psi_section_reassemble(&tdt->tdt_sect, dtf->dtf_tsb,
+	psi_section_reassemble(&tdt->tdt_sect, tsb,
 			       0, got_section, tdt);
     }
     dvb_table_release(tdt);
@@ -122,32 +122,42 @@ dvb_table_raw_dispatch(th_dvb_mux_instance_t *tdmi,
 }
 
 /**
- *
+ * Consumer side of the table feed ring. The tail is only advanced
+ * with global_lock held so dvb_fe_stop() can safely discard the
+ * pending packets when the mux goes away
  */
 static void *
 dvb_table_input(void *aux)
 {
   th_dvb_adapter_t *tda = aux;
   th_dvb_mux_instance_t *tdmi;
-  dvb_table_feed_t *dtf;
+  unsigned int tail;
+  int n;
 
   while(1) {
 
     pthread_mutex_lock(&tda->tda_delivery_mutex);
   
-    while((dtf = TAILQ_FIRST(&tda->tda_table_feed)) == NULL)
+    while(tda->tda_table_feed_head == tda->tda_table_feed_tail)
       pthread_cond_wait(&tda->tda_table_feed_cond, &tda->tda_delivery_mutex);
-    TAILQ_REMOVE(&tda->tda_table_feed, dtf, dtf_link);
 
     pthread_mutex_unlock(&tda->tda_delivery_mutex);
 
     pthread_mutex_lock(&global_lock);
 
-    if((tdmi = tda->tda_mux_current) != NULL)
-      dvb_table_raw_dispatch(tdmi, dtf);
+    /* Don't hog global_lock when lagging behind */
+    for(n = 0; n < 64; n++) {
+      if((tail = tda->tda_table_feed_tail) == tda->tda_table_feed_head)
+        break;
+      __sync_synchronize();
+      if((tdmi = tda->tda_mux_current) != NULL)
+        dvb_table_raw_dispatch(tdmi, tda->tda_table_feed +
+                               (tail & (TDA_TABLE_FEED_SIZE - 1)) * 188);
+      __sync_synchronize();
+      tda->tda_table_feed_tail = tail + 1;
+    }
 
     pthread_mutex_unlock(&global_lock);
-    free(dtf);
   }    
   return NULL;
 }
@@ -165,7 +175,7 @@ dvb_input_raw_setup(th_dvb_adapter_t *tda)
   tda->tda_open_table    = open_table;
   tda->tda_close_table   = close_table;
 
-  TAILQ_INIT(&tda->tda_table_feed);
+  tda->tda_table_feed = malloc(TDA_TABLE_FEED_SIZE * 188);
   pthread_cond_init(&tda->tda_table_feed_cond, NULL);
 
   pthread_t ptid;
@@ -90,8 +90,10 @@ dvb_service_start(service_t *t, unsigned int weight, int force_start)
 
   pthread_mutex_lock(&tda->tda_delivery_mutex);
 
-  if(!r)
+  if(!r) {
     LIST_INSERT_HEAD(&tda->tda_transports, t, s_active_link);
+    tda->tda_pid_map_dirty = 1;
+  }
 
   pthread_mutex_unlock(&tda->tda_delivery_mutex);
 
@@ -118,6 +120,7 @@ dvb_service_stop(service_t *t)
 
   pthread_mutex_lock(&tda->tda_delivery_mutex);
   LIST_REMOVE(t, s_active_link);
+  tda->tda_pid_map_dirty = 1;
   pthread_mutex_unlock(&tda->tda_delivery_mutex);
 
   tda->tda_close_service(tda, t);
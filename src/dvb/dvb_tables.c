@@ -72,6 +72,52 @@ dvb_table_fastswitch(th_dvb_mux_instance_t *tdmi)
 }
 
 
+/**
+ * Find the slot of a section in the handled sections hash
+ */
+static th_dvb_section_t *
+dvb_table_section_find(th_dvb_table_t *tdt, uint32_t key)
+{
+  int mask = tdt->tdt_sections_size - 1;
+  int i = (key * 2654435761U) >> 16 & mask;
+  th_dvb_section_t *tds;
+
+  while((tds = &tdt->tdt_sections[i])->tds_used && tds->tds_key != key)
+    i = (i + 1) & mask;
+  return tds;
+}
+
+/**
+ * Remember a section that was handled successfully
+ */
+static void
+dvb_table_section_add(th_dvb_table_t *tdt, uint32_t key, uint8_t version,
+                      uint32_t crc)
+{
+  th_dvb_section_t *old = tdt->tdt_sections, *tds;
+  int i, size = tdt->tdt_sections_size;
+
+  /* Keep the load factor below 1/2 */
+  if(2 * (tdt->tdt_sections_used + 1) > size) {
+    tdt->tdt_sections_size = size ? 2 * size : 64;
+    tdt->tdt_sections = calloc(tdt->tdt_sections_size,
+                               sizeof(th_dvb_section_t));
+    for(i = 0; i < size; i++)
+      if(old[i].tds_used)
+        *dvb_table_section_find(tdt, old[i].tds_key) = old[i];
+    free(old);
+  }
+
+  tds = dvb_table_section_find(tdt, key);
+  if(!tds->tds_used) {
+    tds->tds_used = 1;
+    tds->tds_key  = key;
+    tdt->tdt_sections_used++;
+  }
+  tds->tds_version = version;
+  tds->tds_crc     = crc;
+}
+
 /**
  *
  */
@@ -82,11 +128,31 @@ dvb_table_dispatch(uint8_t *sec, int r, th_dvb_table_t *tdt)
     return;
 
   int chkcrc = tdt->tdt_flags & TDT_CRC;
+  int dedup = 0;
   int tableid, len;
   uint8_t *ptr;
   int ret;
+  uint32_t key = 0, crc = 0;
+  th_dvb_section_t *tds;
   th_dvb_mux_instance_t *tdmi = tdt->tdt_tdmi;
 
+  /* Carousels repeat unchanged sections all the time, drop those before
+     the CRC check, they were verified when first seen */
+  if((tdt->tdt_flags & TDT_DEDUP) && chkcrc && r >= 12 && (sec[1] & 0x80)) {
+    dedup = 1;
+    key = sec[0] << 24 | sec[3] << 16 | sec[4] << 8 | sec[6];
+    crc = sec[r-4] << 24 | sec[r-3] << 16 | sec[r-2] << 8 | sec[r-1];
+    if(tdt->tdt_sections != NULL) {
+      tds = dvb_table_section_find(tdt, key);
+      if(tds->tds_used && tds->tds_version == (sec[5] & 0x3f) &&
+         tds->tds_crc == crc) {
+        tdt->tdt_dedup_hits++;
+        return;
+      }
+    }
+    tdt->tdt_dedup_misses++;
+  }
+
   /* It seems some hardware (or is it the dvb API?) does not
      honour the DMX_CHECK_CRC flag, so we check it again */
   if(chkcrc && tvh_crc32(sec, r, 0xffffffff))
@@ -113,8 +179,11 @@ dvb_table_dispatch(uint8_t *sec, int r, th_dvb_table_t *tdt)
   else
     ret = tdt->tdt_callback(tdt->tdt_tdmi, ptr, len, tableid, tdt->tdt_opaque);
   
-  if(ret == 0)
+  if(ret == 0) {
     tdt->tdt_count++;
+    if(dedup && !tdt->tdt_destroyed)
+      dvb_table_section_add(tdt, key, sec[5] & 0x3f, crc);
+  }
 
   if(tdt->tdt_flags & TDT_QUICKREQ)
     dvb_table_fastswitch(tdmi);
@@ -127,8 +196,10 @@ dvb_table_dispatch(uint8_t *sec, int r, th_dvb_table_t *tdt)
 void
 dvb_table_release(th_dvb_table_t *tdt)
 {
-  if(--tdt->tdt_refcount == 0)
+  if(--tdt->tdt_refcount == 0) {
+    free(tdt->tdt_sections);
     free(tdt);
+  }
 }
 
 
@@ -1155,12 +1226,12 @@ dvb_table_add_default_dvb(th_dvb_mux_instance_t *tdmi)
   /* Network Information Table */
 
   tdt_add(tdmi, 0, 0, dvb_nit_callback, NULL, "nit", 
-	  TDT_QUICKREQ | TDT_CRC, 0x10);
+	  TDT_QUICKREQ | TDT_CRC | TDT_DEDUP, 0x10);
 
   /* Service Descriptor Table and Bouqeut Allocation Table */
 
   tdt_add(tdmi, 0, 0, dvb_pidx11_callback, NULL, "pidx11", 
-	  TDT_QUICKREQ | TDT_CRC, 0x11);
+	  TDT_QUICKREQ | TDT_CRC | TDT_DEDUP, 0x11);
 
   /* Time Offset Table */
 
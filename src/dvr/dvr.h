@@ -241,6 +241,12 @@ typedef struct dvr_autorec_entry {
   epg_serieslink_t *dae_serieslink;
   epg_episode_num_t dae_epnum;
 
+  /* Match index (see dvr_autorec.c) */
+  struct dvr_autorec_entry *dae_index_next;
+  const void *dae_index_key;
+  int dae_index_seq;
+  int dae_index_mark;
+
 } dvr_autorec_entry_t;
 
 
@@ -377,6 +383,7 @@ void dvr_autorec_check_event(epg_broadcast_t *e);
 void dvr_autorec_check_brand(epg_brand_t *b);
 void dvr_autorec_check_season(epg_season_t *s);
 void dvr_autorec_check_serieslink(epg_serieslink_t *s);
+void dvr_autorec_check_done(void);
 
 
 void autorec_destroy_by_channel(channel_t *ch);
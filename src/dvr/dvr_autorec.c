@@ -44,6 +44,14 @@ struct dvr_autorec_entry_queue autorec_entries;
 
 static void dvr_autorec_changed(dvr_autorec_entry_t *dae, int purge);
 
+/* Matching stats, since the last dvr_autorec_check_done() */
+static struct {
+  int     events;
+  int     candidates;
+  int     regex;
+  int64_t time;
+} autorec_stats;
+
 /**
  * Unlink - and remove any unstarted
  */
@@ -100,6 +108,7 @@ autorec_cmp(dvr_autorec_entry_t *dae, epg_broadcast_t *e)
   if(dae->dae_title != NULL && dae->dae_title[0] != '\0') {
     lang_str_ele_t *ls;
     if(!e->episode->title) return 0;
+    autorec_stats.regex++;
     RB_FOREACH(ls, e->episode->title, link)
       if (!regexec(&dae->dae_title_preg, ls->str, 0, NULL, 0)) break;
     if (!ls) return 0;
@@ -125,20 +134,15 @@ autorec_cmp(dvr_autorec_entry_t *dae, epg_broadcast_t *e)
       return 0;
   }
 
-  if(dae->dae_approx_time != 0) {
-    struct tm a_time;
-    struct tm ev_time;
-    localtime_r(&e->start, &a_time);
-    localtime_r(&e->start, &ev_time);
-    a_time.tm_min = dae->dae_approx_time % 60;
-    a_time.tm_hour = dae->dae_approx_time / 60;
-    if(abs(mktime(&a_time) - mktime(&ev_time)) > 900)
-      return 0;
-  }
-
-  if(dae->dae_weekdays != 0x7f) {
+  if(dae->dae_approx_time != 0 || dae->dae_weekdays != 0x7f) {
     struct tm tm;
     localtime_r(&e->start, &tm);
+
+    // Same day and DST flag, so this is the wall clock difference
+    if(dae->dae_approx_time != 0 &&
+       abs(tm.tm_hour * 60 + tm.tm_min - dae->dae_approx_time) > 15)
+      return 0;
+
     if(!((1 << ((tm.tm_wday ?: 7) - 1)) & dae->dae_weekdays))
       return 0;
   }
@@ -146,6 +150,351 @@ autorec_cmp(dvr_autorec_entry_t *dae, epg_broadcast_t *e)
 }
 
 
+/* **************************************************************************
+ * Match index
+ *
+ * Every rule is filed under a single key which a broadcast must have for
+ * the rule to match: its serieslink, season or brand, a literal string
+ * its title regex requires, its channel or its channel tag. Rules with
+ * none of those are always tested. A broadcast is then only run through
+ * autorec_cmp() for the rules found under its own keys.
+ *
+ * The literals are searched for with an Aho-Corasick automaton over case
+ * folded titles. The index is rebuilt whenever a rule changes.
+ * *************************************************************************/
+
+#define AUTOREC_HASH_SIZE   512
+#define AUTOREC_LITERAL_MIN 3
+#define AUTOREC_LITERAL_MAX 64
+#define AUTOREC_AC_SYMS     64
+
+typedef struct autorec_ac_node {
+  int32_t              next[AUTOREC_AC_SYMS];
+  int32_t              fail;
+  int32_t              dict;  // nearest node with rules via fail links
+  dvr_autorec_entry_t *rules;
+} autorec_ac_node_t;
+
+static int                  autorec_index_dirty = 1;
+static dvr_autorec_entry_t *autorec_index_hash[AUTOREC_HASH_SIZE];
+static dvr_autorec_entry_t *autorec_index_rest;
+static autorec_ac_node_t   *autorec_ac;
+static int                  autorec_ac_count;
+static int                  autorec_ac_size;
+
+static dvr_autorec_entry_t **autorec_cand;
+static int                   autorec_cand_size;
+static int                   autorec_mark;
+
+static inline int
+autorec_hash(const void *key)
+{
+  return ((uintptr_t)key >> 4) & (AUTOREC_HASH_SIZE - 1);
+}
+
+/**
+ * Fold a title byte to the automaton alphabet, unrelated punctuation
+ * may share a symbol (the regex sorts that out)
+ */
+static inline int
+autorec_ac_sym(uint8_t c)
+{
+  if (c >= 128)             return 63;
+  if (c >= '0' && c <= '9') return 1 + c - '0';
+  if (c >= 'a' && c <= 'z') return 11 + c - 'a';
+  if (c >= 'A' && c <= 'Z') return 11 + c - 'A';
+  return 37 + c % 26;
+}
+
+/**
+ * Longest run of (lower case ASCII) literal characters every match of
+ * the extended regex must contain, returns its length (0 if none)
+ */
+static int
+autorec_title_literal(const char *re, char *lit)
+{
+  char run[AUTOREC_LITERAL_MAX];
+  int rlen = 0, best = 0, depth = 0, last = 0;
+  const char *p = re;
+  uint8_t c;
+
+#define FLUSH() do { \
+  if (rlen > best) { memcpy(lit, run, rlen); best = rlen; } \
+  rlen = 0; \
+} while (0)
+
+  while (*p) {
+    c = *p;
+
+    /* Alternation, nothing is required */
+    if (c == '|' && depth == 0)
+      return 0;
+
+    /* Quantifiers, the previous character is optional */
+    if (c == '*' || c == '?' || c == '{') {
+      if (last) rlen--;
+      FLUSH();
+      if (c == '{')
+        while (*p && *p != '}') p++;
+      if (*p) p++;
+      last = 0;
+      continue;
+    }
+
+    /* Escapes of meta characters are literal */
+    if (c == '\\') {
+      if (p[1] && strchr(".[](){}*+?|^$\\/-", p[1])) {
+        c = p[1];
+        p++;
+      } else {
+        FLUSH();
+        p += p[1] ? 2 : 1;
+        last = 0;
+        continue;
+      }
+
+    /* Bracket expressions */
+    } else if (c == '[') {
+      FLUSH();
+      p++;
+      if (*p == '^') p++;
+      if (*p == ']') p++;
+      while (*p && *p != ']') {
+        if (*p == '[' && (p[1] == ':' || p[1] == '=' || p[1] == '.')) {
+          c  = p[1];
+          p += 2;
+          while (*p && !(p[0] == c && p[1] == ']')) p++;
+          if (*p) p++;
+        }
+        if (*p) p++;
+      }
+      if (*p) p++;
+      last = 0;
+      continue;
+
+    /* Groups are skipped, they may be optional */
+    } else if (c == '(' || c == ')' || c == '.' || c == '^' || c == '$' ||
+               c == '+' || c >= 128) {
+      if (c == '(') depth++;
+      if (c == ')') depth--;
+      FLUSH();
+      p++;
+      last = 0;
+      continue;
+    }
+
+    p++;
+    if (depth || rlen == AUTOREC_LITERAL_MAX) {
+      last = 0;
+      continue;
+    }
+    run[rlen++] = tolower(c);
+    last = 1;
+  }
+  FLUSH();
+#undef FLUSH
+
+  return best >= AUTOREC_LITERAL_MIN ? best : 0;
+}
+
+/**
+ *
+ */
+static int
+autorec_ac_alloc(void)
+{
+  if (autorec_ac_count == autorec_ac_size) {
+    autorec_ac_size = MAX(64, autorec_ac_size * 2);
+    autorec_ac = realloc(autorec_ac, autorec_ac_size * sizeof(autorec_ac_node_t));
+  }
+  memset(&autorec_ac[autorec_ac_count], 0, sizeof(autorec_ac_node_t));
+  return autorec_ac_count++;
+}
+
+/**
+ * Add the failure and dictionary links and complete the transitions
+ */
+static void
+autorec_ac_link(void)
+{
+  int32_t *queue = malloc(autorec_ac_count * sizeof(int32_t));
+  int head = 0, tail = 0, u, v, f, s;
+
+  queue[tail++] = 0;
+  while (head < tail) {
+    u = queue[head++];
+    for (s = 0; s < AUTOREC_AC_SYMS; s++) {
+      v = autorec_ac[u].next[s];
+      f = u ? autorec_ac[autorec_ac[u].fail].next[s] : 0;
+      if (v) {
+        autorec_ac[v].fail = f;
+        autorec_ac[v].dict = autorec_ac[f].rules ? f : autorec_ac[f].dict;
+        queue[tail++] = v;
+      } else {
+        autorec_ac[u].next[s] = f;
+      }
+    }
+  }
+  free(queue);
+}
+
+/**
+ *
+ */
+static void
+autorec_index_build(void)
+{
+  dvr_autorec_entry_t *dae;
+  dvr_config_t *cfg;
+  const void *key;
+  char lit[AUTOREC_LITERAL_MAX];
+  int i, n, len, seq = 0;
+  int64_t mono = getmonoclock();
+
+  memset(autorec_index_hash, 0, sizeof(autorec_index_hash));
+  autorec_index_rest = NULL;
+  autorec_ac_count   = 0;
+  autorec_ac_alloc();
+
+  TAILQ_FOREACH(dae, &autorec_entries, dae_link) {
+    dae->dae_index_seq  = seq++;
+    dae->dae_index_key  = NULL;
+    dae->dae_index_next = NULL;
+
+    /* Never matches */
+    if (dae->dae_enabled == 0 || dae->dae_weekdays == 0)
+      continue;
+
+    len = 0;
+    key = NULL;
+    if (dae->dae_serieslink)
+      key = dae->dae_serieslink;
+    else if (dae->dae_season)
+      key = dae->dae_season;
+    else if (dae->dae_brand)
+      key = dae->dae_brand;
+    else if (dae->dae_title && dae->dae_title[0] &&
+             (len = autorec_title_literal(dae->dae_title, lit)) > 0)
+      ;
+    else if (dae->dae_channel &&
+             (cfg = dvr_config_find_by_name_default(dae->dae_config_name)) &&
+             cfg->dvr_sl_quality_lock)
+      key = dae->dae_channel;
+    else if (dae->dae_channel_tag)
+      key = dae->dae_channel_tag;
+
+    if (key) {
+      dae->dae_index_key  = key;
+      dae->dae_index_next = autorec_index_hash[autorec_hash(key)];
+      autorec_index_hash[autorec_hash(key)] = dae;
+    } else if (len) {
+      for (i = n = 0; i < len; i++) {
+        int s = autorec_ac_sym(lit[i]);
+        if (!autorec_ac[n].next[s]) {
+          int c = autorec_ac_alloc();
+          autorec_ac[n].next[s] = c;
+        }
+        n = autorec_ac[n].next[s];
+      }
+      dae->dae_index_next = autorec_ac[n].rules;
+      autorec_ac[n].rules = dae;
+    } else {
+      dae->dae_index_next = autorec_index_rest;
+      autorec_index_rest  = dae;
+    }
+  }
+  autorec_ac_link();
+
+  autorec_index_dirty = 0;
+  tvhtrace("autorec", "index built, %d rules, %d nodes in %"PRId64"us",
+           seq, autorec_ac_count, getmonoclock() - mono);
+}
+
+/**
+ *
+ */
+static void
+autorec_cand_add(dvr_autorec_entry_t *dae, int *n)
+{
+  if (dae->dae_index_mark == autorec_mark)
+    return;
+  dae->dae_index_mark = autorec_mark;
+  if (*n == autorec_cand_size) {
+    autorec_cand_size = MAX(16, autorec_cand_size * 2);
+    autorec_cand = realloc(autorec_cand,
+                           autorec_cand_size * sizeof(dvr_autorec_entry_t *));
+  }
+  autorec_cand[(*n)++] = dae;
+}
+
+static void
+autorec_cand_key(const void *key, int *n)
+{
+  dvr_autorec_entry_t *dae;
+
+  if (!key) return;
+  for (dae = autorec_index_hash[autorec_hash(key)]; dae;
+       dae = dae->dae_index_next)
+    if (dae->dae_index_key == key)
+      autorec_cand_add(dae, n);
+}
+
+static int
+autorec_cand_cmp(const void *a, const void *b)
+{
+  return (*(dvr_autorec_entry_t **)a)->dae_index_seq -
+         (*(dvr_autorec_entry_t **)b)->dae_index_seq;
+}
+
+/**
+ * Collect the rules which may match the broadcast, in rule order
+ */
+static int
+autorec_candidates(epg_broadcast_t *e)
+{
+  dvr_autorec_entry_t *dae;
+  channel_tag_mapping_t *ctm;
+  lang_str_ele_t *ls;
+  const uint8_t *p;
+  int n = 0, state, d;
+
+  if (autorec_index_dirty)
+    autorec_index_build();
+
+  if (!e->channel || !e->episode)
+    return 0;
+
+  if (++autorec_mark == 0)
+    autorec_mark = 1;
+
+  autorec_cand_key(e->serieslink, &n);
+  autorec_cand_key(e->episode->season, &n);
+  autorec_cand_key(e->episode->brand, &n);
+  autorec_cand_key(e->channel, &n);
+  LIST_FOREACH(ctm, &e->channel->ch_ctms, ctm_channel_link)
+    autorec_cand_key(ctm->ctm_tag, &n);
+
+  if (e->episode->title && autorec_ac_count > 1) {
+    RB_FOREACH(ls, e->episode->title, link) {
+      state = 0;
+      for (p = (const uint8_t *)ls->str; *p; p++) {
+        state = autorec_ac[state].next[autorec_ac_sym(*p)];
+        for (d = autorec_ac[state].rules ? state : autorec_ac[state].dict; d;
+             d = autorec_ac[d].dict)
+          for (dae = autorec_ac[d].rules; dae; dae = dae->dae_index_next)
+            autorec_cand_add(dae, &n);
+      }
+    }
+  }
+
+  for (dae = autorec_index_rest; dae; dae = dae->dae_index_next)
+    autorec_cand_add(dae, &n);
+
+  if (n > 1)
+    qsort(autorec_cand, n, sizeof(dvr_autorec_entry_t *), autorec_cand_cmp);
+  return n;
+}
+
 /**
  *
  */
@@ -178,6 +527,7 @@ autorec_entry_find(const char *id, int create)
 
   dae->dae_id = strdup(id);
   TAILQ_INSERT_TAIL(&autorec_entries, dae, dae_link);
+  autorec_index_dirty = 1;
   return dae;
 }
 
@@ -217,6 +567,7 @@ autorec_entry_destroy(dvr_autorec_entry_t *dae)
   
 
   TAILQ_REMOVE(&autorec_entries, dae, dae_link);
+  autorec_index_dirty = 1;
   free(dae);
 }
 
@@ -430,6 +781,7 @@ autorec_record_update(void *opaque, const char *id, htsmsg_t *values,
     if (dae->dae_serieslink)
       dae->dae_serieslink->getref(dae->dae_serieslink);
   }
+  autorec_index_dirty = 1;
   if (!dvr_autorec_in_init)
     dvr_autorec_changed(dae, 1);
 
@@ -482,10 +834,13 @@ dvr_autorec_init(void)
 void
 dvr_autorec_update(void)
 {
-  dvr_autorec_entry_t *dae;
-  TAILQ_FOREACH(dae, &autorec_entries, dae_link) {
-    dvr_autorec_changed(dae, 0);
-  }
+  channel_t *ch;
+  epg_broadcast_t *e;
+
+  RB_FOREACH(ch, &channel_name_tree, ch_name_link)
+    RB_FOREACH(e, &ch->ch_epg_schedule, sched_link)
+      dvr_autorec_check_event(e);
+  dvr_autorec_check_done();
 }
 
 static void
@@ -534,6 +889,7 @@ _dvr_autorec_add(const char *config_name,
   }
 
   dae->dae_approx_time = approx_time;
+  autorec_index_dirty = 1;
 
   m = autorec_record_build(dae);
   hts_settings_save(m, "%s/%s", "autorec", dae->dae_id);
@@ -585,13 +941,33 @@ void dvr_autorec_add_series_link
 void
 dvr_autorec_check_event(epg_broadcast_t *e)
 {
-  dvr_autorec_entry_t *dae;
+  int64_t mono = getmonoclock();
+  int i, n;
 
-  TAILQ_FOREACH(dae, &autorec_entries, dae_link)
-    if(autorec_cmp(dae, e))
-      dvr_entry_create_by_autorec(e, dae);
+  n = autorec_candidates(e);
+  for (i = 0; i < n; i++)
+    if(autorec_cmp(autorec_cand[i], e))
+      dvr_entry_create_by_autorec(e, autorec_cand[i]);
   // Note: no longer updating event here as it will be done from EPG
   //       anyway
+
+  autorec_stats.events++;
+  autorec_stats.candidates += n;
+  autorec_stats.time       += getmonoclock() - mono;
+}
+
+/**
+ * End of an EPG update, log the match stats
+ */
+void
+dvr_autorec_check_done(void)
+{
+  if (autorec_stats.events)
+    tvhlog(LOG_DEBUG, "autorec",
+           "checked %d broadcasts, %d candidate rules (%d regex) in %"PRId64"ms",
+           autorec_stats.events, autorec_stats.candidates,
+           autorec_stats.regex, autorec_stats.time / 1000);
+  memset(&autorec_stats, 0, sizeof(autorec_stats));
 }
 
 void dvr_autorec_check_brand(epg_brand_t *b)
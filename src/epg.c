@@ -23,6 +23,7 @@
 #include <regex.h>
 #include <assert.h>
 #include <inttypes.h>
+#include <ctype.h>
 
 #include "tvheadend.h"
 #include "queue.h"
@@ -52,6 +53,26 @@ epg_object_list_t epg_object_updated;
 /* Global counter */
 static uint32_t _epg_object_idx    = 0;
 
+/* Query indexes */
+#define EPG_TITLE_INDEX_BITS  14
+#define EPG_TITLE_INDEX_WIDTH (1 << EPG_TITLE_INDEX_BITS)
+#define EPG_GENRE_INDEX_WIDTH 256
+
+typedef struct epg_index_node
+{
+  LIST_ENTRY(epg_index_node)  link;
+  epg_episode_t              *episode;
+  uint32_t                    key;
+} epg_index_node_t;
+
+typedef LIST_HEAD(,epg_index_node) epg_index_list_t;
+
+static epg_broadcast_tree_t epg_broadcast_start;
+static epg_index_list_t     epg_title_index[EPG_TITLE_INDEX_WIDTH];
+static uint32_t             epg_title_index_count[EPG_TITLE_INDEX_WIDTH];
+static epg_index_list_t     epg_genre_index[EPG_GENRE_INDEX_WIDTH];
+static uint32_t             epg_genre_index_count[EPG_GENRE_INDEX_WIDTH];
+
 /* **************************************************************************
  * Comparators / Ordering
  * *************************************************************************/
@@ -66,6 +87,14 @@ static int _ebc_start_cmp ( const void *a, const void *b )
   return ((epg_broadcast_t*)a)->start - ((epg_broadcast_t*)b)->start;
 }
 
+static int _ebc_start_id_cmp ( const void *_a, const void *_b )
+{
+  const epg_broadcast_t *a = _a, *b = _b;
+  if (a->start != b->start) return a->start < b->start ? -1 : 1;
+  if (a->id    != b->id)    return a->id    < b->id    ? -1 : 1;
+  return 0;
+}
+
 static int _season_order ( const void *_a, const void *_b )
 {
   const epg_season_t *a = (const epg_season_t*)_a;
@@ -116,6 +145,139 @@ void epg_updated ( void )
     eo->_updated = 0;
     eo->created  = dispatch_clock;
   }
+  dvr_autorec_check_done();
+}
+
+/* **************************************************************************
+ * Query indexes
+ * *************************************************************************/
+
+/*
+ * Title index, every episode is linked into the buckets of the (case
+ * folded) character trigrams of all its titles. A regex that is a plain
+ * string can then only match episodes found in any one of its trigram
+ * buckets, the smallest one is used.
+ */
+static inline uint32_t _epg_title_gram ( const uint8_t *p )
+{
+  uint32_t v = 0;
+  int i;
+  for (i = 0; i < 3; i++)
+    v = (v << 8) | (p[i] < 128 ? tolower(p[i]) : p[i]);
+  return (v * 2654435761U) >> (32 - EPG_TITLE_INDEX_BITS);
+}
+
+static int _epg_index_key_cmp ( const void *a, const void *b )
+{
+  uint32_t x = *(const uint32_t*)a, y = *(const uint32_t*)b;
+  return x < y ? -1 : x > y;
+}
+
+static void _epg_index_unlink
+  ( epg_index_node_t **nodes, int *cnt, uint32_t *count )
+{
+  int i;
+  for (i = 0; i < *cnt; i++) {
+    LIST_REMOVE(&(*nodes)[i], link);
+    count[(*nodes)[i].key]--;
+  }
+  free(*nodes);
+  *nodes = NULL;
+  *cnt   = 0;
+}
+
+static void _epg_index_link
+  ( epg_episode_t *ee, epg_index_node_t **nodes, int *cnt,
+    uint32_t *keys, int num, epg_index_list_t *index, uint32_t *count )
+{
+  int i, n = 0;
+
+  qsort(keys, num, sizeof(uint32_t), _epg_index_key_cmp);
+  for (i = 0; i < num; i++)
+    if (!i || keys[i] != keys[i-1])
+      keys[n++] = keys[i];
+  if (!n) return;
+
+  *nodes = calloc(n, sizeof(epg_index_node_t));
+  *cnt   = n;
+  for (i = 0; i < n; i++) {
+    (*nodes)[i].episode = ee;
+    (*nodes)[i].key     = keys[i];
+    LIST_INSERT_HEAD(&index[keys[i]], &(*nodes)[i], link);
+    count[keys[i]]++;
+  }
+}
+
+static void _epg_episode_index_title ( epg_episode_t *ee )
+{
+  lang_str_ele_t *e;
+  uint32_t *keys = NULL;
+  int num = 0, alloced = 0;
+  size_t i, len;
+
+  _epg_index_unlink(&ee->title_idx, &ee->title_idx_cnt,
+                    epg_title_index_count);
+  if (!ee->title) return;
+
+  RB_FOREACH(e, ee->title, link) {
+    len = strlen(e->str);
+    for (i = 0; i + 2 < len; i++) {
+      if (num == alloced) {
+        alloced = MAX(32, alloced * 2);
+        keys    = realloc(keys, alloced * sizeof(uint32_t));
+      }
+      keys[num++] = _epg_title_gram((const uint8_t*)e->str + i);
+    }
+  }
+  _epg_index_link(ee, &ee->title_idx, &ee->title_idx_cnt, keys, num,
+                  epg_title_index, epg_title_index_count);
+  free(keys);
+}
+
+/*
+ * Genre index, one bucket per genre code
+ */
+static void _epg_episode_index_genre ( epg_episode_t *ee )
+{
+  epg_genre_t *g;
+  uint32_t keys[EPG_GENRE_INDEX_WIDTH];
+  int num = 0;
+
+  _epg_index_unlink(&ee->genre_idx, &ee->genre_idx_cnt,
+                    epg_genre_index_count);
+  LIST_FOREACH(g, &ee->genre, link)
+    if (num < EPG_GENRE_INDEX_WIDTH)
+      keys[num++] = g->code;
+  _epg_index_link(ee, &ee->genre_idx, &ee->genre_idx_cnt, keys, num,
+                  epg_genre_index, epg_genre_index_count);
+}
+
+static void _epg_episode_unindex ( epg_episode_t *ee )
+{
+  _epg_index_unlink(&ee->title_idx, &ee->title_idx_cnt,
+                    epg_title_index_count);
+  _epg_index_unlink(&ee->genre_idx, &ee->genre_idx_cnt,
+                    epg_genre_index_count);
+}
+
+/*
+ * Broadcasts on a schedule are in the global start time index and in the
+ * channel's EID hash
+ */
+static void _epg_broadcast_index ( channel_t *ch, epg_broadcast_t *ebc )
+{
+  RB_INSERT_SORTED(&epg_broadcast_start, ebc, start_link, _ebc_start_id_cmp);
+  LIST_INSERT_HEAD(&ch->ch_epg_eid[ebc->dvb_eid & EPG_EID_HASH_MASK],
+                   ebc, eid_link);
+  ebc->scheduled = 1;
+}
+
+static void _epg_broadcast_unindex ( epg_broadcast_t *ebc )
+{
+  if (!ebc->scheduled) return;
+  RB_REMOVE(&epg_broadcast_start, ebc, start_link);
+  LIST_REMOVE(ebc, eid_link);
+  ebc->scheduled = 0;
 }
 
 /* **************************************************************************
@@ -792,6 +954,7 @@ static void _epg_episode_destroy ( void *eo )
   if (ee->subtitle)    lang_str_destroy(ee->subtitle);
   if (ee->summary)     lang_str_destroy(ee->summary);
   if (ee->description) lang_str_destroy(ee->description);
+  _epg_episode_unindex(ee);
   while ((g = LIST_FIRST(&ee->genre))) {
     LIST_REMOVE(g, link);
     free(g);
@@ -836,15 +999,23 @@ int epg_episode_set_title
   ( epg_episode_t *episode, const char *title, const char *lang,
     epggrab_module_t *src )
 {
+  int save;
   if (!episode) return 0;
-  return _epg_object_set_lang_str(episode, &episode->title, title, lang, src);
+  save = _epg_object_set_lang_str(episode, &episode->title, title, lang, src);
+  if (save)
+    _epg_episode_index_title(episode);
+  return save;
 }
 
 int epg_episode_set_title2
   ( epg_episode_t *episode, const lang_str_t *str, epggrab_module_t *src )
 {
+  int save;
   if (!episode || !str) return 0;
-  return _epg_object_set_lang_str2(episode, &episode->title, str, src);
+  save = _epg_object_set_lang_str2(episode, &episode->title, str, src);
+  if (save)
+    _epg_episode_index_title(episode);
+  return save;
 }
 
 int epg_episode_set_subtitle
@@ -997,6 +1168,8 @@ int epg_episode_set_genre
   LIST_FOREACH(g1, genre, link) {
     save |= epg_genre_list_add(&ee->genre, g1);
   }
+  if (save)
+    _epg_episode_index_genre(ee);
 
   return save;
 }
@@ -1352,6 +1525,7 @@ static void _epg_channel_rem_broadcast
 {
   if (new) dvr_event_replaced(ebc, new);
   RB_REMOVE(&ch->ch_epg_schedule, ebc, sched_link);
+  _epg_broadcast_unindex(ebc);
   if (ch->ch_epg_now  == ebc) ch->ch_epg_now  = NULL;
   if (ch->ch_epg_next == ebc) ch->ch_epg_next = NULL;
   _epg_object_putref(ebc);
@@ -1421,6 +1595,7 @@ static epg_broadcast_t *_epg_channel_add_broadcast
   ( channel_t *ch, epg_broadcast_t **bcast, int create, int *save )
 {
   int timer = 0;
+  uint16_t eid;
   epg_broadcast_t *ebc, *ret;
 
   /* Set channel */
@@ -1442,12 +1617,19 @@ static epg_broadcast_t *_epg_channel_add_broadcast
       _epg_object_create(ret);
       // Note: sets updated
       _epg_object_getref(ret);
+      _epg_broadcast_index(ch, ret);
       tvhtrace("epg", "added event %u (%s) on %s @ %"PRItime_t " to %"PRItime_t,
                ret->id, epg_broadcast_get_title(ret, NULL), ch->ch_name, ret->start, ret->stop);
 
     /* Existing */
     } else {
+      eid    = ret->dvb_eid;
       *save |= _epg_object_set_u16(ret, &ret->dvb_eid, (*bcast)->dvb_eid, NULL);
+      if (eid != ret->dvb_eid) {
+        LIST_REMOVE(ret, eid_link);
+        LIST_INSERT_HEAD(&ch->ch_epg_eid[ret->dvb_eid & EPG_EID_HASH_MASK],
+                         ret, eid_link);
+      }
 
       /* No time change */
       if ( ret->stop == (*bcast)->stop ) {
@@ -1511,6 +1693,7 @@ void epg_channel_unlink ( channel_t *ch )
 static void _epg_broadcast_destroy ( void *eo )
 {
   epg_broadcast_t *ebc = eo;
+  _epg_broadcast_unindex(ebc);
   if (ebc->created)     htsp_event_delete(ebc);
   if (ebc->episode)     _epg_episode_rem_broadcast(ebc->episode, ebc);
   if (ebc->serieslink)  _epg_serieslink_rem_broadcast(ebc->serieslink, ebc);
@@ -1569,11 +1752,11 @@ epg_broadcast_t *epg_broadcast_find_by_id ( uint32_t id, channel_t *ch )
 
 epg_broadcast_t *epg_broadcast_find_by_eid ( channel_t *ch, uint16_t eid )
 {
-  epg_broadcast_t *e;
-  RB_FOREACH(e, &ch->ch_epg_schedule, sched_link) {
-    if (e->dvb_eid == eid) return e;
+  epg_broadcast_t *e, *ret = NULL;
+  LIST_FOREACH(e, &ch->ch_epg_eid[eid & EPG_EID_HASH_MASK], eid_link) {
+    if (e->dvb_eid == eid && (!ret || e->start < ret->start)) ret = e;
   }
-  return NULL;
+  return ret;
 }
 
 int epg_broadcast_set_episode 
@@ -2182,9 +2365,30 @@ htsmsg_t *epg_genres_list_all ( int major_only, int major_prefix )
  * Querying
  * *************************************************************************/
 
+static int _eqr_cmp ( const void *a, const void *b )
+{
+  return _ebc_start_id_cmp(*(epg_broadcast_t**)a, *(epg_broadcast_t**)b);
+}
+
+static int _eqr_channel
+  ( channel_t *ch, channel_tag_t *tag, channel_t *channel )
+{
+  channel_tag_mapping_t *ctm;
+  if (channel && ch != channel) return 0;
+  if (!tag) return 1;
+  LIST_FOREACH(ctm, &ch->ch_ctms, ctm_channel_link)
+    if (ctm->ctm_tag == tag) return 1;
+  return 0;
+}
+
+/*
+ * Add a match, when walking in start order (ordered) only the requested
+ * page is stored
+ */
 static void _eqr_add 
   ( epg_query_result_t *eqr, epg_broadcast_t *e,
-    epg_genre_t *genre, regex_t *preg, time_t start, const char *lang )
+    epg_genre_t *genre, regex_t *preg, time_t start, const char *lang,
+    int ordered, int offset, int limit )
 {
   const char *title;
 
@@ -2194,64 +2398,170 @@ static void _eqr_add
   if ( genre && !epg_genre_list_contains(&e->episode->genre, genre, 1) ) return;
   if ( preg && regexec(preg, title, 0, NULL, 0)) return;
 
+  /* Outside of page */
+  if ( ordered ) {
+    eqr->eqr_total++;
+    if ( eqr->eqr_total <= offset ) return;
+    if ( limit && eqr->eqr_entries >= limit ) return;
+  }
+
   /* More space */
   if ( eqr->eqr_entries == eqr->eqr_alloced ) {
     eqr->eqr_alloced = MAX(100, eqr->eqr_alloced * 2);
     eqr->eqr_array   = realloc(eqr->eqr_array, 
-                               eqr->eqr_alloced * sizeof(epg_broadcast_t));
+                               eqr->eqr_alloced * sizeof(epg_broadcast_t*));
   }
   
   /* Store */
   eqr->eqr_array[eqr->eqr_entries++] = e;
 }
 
-static void _eqr_add_channel 
-  ( epg_query_result_t *eqr, channel_t *ch, epg_genre_t *genre,
-    regex_t *preg, time_t start, const char *lang )
+/*
+ * Sort an unordered result and cut out the page
+ */
+static void _eqr_page ( epg_query_result_t *eqr, int offset, int limit )
+{
+  int n;
+  qsort(eqr->eqr_array, eqr->eqr_entries, sizeof(epg_broadcast_t*), _eqr_cmp);
+  eqr->eqr_total = eqr->eqr_entries;
+  offset = MIN(offset, eqr->eqr_entries);
+  n      = eqr->eqr_entries - offset;
+  if (limit && n > limit) n = limit;
+  if (offset)
+    memmove(eqr->eqr_array, eqr->eqr_array + offset,
+            n * sizeof(epg_broadcast_t*));
+  eqr->eqr_entries = n;
+}
+
+/*
+ * Extract the trigram keys of a regex that is a plain string (anchors
+ * allowed), returns the number of keys (0 if the index can't be used)
+ */
+static int _eqr_title_keys ( const char *re, uint32_t *keys, int max )
+{
+  char lit[256];
+  size_t len;
+  int i, n = 0;
+
+  if (*re == '^') re++;
+  len = strlen(re);
+  if (len && re[len-1] == '$') len--;
+  if (len < 3 || len >= sizeof(lit)) return 0;
+  for (i = 0; i < len; i++) {
+    if ((uint8_t)re[i] >= 128 || strchr(".[]()*+?{}|^$\\", re[i]))
+      return 0;
+    lit[i] = re[i];
+  }
+  for (i = 0; i + 2 < len && n < max; i++)
+    keys[n++] = _epg_title_gram((uint8_t*)lit + i);
+  return n;
+}
+
+/*
+ * Candidates from an index bucket (episodes), broadcasts which are no
+ * longer on a schedule are skipped
+ */
+static void _eqr_add_episode
+  ( epg_query_result_t *eqr, epg_episode_t *ee, channel_t *channel,
+    channel_tag_t *tag, epg_genre_t *genre, regex_t *preg, time_t start,
+    const char *lang )
 {
   epg_broadcast_t *ebc;
-  RB_FOREACH(ebc, &ch->ch_epg_schedule, sched_link) {
-    if ( ebc->episode ) _eqr_add(eqr, ebc, genre, preg, start, lang);
+  const char *title;
+
+  if ( preg ) {
+    if ( !(title = epg_episode_get_title(ee, lang)) ) return;
+    if ( regexec(preg, title, 0, NULL, 0) ) return;
+  }
+  LIST_FOREACH(ebc, &ee->broadcasts, ep_link) {
+    if ( !ebc->scheduled ) continue;
+    if ( !_eqr_channel(ebc->channel, tag, channel) ) continue;
+    _eqr_add(eqr, ebc, genre, NULL, start, lang, 0, 0, 0);
   }
 }
 
 void epg_query0
   ( epg_query_result_t *eqr, channel_t *channel, channel_tag_t *tag,
-    epg_genre_t *genre, const char *title, const char *lang )
+    epg_genre_t *genre, const char *title, const char *lang,
+    int start, int limit )
 {
   time_t now;
   channel_tag_mapping_t *ctm;
   regex_t preg0, *preg;
+  epg_broadcast_t *ebc;
+  epg_index_node_t *n;
+  uint32_t keys[64], tcount = 0, gcount = 0, tkey = 0;
+  int i, nkeys = 0, gfirst = 0, glast = -1;
   time(&now);
 
   /* Clear (just incase) */
   memset(eqr, 0, sizeof(epg_query_result_t));
+  if (start < 0) start = 0;
+  if (limit < 0) limit = 0;
 
   /* Setup exp */
   if ( title ) {
     if (regcomp(&preg0, title, REG_ICASE | REG_EXTENDED | REG_NOSUB) )
       return;
     preg = &preg0;
+    nkeys = _eqr_title_keys(title, keys, ARRAY_SIZE(keys));
+    for (i = 0; i < nkeys; i++)
+      if (!i || epg_title_index_count[keys[i]] < tcount) {
+        tkey   = keys[i];
+        tcount = epg_title_index_count[tkey];
+      }
   } else {
     preg = NULL;
   }
+
+  /* Genre buckets (major only matches all minor codes) */
+  if ( genre ) {
+    gfirst = glast = genre->code;
+    if (!(genre->code & 0x0F)) glast |= 0x0F;
+    for (i = gfirst; i <= glast; i++)
+      gcount += epg_genre_index_count[i];
+  }
   
-  /* Single channel */
+  /* Single channel (schedule is in start order) */
   if (channel && !tag) {
-    _eqr_add_channel(eqr, channel, genre, preg, now, lang);
-  
+    RB_FOREACH(ebc, &channel->ch_epg_schedule, sched_link)
+      if ( ebc->episode )
+        _eqr_add(eqr, ebc, genre, preg, now, lang, 1, start, limit);
+
+  /* Title index */
+  } else if ( nkeys && (!genre || tcount <= gcount) ) {
+    LIST_FOREACH(n, &epg_title_index[tkey], link)
+      _eqr_add_episode(eqr, n->episode, channel, tag, genre, preg, now, lang);
+    _eqr_page(eqr, start, limit);
+
+  /* Genre index (an episode is only taken from its first matching code) */
+  } else if ( genre ) {
+    for (i = gfirst; i <= glast; i++)
+      LIST_FOREACH(n, &epg_genre_index[i], link) {
+        epg_genre_t *g;
+        LIST_FOREACH(g, &n->episode->genre, link)
+          if (g->code >= gfirst && g->code <= glast) break;
+        if (g && g->code == i)
+          _eqr_add_episode(eqr, n->episode, channel, tag, NULL, preg,
+                           now, lang);
+      }
+    _eqr_page(eqr, start, limit);
+
   /* Tag based */
   } else if ( tag ) {
     LIST_FOREACH(ctm, &tag->ct_ctms, ctm_tag_link) {
       if(channel == NULL || ctm->ctm_channel == channel)
-        _eqr_add_channel(eqr, ctm->ctm_channel, genre, preg, now, lang);
+        RB_FOREACH(ebc, &ctm->ctm_channel->ch_epg_schedule, sched_link)
+          if ( ebc->episode )
+            _eqr_add(eqr, ebc, genre, preg, now, lang, 0, 0, 0);
     }
+    _eqr_page(eqr, start, limit);
 
-  /* All channels */
+  /* All channels (global start time index) */
   } else {
-    RB_FOREACH(channel, &channel_name_tree, ch_name_link) {
-      _eqr_add_channel(eqr, channel, genre, preg, now, lang);
-    }
+    RB_FOREACH(ebc, &epg_broadcast_start, start_link)
+      if ( ebc->episode )
+        _eqr_add(eqr, ebc, genre, preg, now, lang, 1, start, limit);
   }
   if (preg) regfree(preg);
 
@@ -2259,11 +2569,12 @@ void epg_query0
 }
 
 void epg_query(epg_query_result_t *eqr, const char *channel, const char *tag,
-	       epg_genre_t *genre, const char *title, const char *lang)
+	       epg_genre_t *genre, const char *title, const char *lang,
+               int start, int limit)
 {
   channel_t     *ch = channel ? channel_find_by_name(channel, 0, 0) : NULL;
   channel_tag_t *ct = tag     ? channel_tag_find_by_name(tag, 0)    : NULL;
-  epg_query0(eqr, ch, ct, genre, title, lang);
+  epg_query0(eqr, ch, ct, genre, title, lang, start, limit);
 }
 
 void epg_query_free(epg_query_result_t *eqr)
@@ -2271,15 +2582,9 @@ void epg_query_free(epg_query_result_t *eqr)
   free(eqr->eqr_array);
 }
 
-static int _epg_sort_start_ascending ( const void *a, const void *b )
-{
-  return (*(epg_broadcast_t**)a)->start - (*(epg_broadcast_t**)b)->start;
-}
-
 void epg_query_sort(epg_query_result_t *eqr)
 {
-  qsort(eqr->eqr_array, eqr->eqr_entries, sizeof(epg_broadcast_t*),
-        _epg_sort_start_ascending);
+  qsort(eqr->eqr_array, eqr->eqr_entries, sizeof(epg_broadcast_t*), _eqr_cmp);
 }
 
 /* **************************************************************************
@@ -28,6 +28,7 @@
 struct channel;
 struct channel_tag;
 struct epggrab_module;
+struct epg_index_node;
 
 /*
  * Map/List types
@@ -276,6 +277,11 @@ struct epg_episode
   epg_brand_t               *brand;         ///< (Grand-)Parent brand
   epg_season_t              *season;        ///< Parent season
   epg_broadcast_list_t       broadcasts;    ///< Broadcast list
+
+  struct epg_index_node     *title_idx;     ///< Title n-gram index entries
+  int                        title_idx_cnt;
+  struct epg_index_node     *genre_idx;     ///< Genre index entries
+  int                        genre_idx_cnt;
 };
 
 /* Lookup */
@@ -437,6 +443,9 @@ struct epg_broadcast
   lang_str_t                *description;      ///< Description
 
   RB_ENTRY(epg_broadcast)    sched_link;       ///< Schedule link
+  RB_ENTRY(epg_broadcast)    start_link;       ///< Global start time index
+  LIST_ENTRY(epg_broadcast)  eid_link;         ///< Channel EID hash link
+  uint8_t                    scheduled;        ///< On a channel schedule
   LIST_ENTRY(epg_broadcast)  ep_link;          ///< Episode link
   epg_episode_t             *episode;          ///< Episode shown
   LIST_ENTRY(epg_broadcast)  sl_link;          ///< SeriesLink link
@@ -445,6 +454,10 @@ struct epg_broadcast
 
 };
 
+/* Channel EID hash */
+#define EPG_EID_HASH_WIDTH 64
+#define EPG_EID_HASH_MASK  (EPG_EID_HASH_WIDTH - 1)
+
 /* Lookup */
 epg_broadcast_t *epg_broadcast_find_by_time 
   ( struct channel *ch, time_t start, time_t stop, 
@@ -530,11 +543,16 @@ void epg_channel_unlink ( struct channel *ch );
 
 /*
  * Query result
+ *
+ * Entries are ordered by start time, eqr_array only holds the requested
+ * page (start/limit, limit 0 = all) while eqr_total is the number of
+ * matches in total
  */
 typedef struct epg_query_result {
   epg_broadcast_t **eqr_array;
   int               eqr_entries;
   int               eqr_alloced;
+  int               eqr_total;
 } epg_query_result_t;
 
 void epg_query_free(epg_query_result_t *eqr);
@@ -546,9 +564,10 @@ void epg_query_sort(epg_query_result_t *eqr);
 /* Query routines */
 void epg_query0(epg_query_result_t *eqr, struct channel *ch,
                 struct channel_tag *ct, epg_genre_t *genre, const char *title,
-                const char *lang);
+                const char *lang, int start, int limit);
 void epg_query(epg_query_result_t *eqr, const char *channel, const char *tag,
-	       epg_genre_t *genre, const char *title, const char *lang);
+	       epg_genre_t *genre, const char *title, const char *lang,
+               int start, int limit);
 
 
 /* ************************************************************************
@@ -557,6 +576,7 @@ void epg_query(epg_query_result_t *eqr, const char *channel, const char *tag,
 
 void epg_init    (void);
 void epg_save    (void*);
+void epg_save_wait (void);
 void epg_updated (void);
 
 /* ************************************************************************
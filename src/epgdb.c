@@ -21,6 +21,9 @@
 #include <sys/stat.h>
 #include <unistd.h>
 #include <pthread.h>
+#include <fcntl.h>
+#include <errno.h>
+#include <stdio.h>
 
 #include "tvheadend.h"
 #include "queue.h"
@@ -136,6 +139,76 @@ static void _epgdb_v2_process ( htsmsg_t *m, epggrab_stats_t *stats )
   }
 }
 
+static void _epgdb_save_init ( void );
+
+/*
+ * Parallel decode
+ *
+ * The file is split at record boundaries into batches which are decoded
+ * by a pool of threads, while the calling thread inserts the decoded
+ * messages in file order (section markers must be seen in order). The
+ * decoders are only allowed to run a limited number of batches ahead of
+ * the insertion, to bound the memory held by decoded messages.
+ */
+#define EPGDB_LOAD_BATCH   1024
+#define EPGDB_LOAD_AHEAD   16
+#define EPGDB_LOAD_THREADS 8
+
+typedef struct epgdb_record {
+  const uint8_t *er_data;
+  size_t         er_len;
+} epgdb_record_t;
+
+typedef struct epgdb_loader {
+  pthread_mutex_t  el_mutex;
+  pthread_cond_t   el_cond;
+  epgdb_record_t  *el_rec;
+  htsmsg_t       **el_msg;
+  uint8_t         *el_done;
+  int              el_nrec;
+  int              el_nbatch;
+  int              el_next;      // next batch to decode
+  int              el_insert;    // next batch to insert
+  int64_t          el_decode;    // decode time (all threads)
+} epgdb_loader_t;
+
+static void _epgdb_decode_batch ( epgdb_loader_t *el, int b )
+{
+  int i = b * EPGDB_LOAD_BATCH;
+  int e = MIN(i + EPGDB_LOAD_BATCH, el->el_nrec);
+  for ( ; i < e; i++)
+    el->el_msg[i] = htsmsg_binary_deserialize(el->el_rec[i].er_data,
+                                              el->el_rec[i].er_len, NULL);
+}
+
+static void *_epgdb_decode_thread ( void *aux )
+{
+  epgdb_loader_t *el = aux;
+  int64_t t;
+  int b;
+
+  pthread_mutex_lock(&el->el_mutex);
+  while (el->el_next < el->el_nbatch) {
+    if (el->el_next >= el->el_insert + EPGDB_LOAD_AHEAD) {
+      pthread_cond_wait(&el->el_cond, &el->el_mutex);
+      continue;
+    }
+    b = el->el_next++;
+    pthread_mutex_unlock(&el->el_mutex);
+
+    t = getmonoclock();
+    _epgdb_decode_batch(el, b);
+    t = getmonoclock() - t;
+
+    pthread_mutex_lock(&el->el_mutex);
+    el->el_decode += t;
+    el->el_done[b] = 1;
+    pthread_cond_broadcast(&el->el_cond);
+  }
+  pthread_mutex_unlock(&el->el_mutex);
+  return NULL;
+}
+
 /*
  * Load data
  */
@@ -146,8 +219,14 @@ void epg_init ( void )
   size_t remain;
   uint8_t *mem, *rp;
   epggrab_stats_t stats;
+  epgdb_loader_t el;
+  pthread_t tids[EPGDB_LOAD_THREADS];
+  int64_t t0, t1, t2, tins = 0, t;
+  int i, b, e, nthreads, size = 0;
   int ver = EPG_DB_VERSION;
 
+  _epgdb_save_init();
+
   /* Find the right file (and version) */
   while (fd < 0 && ver > 0) {
     fd = hts_settings_open_file(0, "epgdb.v%d", ver);
@@ -177,12 +256,13 @@ void epg_init ( void )
     return;
   }
 
-  /* Process */
-  memset(&stats, 0, sizeof(stats));
+  /* Find record boundaries */
+  t0 = getmonoclock();
+  memset(&el, 0, sizeof(el));
   while ( remain > 4 ) {
 
     /* Get message length */
-    int msglen = (rp[0] << 24) | (rp[1] << 16) | (rp[2] << 8) | rp[3];
+    size_t msglen = (rp[0] << 24) | (rp[1] << 16) | (rp[2] << 8) | rp[3];
     remain    -= 4;
     rp        += 4;
 
@@ -191,30 +271,90 @@ void epg_init ( void )
       tvhlog(LOG_ERR, "epgdb", "corruption detected, some/all data lost");
       break;
     }
-    
-    /* Extract message */
-    htsmsg_t *m = htsmsg_binary_deserialize(rp, msglen, NULL);
+
+    if (el.el_nrec == size) {
+      size = size ? size * 2 : 4096;
+      el.el_rec = realloc(el.el_rec, size * sizeof(epgdb_record_t));
+    }
+    el.el_rec[el.el_nrec].er_data = rp;
+    el.el_rec[el.el_nrec].er_len  = msglen;
+    el.el_nrec++;
 
     /* Next */
     rp     += msglen;
     remain -= msglen;
+  }
+
+  /* Start decoders */
+  t1 = getmonoclock();
+  el.el_nbatch = (el.el_nrec + EPGDB_LOAD_BATCH - 1) / EPGDB_LOAD_BATCH;
+  el.el_msg    = calloc(el.el_nrec ?: 1, sizeof(htsmsg_t *));
+  el.el_done   = calloc(el.el_nbatch ?: 1, 1);
+  pthread_mutex_init(&el.el_mutex, NULL);
+  pthread_cond_init(&el.el_cond, NULL);
+  nthreads = MIN(sysconf(_SC_NPROCESSORS_ONLN), EPGDB_LOAD_THREADS);
+  nthreads = MIN(nthreads, el.el_nbatch);
+  if (nthreads < 2)
+    nthreads = 0;
+  for (i = 0; i < nthreads; i++)
+    pthread_create(&tids[i], NULL, _epgdb_decode_thread, &el);
 
-    /* Skip */
-    if (!m) continue;
-
-    /* Process */
-    switch (ver) {
-      case 2:
-        _epgdb_v2_process(m, &stats);
-        break;
-      default: /* v0/1 */
-        _epgdb_v1_process(m, &stats);
-        break;
+  /* Process */
+  memset(&stats, 0, sizeof(stats));
+  for (b = 0; b < el.el_nbatch; b++) {
+
+    /* Wait for batch (or decode here if there are no threads) */
+    if (nthreads) {
+      pthread_mutex_lock(&el.el_mutex);
+      while (!el.el_done[b])
+        pthread_cond_wait(&el.el_cond, &el.el_mutex);
+      pthread_mutex_unlock(&el.el_mutex);
+    } else {
+      t = getmonoclock();
+      _epgdb_decode_batch(&el, b);
+      el.el_decode += getmonoclock() - t;
     }
 
-    /* Cleanup */
-    htsmsg_destroy(m);
+    t = getmonoclock();
+    e = MIN((b + 1) * EPGDB_LOAD_BATCH, el.el_nrec);
+    for (i = b * EPGDB_LOAD_BATCH; i < e; i++) {
+      htsmsg_t *m = el.el_msg[i];
+
+      /* Skip */
+      if (!m) continue;
+
+      /* Process */
+      switch (ver) {
+        case 2:
+          _epgdb_v2_process(m, &stats);
+          break;
+        default: /* v0/1 */
+          _epgdb_v1_process(m, &stats);
+          break;
+      }
+
+      /* Cleanup */
+      htsmsg_destroy(m);
+    }
+    tins += getmonoclock() - t;
+
+    /* Let the decoders advance */
+    if (nthreads) {
+      pthread_mutex_lock(&el.el_mutex);
+      el.el_insert = b + 1;
+      pthread_cond_broadcast(&el.el_cond);
+      pthread_mutex_unlock(&el.el_mutex);
+    }
   }
+  for (i = 0; i < nthreads; i++)
+    pthread_join(tids[i], NULL);
+  t2 = getmonoclock();
+
+  pthread_mutex_destroy(&el.el_mutex);
+  pthread_cond_destroy(&el.el_cond);
+  free(el.el_done);
+  free(el.el_msg);
+  free(el.el_rec);
 
   /* Stats */
   tvhlog(LOG_INFO, "epgdb", "loaded v%d", ver);
@@ -223,6 +363,13 @@ void epg_init ( void )
   tvhlog(LOG_INFO, "epgdb", "  seasons    %d", stats.seasons.total);
   tvhlog(LOG_INFO, "epgdb", "  episodes   %d", stats.episodes.total);
   tvhlog(LOG_INFO, "epgdb", "  broadcasts %d", stats.broadcasts.total);
+  tvhlog(LOG_INFO, "epgdb", "  records    %d (%zd bytes)",
+         el.el_nrec, (size_t)st.st_size);
+  tvhlog(LOG_INFO, "epgdb", "  scan       %"PRId64"ms", (t1 - t0) / 1000);
+  tvhlog(LOG_INFO, "epgdb", "  decode     %"PRId64"ms (%d threads)",
+         el.el_decode / 1000, nthreads ?: 1);
+  tvhlog(LOG_INFO, "epgdb", "  insert     %"PRId64"ms", tins / 1000);
+  tvhlog(LOG_INFO, "epgdb", "  total      %"PRId64"ms", (t2 - t0) / 1000);
 
   /* Close file */
   munmap(mem, st.st_size);
@@ -233,84 +380,209 @@ void epg_init ( void )
  * Save
  * *************************************************************************/
 
-static int _epg_write ( int fd, htsmsg_t *m )
+/*
+ * Turning EPG objects into htsmsgs has to happen under global_lock, the
+ * messages are then queued for a background thread which does the binary
+ * encoding and all file I/O, so the lock is never held for either.
+ */
+#define EPGDB_WRITE_CHUNK (256 * 1024)
+
+static pthread_mutex_t epgdb_save_mutex = PTHREAD_MUTEX_INITIALIZER;
+static pthread_cond_t  epgdb_save_cond  = PTHREAD_COND_INITIALIZER;
+static htsmsg_t       *epgdb_save_pending;
+static int             epgdb_save_busy;
+
+static int _epg_write ( htsmsg_t *l, htsmsg_t *m )
 {
-  int ret = 1;
-  size_t msglen;
+  if (m)
+    htsmsg_add_msg(l, NULL, m);
+  return 0;
+}
+
+static int _epg_write_sect ( htsmsg_t *l, const char *sect )
+{
+  htsmsg_t *m = htsmsg_create_map();
+  htsmsg_add_str(m, "__section__", sect);
+  return _epg_write(l, m);
+}
+
+/*
+ * Encode the queued messages and write them to a temporary file in large
+ * chunks, the file is then moved over the old database so a failed or
+ * interrupted save never leaves a truncated file behind
+ */
+static int _epgdb_store ( htsmsg_t *l, size_t *size )
+{
+  char path[256], tmppath[280];
+  htsmsg_field_t *f;
+  htsmsg_t *m;
+  sbuf_t sb;
   void *msgdata;
-  if (m) {
-    int r = htsmsg_binary_serialize(m, &msgdata, &msglen, 0x10000);
-    htsmsg_destroy(m);
-    if (!r) {
-      ret = tvh_write(fd, msgdata, msglen);
-      free(msgdata);
+  size_t msglen;
+  int fd, ok = 1;
+
+  if (hts_settings_buildpath(path, sizeof(path), "epgdb.v%d", EPG_DB_VERSION))
+    return 1;
+  if (hts_settings_makedirs(path))
+    return 1;
+  snprintf(tmppath, sizeof(tmppath), "%s.tmp", path);
+
+  if ((fd = tvh_open(tmppath, O_CREAT | O_TRUNC | O_WRONLY, 0700)) < 0) {
+    tvhlog(LOG_ERR, "epgdb", "unable to create \"%s\" - %s",
+           tmppath, strerror(errno));
+    return 1;
+  }
+
+  sbuf_init(&sb);
+  HTSMSG_FOREACH(f, l) {
+    if ((m = htsmsg_get_map_by_field(f)) == NULL ||
+        htsmsg_binary_serialize(m, &msgdata, &msglen, 0x10000)) {
+      tvhlog(LOG_ERR, "epgdb", "failed to serialize epg");
+      ok = 0;
+      break;
     }
-  } else {
-    ret = 0;
+    sbuf_append(&sb, msgdata, msglen);
+    free(msgdata);
+    if (sb.sb_ptr < EPGDB_WRITE_CHUNK && TAILQ_NEXT(f, hmf_link))
+      continue;
+    if (tvh_write(fd, sb.sb_data, sb.sb_ptr)) {
+      tvhlog(LOG_ERR, "epgdb", "failed to write \"%s\" - %s",
+             tmppath, strerror(errno));
+      ok = 0;
+      break;
+    }
+    *size += sb.sb_ptr;
+    sb.sb_ptr = 0;
   }
-  if(ret) {
-    tvhlog(LOG_ERR, "epgdb", "failed to store epg to disk");
-    close(fd);
-    hts_settings_remove("epgdb.v%d", EPG_DB_VERSION);
+  sbuf_free(&sb);
+  if (close(fd))
+    ok = 0;
+
+  if (ok && rename(tmppath, path)) {
+    tvhlog(LOG_ERR, "epgdb", "unable to rename \"%s\" - %s",
+           tmppath, strerror(errno));
+    ok = 0;
   }
-  return ret;
+  if (!ok)
+    unlink(tmppath);
+  return !ok;
 }
 
-static int _epg_write_sect ( int fd, const char *sect )
+static void *_epgdb_save_thread ( void *aux )
 {
-  htsmsg_t *m = htsmsg_create_map();
-  htsmsg_add_str(m, "__section__", sect);
-  return _epg_write(fd, m);
+  htsmsg_t *l;
+  size_t size;
+  int64_t t;
+
+  pthread_mutex_lock(&epgdb_save_mutex);
+  while (1) {
+    if ((l = epgdb_save_pending) == NULL) {
+      pthread_cond_wait(&epgdb_save_cond, &epgdb_save_mutex);
+      continue;
+    }
+    epgdb_save_pending = NULL;
+    epgdb_save_busy    = 1;
+    pthread_mutex_unlock(&epgdb_save_mutex);
+
+    t    = getmonoclock();
+    size = 0;
+    if (_epgdb_store(l, &size))
+      tvhlog(LOG_ERR, "epgdb", "failed to store epg to disk");
+    else
+      tvhlog(LOG_INFO, "epgdb", "  written    %zu bytes in %"PRId64"ms",
+             size, (getmonoclock() - t) / 1000);
+    htsmsg_destroy(l);
+
+    pthread_mutex_lock(&epgdb_save_mutex);
+    epgdb_save_busy = 0;
+    pthread_cond_broadcast(&epgdb_save_cond);
+  }
+  return NULL;
+}
+
+static void _epgdb_save_init ( void )
+{
+  pthread_t tid;
+  pthread_attr_t attr;
+
+  pthread_attr_init(&attr);
+  pthread_attr_setdetachstate(&attr, PTHREAD_CREATE_DETACHED);
+  pthread_create(&tid, &attr, _epgdb_save_thread, NULL);
+}
+
+void epg_save_wait ( void )
+{
+  pthread_mutex_lock(&epgdb_save_mutex);
+  while (epgdb_save_pending || epgdb_save_busy)
+    pthread_cond_wait(&epgdb_save_cond, &epgdb_save_mutex);
+  pthread_mutex_unlock(&epgdb_save_mutex);
 }
 
 void epg_save ( void *p )
 {
-  int fd;
+  htsmsg_t *l;
   epg_object_t *eo;
   epg_broadcast_t *ebc;
   channel_t *ch;
   epggrab_stats_t stats;
+  int64_t t;
   extern gtimer_t epggrab_save_timer;
 
   if (epggrab_epgdb_periodicsave)
     gtimer_arm(&epggrab_save_timer, epg_save, NULL, epggrab_epgdb_periodicsave);
-  
-  fd = hts_settings_open_file(1, "epgdb.v%d", EPG_DB_VERSION);
+
+  t  = getmonoclock();
+  l  = htsmsg_create_list();
 
   memset(&stats, 0, sizeof(stats));
-  if ( _epg_write_sect(fd, "brands") ) return;
+  if ( _epg_write_sect(l, "brands") ) goto error;
   RB_FOREACH(eo,  &epg_brands, uri_link) {
-    if (_epg_write(fd, epg_brand_serialize((epg_brand_t*)eo))) return;
+    if (_epg_write(l, epg_brand_serialize((epg_brand_t*)eo))) goto error;
     stats.brands.total++;
   }
-  if ( _epg_write_sect(fd, "seasons") ) return;
+  if ( _epg_write_sect(l, "seasons") ) goto error;
   RB_FOREACH(eo,  &epg_seasons, uri_link) {
-    if (_epg_write(fd, epg_season_serialize((epg_season_t*)eo))) return;
+    if (_epg_write(l, epg_season_serialize((epg_season_t*)eo))) goto error;
     stats.seasons.total++;
   }
-  if ( _epg_write_sect(fd, "episodes") ) return;
+  if ( _epg_write_sect(l, "episodes") ) goto error;
   RB_FOREACH(eo,  &epg_episodes, uri_link) {
-    if (_epg_write(fd, epg_episode_serialize((epg_episode_t*)eo))) return;
+    if (_epg_write(l, epg_episode_serialize((epg_episode_t*)eo))) goto error;
     stats.episodes.total++;
   }
-  if ( _epg_write_sect(fd, "serieslinks") ) return;
+  if ( _epg_write_sect(l, "serieslinks") ) goto error;
   RB_FOREACH(eo, &epg_serieslinks, uri_link) {
-    if (_epg_write(fd, epg_serieslink_serialize((epg_serieslink_t*)eo)))
-      return;
+    if (_epg_write(l, epg_serieslink_serialize((epg_serieslink_t*)eo)))
+      goto error;
     stats.seasons.total++;
   }
-  if ( _epg_write_sect(fd, "broadcasts") ) return;
+  if ( _epg_write_sect(l, "broadcasts") ) goto error;
   RB_FOREACH(ch, &channel_name_tree, ch_name_link) {
     RB_FOREACH(ebc, &ch->ch_epg_schedule, sched_link) {
-      if (_epg_write(fd, epg_broadcast_serialize(ebc))) return;
+      if (_epg_write(l, epg_broadcast_serialize(ebc))) goto error;
       stats.broadcasts.total++;
     }
   }
 
+  /* Hand over to the writer, a newer snapshot replaces an unwritten one */
+  t = getmonoclock() - t;
+  pthread_mutex_lock(&epgdb_save_mutex);
+  if (epgdb_save_pending)
+    htsmsg_destroy(epgdb_save_pending);
+  epgdb_save_pending = l;
+  pthread_cond_broadcast(&epgdb_save_cond);
+  pthread_mutex_unlock(&epgdb_save_mutex);
+
   /* Stats */
   tvhlog(LOG_INFO, "epgdb", "saved");
   tvhlog(LOG_INFO, "epgdb", "  brands     %d", stats.brands.total);
   tvhlog(LOG_INFO, "epgdb", "  seasons    %d", stats.seasons.total);
   tvhlog(LOG_INFO, "epgdb", "  episodes   %d", stats.episodes.total);
   tvhlog(LOG_INFO, "epgdb", "  broadcasts %d", stats.broadcasts.total);
+  tvhlog(LOG_INFO, "epgdb", "  snapshot   taken in %"PRId64"ms", t / 1000);
+  return;
+
+error:
+  tvhlog(LOG_ERR, "epgdb", "failed to serialize epg");
+  htsmsg_destroy(l);
 }
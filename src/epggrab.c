@@ -64,6 +64,17 @@ static void _epggrab_module_grab ( epggrab_module_int_t *mod )
 {
   time_t tm1, tm2;
   htsmsg_t *data;
+  int fd;
+
+  /* Grab and parse as the output arrives */
+  if (mod->stream) {
+    tvhlog(LOG_INFO, mod->id, "grab %s", mod->path);
+    if ((fd = spawn_with_stdout(mod->path, NULL)) < 0)
+      tvhlog(LOG_ERR, mod->id, "failed to run %s", mod->path);
+    else
+      epggrab_module_stream(mod, fd);
+    return;
+  }
 
   /* Grab */
   time(&tm1);
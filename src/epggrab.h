@@ -152,6 +152,10 @@ struct epggrab_module_int
   char*     (*grab)   ( void *mod );
   htsmsg_t* (*trans)  ( void *mod, char *data );
   int       (*parse)  ( void *mod, htsmsg_t *data, epggrab_stats_t *stat );
+
+  /* Incremental alternative to trans/parse, reads fd to the end and
+   * takes global_lock itself */
+  int       (*stream) ( void *mod, int fd, epggrab_stats_t *stat );
 };
 
 /*
@@ -99,6 +99,29 @@ epggrab_module_t *epggrab_module_create
   return skel;
 }
 
+/*
+ * Log the parse statistics
+ */
+static void _epggrab_module_stats
+  ( epggrab_module_t *mod, epggrab_stats_t *stats )
+{
+  tvhlog(LOG_INFO, mod->id, "  channels   tot=%5d new=%5d mod=%5d",
+         stats->channels.total, stats->channels.created,
+         stats->channels.modified);
+  tvhlog(LOG_INFO, mod->id, "  brands     tot=%5d new=%5d mod=%5d",
+         stats->brands.total, stats->brands.created,
+         stats->brands.modified);
+  tvhlog(LOG_INFO, mod->id, "  seasons    tot=%5d new=%5d mod=%5d",
+         stats->seasons.total, stats->seasons.created,
+         stats->seasons.modified);
+  tvhlog(LOG_INFO, mod->id, "  episodes   tot=%5d new=%5d mod=%5d",
+         stats->episodes.total, stats->episodes.created,
+         stats->episodes.modified);
+  tvhlog(LOG_INFO, mod->id, "  broadcasts tot=%5d new=%5d mod=%5d",
+         stats->broadcasts.total, stats->broadcasts.created,
+         stats->broadcasts.modified);
+}
+
 /*
  * Run the parse
  */
@@ -122,21 +145,36 @@ void epggrab_module_parse
 
   /* Debug stats */
   tvhlog(LOG_INFO, mod->id, "parse took %"PRItime_t" seconds", tm2 - tm1);
-  tvhlog(LOG_INFO, mod->id, "  channels   tot=%5d new=%5d mod=%5d",
-         stats.channels.total, stats.channels.created,
-         stats.channels.modified);
-  tvhlog(LOG_INFO, mod->id, "  brands     tot=%5d new=%5d mod=%5d",
-         stats.brands.total, stats.brands.created,
-         stats.brands.modified);
-  tvhlog(LOG_INFO, mod->id, "  seasons    tot=%5d new=%5d mod=%5d",
-         stats.seasons.total, stats.seasons.created,
-         stats.seasons.modified);
-  tvhlog(LOG_INFO, mod->id, "  episodes   tot=%5d new=%5d mod=%5d",
-         stats.episodes.total, stats.episodes.created,
-         stats.episodes.modified);
-  tvhlog(LOG_INFO, mod->id, "  broadcasts tot=%5d new=%5d mod=%5d",
-         stats.broadcasts.total, stats.broadcasts.created,
-         stats.broadcasts.modified);
+  _epggrab_module_stats((epggrab_module_t*)mod, &stats);
+}
+
+/*
+ * Run the incremental parse, fd is closed when done
+ */
+void epggrab_module_stream
+  ( void *m, int fd )
+{
+  time_t tm1, tm2;
+  int save;
+  epggrab_stats_t stats;
+  epggrab_module_int_t *mod = m;
+
+  /* Parse as the data arrives */
+  memset(&stats, 0, sizeof(stats));
+  time(&tm1);
+  save = mod->stream(mod, fd, &stats);
+  time(&tm2);
+  close(fd);
+  if (save) {
+    pthread_mutex_lock(&global_lock);
+    epg_updated();
+    pthread_mutex_unlock(&global_lock);
+  }
+
+  /* Debug stats */
+  tvhlog(LOG_INFO, mod->id, "grab and parse took %"PRItime_t" seconds",
+         tm2 - tm1);
+  _epggrab_module_stats((epggrab_module_t*)mod, &stats);
 }
 
 /* **************************************************************************
@@ -326,6 +364,12 @@ static void _epggrab_socket_handler ( epggrab_module_ext_t *mod, int s )
   time_t tm1, tm2;
   htsmsg_t *data = NULL;
 
+  /* Incremental */
+  if (mod->stream) {
+    epggrab_module_stream(mod, s);
+    return;
+  }
+
   /* Grab/Translate */
   time(&tm1);
   outlen = file_readall(s, &outbuf);
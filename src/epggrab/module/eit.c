@@ -839,10 +839,10 @@ static void _eit_start
   /* Freesat (3002/3003) */
   if (!strcmp("uk_freesat", m->id)) {
 #ifdef IGNORE_TOO_SLOW
-    tdt_add(tdmi, 0, 0, dvb_pidx11_callback, m, m->id, TDT_CRC, 3840, NULL);
+    tdt_add(tdmi, 0, 0, dvb_pidx11_callback, m, m->id, TDT_CRC | TDT_DEDUP, 3840, NULL);
     tdt_add(tdmi, 0, 0, _eit_callback, m, m->id, TDT_CRC, 3841, NULL);
 #endif
-    tdt_add(tdmi, 0, 0, dvb_pidx11_callback, m, m->id, TDT_CRC, 3002);
+    tdt_add(tdmi, 0, 0, dvb_pidx11_callback, m, m->id, TDT_CRC | TDT_DEDUP, 3002);
     tdt_add(tdmi, 0, 0, _eit_callback, m, m->id, TDT_CRC, 3003);
 
   /* Viasat Baltic (0x39) */
@@ -887,6 +887,7 @@ static int _eit_enable ( void *m, uint8_t e )
 
 void eit_init ( void )
 {
+  freesat_huffman_init();
   epggrab_module_ota_create(NULL, "eit", "EIT: DVB Grabber", 1,
                             _eit_start, _eit_enable, NULL);
   epggrab_module_ota_create(NULL, "uk_freesat", "UK: Freesat", 5,
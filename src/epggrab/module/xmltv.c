@@ -42,6 +42,9 @@
 #define XMLTV_FIND "tv_find_grabbers"
 #define XMLTV_GRAB "tv_grab_"
 
+/* Elements applied per global_lock hold when streaming */
+#define XMLTV_BATCH 100
+
 static epggrab_channel_tree_t _xmltv_channels;
 static epggrab_module_t      *_xmltv_module;
 
@@ -632,12 +635,80 @@ static int _xmltv_parse
   return _xmltv_parse_tv(mod, tv, stats);
 }
 
+/*
+ * Incremental parse, elements are applied in batches as they are read
+ */
+typedef struct xmltv_stream
+{
+  epggrab_module_t *mod;
+  epggrab_stats_t  *stats;
+  int               save;
+  int               batch;  ///< Elements applied with global_lock held
+} xmltv_stream_t;
+
+static void _xmltv_stream_element
+  ( void *opaque, const char *name, htsmsg_t *body )
+{
+  xmltv_stream_t *xs = opaque;
+
+  if (!xs->batch)
+    pthread_mutex_lock(&global_lock);
+
+  if (!strcmp(name, "channel"))
+    xs->save |= _xmltv_parse_channel(xs->mod, body, xs->stats);
+  else if (!strcmp(name, "programme"))
+    xs->save |= _xmltv_parse_programme(xs->mod, body, xs->stats);
+
+  if (++xs->batch == XMLTV_BATCH) {
+    pthread_mutex_unlock(&global_lock);
+    xs->batch = 0;
+  }
+}
+
+static int _xmltv_stream
+  ( void *m, int fd, epggrab_stats_t *stats )
+{
+  char buf[65536], errbuf[100];
+  ssize_t r;
+  htsmsg_xml_stream_t *hxs;
+  xmltv_stream_t xs;
+  epggrab_module_t *mod = m;
+
+  memset(&xs, 0, sizeof(xs));
+  xs.mod   = mod;
+  xs.stats = stats;
+  hxs = htsmsg_xml_stream_create(_xmltv_stream_element, &xs);
+
+  do {
+    r = read(fd, buf, sizeof(buf));
+    if (r < 0 && errno == EINTR) continue;
+    if (r < 0) {
+      tvhlog(LOG_ERR, mod->id, "read error %s", strerror(errno));
+      break;
+    }
+    if (htsmsg_xml_stream_feed(hxs, buf, r, errbuf, sizeof(errbuf))) {
+      tvhlog(LOG_ERR, mod->id, "htsmsg_xml_stream error %s", errbuf);
+      r = 0;
+    }
+
+    /* Never wait for more input while holding the lock */
+    if (xs.batch) {
+      pthread_mutex_unlock(&global_lock);
+      xs.batch = 0;
+    }
+  } while (r != 0);
+
+  htsmsg_xml_stream_destroy(hxs);
+  return xs.save;
+}
+
 /* ************************************************************************
  * Module Setup
  * ***********************************************************************/
 
 static void _xmltv_load_grabbers ( void )
 {
+  epggrab_module_int_t *mod;
   int outlen;
   size_t i, p, n;
   char *outbuf;
@@ -654,8 +725,9 @@ static void _xmltv_load_grabbers ( void )
       if ( outbuf[i] == '\n' || outbuf[i] == '\0' ) {
         outbuf[i] = '\0';
         sprintf(name, "XMLTV: %s", &outbuf[n]);
-        epggrab_module_int_create(NULL, &outbuf[p], name, 3, &outbuf[p],
-                                NULL, _xmltv_parse, NULL, NULL);
+        mod = epggrab_module_int_create(NULL, &outbuf[p], name, 3, &outbuf[p],
+                                        NULL, _xmltv_parse, NULL, NULL);
+        mod->stream = _xmltv_stream;
         p = n = i + 1;
       } else if ( outbuf[i] == '|' ) {
         outbuf[i] = '\0';
@@ -692,8 +764,9 @@ static void _xmltv_load_grabbers ( void )
           if ((outlen = spawn_and_store_stdout(bin, argv, &outbuf)) > 0) {
             if (outbuf[outlen-1] == '\n') outbuf[outlen-1] = '\0';
             snprintf(name, sizeof(name), "XMLTV: %s", outbuf);
-            epggrab_module_int_create(NULL, bin, name, 3, bin,
-                                      NULL, _xmltv_parse, NULL, NULL);
+            mod = epggrab_module_int_create(NULL, bin, name, 3, bin,
+                                            NULL, _xmltv_parse, NULL, NULL);
+            mod->stream = _xmltv_stream;
             free(outbuf);
           }
         }
@@ -712,6 +785,7 @@ void xmltv_init ( void )
     epggrab_module_ext_create(NULL, "xmltv", "XMLTV", 3, "xmltv",
                               _xmltv_parse, NULL,
                               &_xmltv_channels);
+  ((epggrab_module_int_t*)_xmltv_module)->stream = _xmltv_stream;
 
   /* Standard modules */
   _xmltv_load_grabbers();
@@ -39,6 +39,7 @@ void      epggrab_module_ch_save ( void *m, epggrab_channel_t *ec );
 int       epggrab_module_enable_socket ( void *m, uint8_t e );
 
 void      epggrab_module_parse ( void *m, htsmsg_t *data );
+void      epggrab_module_stream ( void *m, int fd );
 
 void      epggrab_module_channels_load ( epggrab_module_t *m );
 
@@ -152,6 +153,7 @@ int  xmltv_parse_accessibility
   ( epggrab_module_t *mod, epg_broadcast_t *ebc, htsmsg_t *m );
 
 /* Freesat huffman decoder */
+void freesat_huffman_init ( void );
 size_t freesat_huffman_decode
   (char *dst, size_t* dstlen, const uint8_t *src, size_t srclen);
 
@@ -5758,9 +5758,56 @@ unsigned fsat_index_2[] = {
 		3160  /* 128 */
 };
 
+/*
+ * Codes of up to 8 bits by context and leading byte: bits << 8 | next,
+ * 0 if the code is longer (those are searched for in the table)
+ */
+static uint16_t fsat_lut[2][128][256];
+
+#define FSAT_LUT_LONG 0xffff
+
+static void freesat_huffman_lut_build
+  (uint16_t lut[128][256], struct fsattab *table, unsigned *index)
+{
+  unsigned int c, j, p, n, mask;
+  int bits;
+
+  for (c = 0; c < 128; c++) {
+    /* The first matching entry wins, so a longer code listed before a
+       shorter one sharing its leading byte keeps that byte for itself */
+    for (j = index[c]; j < index[c + 1]; j++) {
+      bits = table[j].bits;
+      if (bits <= 0) continue;
+      mask = 0xffffffff << (32 - bits);
+      if (table[j].value & ~mask) continue;
+      p = table[j].value >> 24;
+      if (bits > 8) {
+        if (!lut[c][p])
+          lut[c][p] = FSAT_LUT_LONG;
+        continue;
+      }
+      for (n = 0; n < (1 << (8 - bits)); n++)
+        if (!lut[c][p + n])
+          lut[c][p + n] = bits << 8 | (uint8_t)table[j].next;
+    }
+    for (p = 0; p < 256; p++)
+      if (lut[c][p] == FSAT_LUT_LONG)
+        lut[c][p] = 0;
+  }
+}
+
+void freesat_huffman_init ( void )
+{
+  freesat_huffman_lut_build(fsat_lut[0], fsat_table_1, fsat_index_1);
+  freesat_huffman_lut_build(fsat_lut[1], fsat_table_2, fsat_index_2);
+}
+
 size_t freesat_huffman_decode
   (char *dst, size_t* dstlen, const uint8_t *src, size_t srclen)
 {
+	uint16_t (*lut)[256];
+	uint16_t hit;
+	unsigned int n;
 	struct fsattab *fsat_table;
 	unsigned int *fsat_index;
   size_t p;
@@ -5774,9 +5821,6 @@ size_t freesat_huffman_decode
 	unsigned int indx;
 	unsigned int j;
 	unsigned int mask;
-	unsigned int maskbit;
-	unsigned short kk;
-	unsigned int b;
 
   if (src[0] != 0x1f) return -1;
 
@@ -5785,9 +5829,11 @@ size_t freesat_huffman_decode
 		if (src[1] == 1) {
 			fsat_table = fsat_table_1;
 			fsat_index = fsat_index_1;
+			lut = fsat_lut[0];
 		} else {
 			fsat_table = fsat_table_2;
 			fsat_index = fsat_index_2;
+			lut = fsat_lut[1];
 		}
 		value = 0;
 		byte = 2;
@@ -5813,17 +5859,18 @@ size_t freesat_huffman_decode
 						nextCh = STOP;
 					lastch = nextCh;
 				}
+			} else if ((hit = lut[(unsigned int) lastch][value >> 24])) {
+				found = 1;
+				nextCh = hit & 0xff;
+				bitShift = hit >> 8;
+				lastch = nextCh;
 			} else {
 				indx = (unsigned int) lastch;
 				//if (src[1] == 2)
 				//    indx |= 0x80;
 				for (j = fsat_index[indx]; j < fsat_index[indx + 1]; j++) {
-					mask = 0;
-					maskbit = 0x80000000;
-					for (kk = 0; kk < fsat_table[j].bits; kk++) {
-						mask |= maskbit;
-						maskbit >>= 1;
-					}
+					mask = fsat_table[j].bits > 0 ?
+					       0xffffffff << (32 - fsat_table[j].bits) : 0;
 					if ((value & mask) == fsat_table[j].value) {
 						nextCh = fsat_table[j].next;
 						bitShift = fsat_table[j].bits;
@@ -5838,16 +5885,18 @@ size_t freesat_huffman_decode
 					if (p >= *dstlen) return 0;
 					dst[p++] = nextCh;
 				}
-				// Shift up by the number of bits.
-				for (b = 0; b < bitShift; b++) {
-					value = (value << 1) & 0xfffffffe;
+				// Shift up by the number of bits, up to a byte at a time.
+				while (bitShift) {
+					n = MIN(bitShift, 8 - bit);
+					value <<= n;
 					if (byte < srclen)
-						value |= (src[byte] >> (7 - bit)) & 1;
-					if (bit == 7) {
+						value |= (src[byte] >> (8 - bit - n)) & ((1 << n) - 1);
+					bit += n;
+					bitShift -= n;
+					if (bit == 8) {
 						bit = 0;
 						byte++;
-					} else
-						bit++;
+					}
 				}
 			} else {
         return -1;
@@ -92,11 +92,19 @@ htsmsg_binary_des0(htsmsg_t *msg, const uint8_t *buf, size_t len)
       f->hmf_s64 = u64;
       break;
 
+    case HMF_DBL:
+      u64 = 0;
+      for(i = datalen - 1; i >= 0; i--)
+	  u64 = (u64 << 8) | buf[i];
+      memcpy(&f->hmf_dbl, &u64, sizeof(u64));
+      break;
+
     case HMF_MAP:
     case HMF_LIST:
       sub = &f->hmf_msg;
       TAILQ_INIT(&sub->hm_fields);
       sub->hm_data = NULL;
+      sub->hm_islist = type == HMF_LIST;
       if(htsmsg_binary_des0(sub, buf, datalen) < 0) {
         free(n);
         free(f);
@@ -173,6 +181,10 @@ htsmsg_binary_count(htsmsg_t *msg)
 	u64 = u64 >> 8;
       }
       break;
+
+    case HMF_DBL:
+      len += sizeof(double);
+      break;
     }
   }
   return len;
@@ -216,6 +228,11 @@ htsmsg_binary_write(htsmsg_t *msg, uint8_t *ptr)
 	u64 = u64 >> 8;
       }
       break;
+
+    case HMF_DBL:
+      l = sizeof(double);
+      break;
+
     default:
       abort();
     }
@@ -252,6 +269,14 @@ htsmsg_binary_write(htsmsg_t *msg, uint8_t *ptr)
 	u64 = u64 >> 8;
       }
       break;
+
+    case HMF_DBL:
+      memcpy(&u64, &f->hmf_dbl, sizeof(u64));
+      for(i = 0; i < l; i++) {
+	ptr[i] = u64;
+	u64 = u64 >> 8;
+      }
+      break;
     }
     ptr += l;
   }
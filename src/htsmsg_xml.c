@@ -866,6 +866,269 @@ htsmsg_xml_deserialize(char *src, char *errbuf, size_t errbufsize)
   return NULL;
 }
 
+/* **************************************************************************
+ * Streaming
+ *
+ * The input is split into the children of the root element, each of
+ * those is parsed on its own (with the document prolog, for the encoding)
+ * and handed to the callback. Only the element being received is kept
+ * in memory.
+ * *************************************************************************/
+
+struct htsmsg_xml_stream {
+  htsmsg_xml_stream_cb_t *hxs_cb;
+  void                   *hxs_opaque;
+
+  char                   *hxs_buf;    // unconsumed input, NUL terminated
+  size_t                  hxs_len;
+  size_t                  hxs_size;
+  size_t                  hxs_pos;    // scan position
+  size_t                  hxs_elem;   // start of the current element
+
+  char                   *hxs_prolog; // <?xml ?> declaration
+  int                     hxs_depth;
+  int                     hxs_root;   // root element seen
+  char                    hxs_errmsg[128];
+};
+
+/**
+ * 1 if p starts with s, 0 if not, -1 if there is too little data to tell
+ */
+static int
+hxs_prefix(const char *p, size_t left, const char *s)
+{
+  size_t n = strlen(s);
+
+  if(left >= n)
+    return !memcmp(p, s, n);
+  return memcmp(p, s, left) ? 0 : -1;
+}
+
+/**
+ * Length of the markup at p up to and including the terminator s,
+ * 0 if more data is needed
+ */
+static size_t
+hxs_find(const char *p, size_t left, size_t skip, const char *s)
+{
+  size_t n = strlen(s);
+  const char *e, *end = p + left;
+
+  for(e = p + skip; (e = memchr(e, *s, end - e)) != NULL; e++) {
+    if(e + n > end)
+      break;
+    if(!memcmp(e, s, n))
+      return e - p + n;
+  }
+  return 0;
+}
+
+/**
+ * Length of a tag or declaration, '>' inside quotes or an internal
+ * DTD subset does not count
+ */
+static size_t
+hxs_tag_len(const char *p, size_t left)
+{
+  size_t i;
+  char q = 0;
+  int sub = 0;
+
+  for(i = 1; i < left; i++) {
+    if(q) {
+      if(p[i] == q)
+        q = 0;
+    } else if(p[i] == '"' || p[i] == '\'') {
+      q = p[i];
+    } else if(p[i] == '[') {
+      sub++;
+    } else if(p[i] == ']') {
+      sub--;
+    } else if(p[i] == '>' && sub <= 0) {
+      return i + 1;
+    }
+  }
+  return 0;
+}
+
+/**
+ * Parse a complete child of the root element and pass it on
+ */
+static int
+htsmsg_xml_stream_emit(htsmsg_xml_stream_t *hxs, size_t end)
+{
+  size_t plen = hxs->hxs_prolog ? strlen(hxs->hxs_prolog) : 0;
+  size_t len  = end - hxs->hxs_elem;
+  char *src = malloc(plen + len + 1);
+  htsmsg_t *m, *tags, *body;
+  htsmsg_field_t *f;
+
+  if(plen)
+    memcpy(src, hxs->hxs_prolog, plen);
+  memcpy(src + plen, hxs->hxs_buf + hxs->hxs_elem, len);
+  src[plen + len] = 0;
+
+  if((m = htsmsg_xml_deserialize(src, hxs->hxs_errmsg,
+                                 sizeof(hxs->hxs_errmsg))) == NULL) {
+    if(!hxs->hxs_errmsg[0])
+      snprintf(hxs->hxs_errmsg, sizeof(hxs->hxs_errmsg), "Parse error");
+    return -1;
+  }
+
+  if((tags = htsmsg_get_map(m, "tags")) != NULL &&
+     (f = TAILQ_FIRST(&tags->hm_fields)) != NULL &&
+     (body = htsmsg_get_map_by_field(f)) != NULL)
+    hxs->hxs_cb(hxs->hxs_opaque, f->hmf_name, body);
+
+  htsmsg_destroy(m);
+  return 0;
+}
+
+/**
+ * Consume as much of the buffered input as possible
+ */
+static int
+htsmsg_xml_stream_scan(htsmsg_xml_stream_t *hxs)
+{
+  const char *p, *e;
+  size_t left, n;
+  int r;
+
+  while(hxs->hxs_pos < hxs->hxs_len) {
+    p    = hxs->hxs_buf + hxs->hxs_pos;
+    left = hxs->hxs_len - hxs->hxs_pos;
+
+    /* Character data, only of interest inside an element */
+    if(*p != '<') {
+      e = memchr(p, '<', left);
+      hxs->hxs_pos = e ? e - hxs->hxs_buf : hxs->hxs_len;
+      continue;
+    }
+    if(left < 2)
+      break;
+
+    if((r = hxs_prefix(p, left, "<!--")) != 0) {
+      if(r < 0 || !(n = hxs_find(p, left, 4, "-->")))
+        break;
+
+    } else if((r = hxs_prefix(p, left, "<![CDATA[")) != 0) {
+      if(r < 0 || !(n = hxs_find(p, left, 9, "]]>")))
+        break;
+
+    } else if(p[1] == '?') {
+      if(!(n = hxs_find(p, left, 2, "?>")))
+        break;
+      if(!hxs->hxs_root && !hxs->hxs_prolog && !strncmp(p, "<?xml", 5)) {
+        hxs->hxs_prolog = malloc(n + 1);
+        memcpy(hxs->hxs_prolog, p, n);
+        hxs->hxs_prolog[n] = 0;
+      }
+
+    } else if(p[1] == '!') {
+      if(!(n = hxs_tag_len(p, left)))
+        break;
+
+    } else if(p[1] == '/') {
+      if(!(n = hxs_tag_len(p, left)))
+        break;
+      if(hxs->hxs_depth == 0) {
+        snprintf(hxs->hxs_errmsg, sizeof(hxs->hxs_errmsg),
+                 "Unexpected end tag");
+        return -1;
+      }
+      if(--hxs->hxs_depth == 1 &&
+         htsmsg_xml_stream_emit(hxs, hxs->hxs_pos + n))
+        return -1;
+
+    } else {
+      if(!(n = hxs_tag_len(p, left)))
+        break;
+      if(hxs->hxs_depth == 1)
+        hxs->hxs_elem = hxs->hxs_pos;
+      if(p[n - 2] != '/') {
+        hxs->hxs_depth++;
+        hxs->hxs_root = 1;
+      } else if(hxs->hxs_depth == 1 &&
+                htsmsg_xml_stream_emit(hxs, hxs->hxs_pos + n)) {
+        return -1;
+      }
+    }
+
+    hxs->hxs_pos += n;
+  }
+  return 0;
+}
+
+/**
+ *
+ */
+htsmsg_xml_stream_t *
+htsmsg_xml_stream_create(htsmsg_xml_stream_cb_t *cb, void *opaque)
+{
+  htsmsg_xml_stream_t *hxs = calloc(1, sizeof(htsmsg_xml_stream_t));
+
+  hxs->hxs_cb     = cb;
+  hxs->hxs_opaque = opaque;
+  return hxs;
+}
+
+/**
+ *
+ */
+int
+htsmsg_xml_stream_feed(htsmsg_xml_stream_t *hxs, const char *data, size_t len,
+                       char *errbuf, size_t errbufsize)
+{
+  size_t keep;
+
+  if(hxs->hxs_errmsg[0])
+    goto err;
+
+  /* End of input */
+  if(len == 0) {
+    if(!hxs->hxs_root || hxs->hxs_depth) {
+      snprintf(hxs->hxs_errmsg, sizeof(hxs->hxs_errmsg),
+               "Unexpected end of document");
+      goto err;
+    }
+    return 0;
+  }
+
+  if(hxs->hxs_len + len + 1 > hxs->hxs_size) {
+    hxs->hxs_size = MAX(hxs->hxs_size * 2, hxs->hxs_len + len + 1);
+    hxs->hxs_buf  = realloc(hxs->hxs_buf, hxs->hxs_size);
+  }
+  memcpy(hxs->hxs_buf + hxs->hxs_len, data, len);
+  hxs->hxs_len += len;
+  hxs->hxs_buf[hxs->hxs_len] = 0;
+
+  if(htsmsg_xml_stream_scan(hxs))
+    goto err;
+
+  /* Drop consumed input, the current element is kept */
+  keep = hxs->hxs_depth > 1 ? hxs->hxs_elem : hxs->hxs_pos;
+  memmove(hxs->hxs_buf, hxs->hxs_buf + keep, hxs->hxs_len - keep + 1);
+  hxs->hxs_len -= keep;
+  hxs->hxs_pos -= keep;
+  hxs->hxs_elem = 0;
+  return 0;
+
+ err:
+  snprintf(errbuf, errbufsize, "%s", hxs->hxs_errmsg);
+  return -1;
+}
+
+/**
+ *
+ */
+void
+htsmsg_xml_stream_destroy(htsmsg_xml_stream_t *hxs)
+{
+  free(hxs->hxs_buf);
+  free(hxs->hxs_prolog);
+  free(hxs);
+}
+
 /*
  * Get cdata string field
  */
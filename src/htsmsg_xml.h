@@ -28,4 +28,20 @@ int htsmsg_xml_get_cdata_u32 (htsmsg_t *tags, const char *tag, uint32_t *u32);
 const char *htsmsg_xml_get_attr_str(htsmsg_t *tag, const char *attr);
 int htsmsg_xml_get_attr_u32(htsmsg_t *tag, const char *attr, uint32_t *u32);
 
+/**
+ * Incremental parser, calls cb for each complete child of the root
+ * element with its tag name and body (as from htsmsg_xml_deserialize)
+ *
+ * Feed with len 0 at the end of input, returns -1 on error (in errbuf)
+ */
+typedef struct htsmsg_xml_stream htsmsg_xml_stream_t;
+typedef void (htsmsg_xml_stream_cb_t)
+  (void *opaque, const char *name, htsmsg_t *body);
+
+htsmsg_xml_stream_t *htsmsg_xml_stream_create
+  (htsmsg_xml_stream_cb_t *cb, void *opaque);
+int htsmsg_xml_stream_feed(htsmsg_xml_stream_t *hxs, const char *data,
+                           size_t len, char *errbuf, size_t errbufsize);
+void htsmsg_xml_stream_destroy(htsmsg_xml_stream_t *hxs);
+
 #endif /* HTSMSG_XML_H_ */
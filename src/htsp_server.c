@@ -31,6 +31,7 @@
 #include <sys/stat.h>
 #include <sys/types.h>
 #include <sys/socket.h>
+#include <sys/uio.h>
 
 #include "tvheadend.h"
 #include "channels.h"
@@ -97,8 +98,30 @@ typedef struct htsp_msg {
 			   hm_msg can contain messages that points
 			   to packet payload so to avoid copy we
 			   keep a reference here */
+
+  int64_t hm_dts;       /* DTS of muxpkt messages, for queue delay */
+
+  /**
+   * Monotonic min/max DTS deques, see htsp_dts_add()
+   */
+  TAILQ_ENTRY(htsp_msg) hm_dts_min_link;
+  TAILQ_ENTRY(htsp_msg) hm_dts_max_link;
+  uint8_t hm_dts_min;
+  uint8_t hm_dts_max;
+
+  /**
+   * Pre-serialized muxpkt header (hm_msg == NULL), the payload
+   * in hm_pb is appended on the wire
+   */
+  size_t hm_hdrlen;
+  uint8_t hm_hdr[0];
 } htsp_msg_t;
 
+#define HTSP_MUXPKT_HDR_MAX 192
+
+#define HTSP_WRITE_BATCH_MSGS  32
+#define HTSP_WRITE_BATCH_BYTES (256 * 1024)
+
 
 /**
  *
@@ -110,6 +133,8 @@ typedef struct htsp_msg_q {
   int hmq_strict_prio;      /* Serve this queue 'til it's empty */
   int hmq_length;
   int hmq_payload;          /* Bytes of streaming payload that's enqueued */
+  struct htsp_msg_queue hmq_dts_min; /* Increasing DTS, head is the min */
+  struct htsp_msg_queue hmq_dts_max; /* Decreasing DTS, head is the max */
 } htsp_msg_q_t;
 
 /**
@@ -151,6 +176,11 @@ typedef struct htsp_connection {
   htsp_msg_q_t htsp_hmq_epg;
   htsp_msg_q_t htsp_hmq_qstatus;
 
+  /* Writer statistics, protected via htsp_out_mutex */
+  uint64_t htsp_stat_writes;
+  uint64_t htsp_stat_msgs;
+  uint64_t htsp_stat_bytes;
+
   struct htsp_subscription_list htsp_subscriptions;
   struct htsp_file_list htsp_files;
   int htsp_file_id;
@@ -194,6 +224,7 @@ streaming_target_t *hs_transcoder;
   int hs_90khz;
 
   int hs_queue_depth;
+  int hs_queue_delay;  /* Max. queued time in ms, 0 = unlimited */
 
 #define NUM_FILTERED_STREAMS (32*16)
 
@@ -270,7 +301,8 @@ htsp_update_logname(htsp_connection_t *htsp)
 static void
 htsp_msg_destroy(htsp_msg_t *hm)
 {
-  htsmsg_destroy(hm->hm_msg);
+  if(hm->hm_msg != NULL)
+    htsmsg_destroy(hm->hm_msg);
   if(hm->hm_pb != NULL)
     pktbuf_ref_dec(hm->hm_pb);
   free(hm);
@@ -283,6 +315,8 @@ static void
 htsp_init_queue(htsp_msg_q_t *hmq, int strict_prio)
 {
   TAILQ_INIT(&hmq->hmq_q);
+  TAILQ_INIT(&hmq->hmq_dts_min);
+  TAILQ_INIT(&hmq->hmq_dts_max);
   hmq->hmq_length = 0;
   hmq->hmq_strict_prio = strict_prio;
 }
@@ -306,6 +340,8 @@ htsp_flush_queue(htsp_connection_t *htsp, htsp_msg_q_t *hmq)
   }
 
   // reset
+  TAILQ_INIT(&hmq->hmq_dts_min);
+  TAILQ_INIT(&hmq->hmq_dts_max);
   hmq->hmq_length = 0;
   hmq->hmq_payload = 0;
   pthread_mutex_unlock(&htsp->htsp_out_mutex);
@@ -340,23 +376,76 @@ htsp_subscription_destroy(htsp_connection_t *htsp, htsp_subscription_t *hs)
 }
 
 /**
+ * Queue DTS range tracking, htsp_out_mutex must be held
  *
+ * Each deque only keeps the messages that can still become the min
+ * (resp. max) once older messages have been sent, so both the update
+ * and the lookup are O(1) amortized
  */
 static void
-htsp_send(htsp_connection_t *htsp, htsmsg_t *m, pktbuf_t *pb,
-	  htsp_msg_q_t *hmq, int payloadsize)
+htsp_dts_add(htsp_msg_q_t *hmq, htsp_msg_t *hm)
 {
-  htsp_msg_t *hm = malloc(sizeof(htsp_msg_t));
+  htsp_msg_t *l;
+
+  hm->hm_dts_min = hm->hm_dts_max = 0;
+  if(hm->hm_dts == PTS_UNSET)
+    return;
+
+  while((l = TAILQ_LAST(&hmq->hmq_dts_min, htsp_msg_queue)) != NULL &&
+        l->hm_dts >= hm->hm_dts) {
+    TAILQ_REMOVE(&hmq->hmq_dts_min, l, hm_dts_min_link);
+    l->hm_dts_min = 0;
+  }
+  TAILQ_INSERT_TAIL(&hmq->hmq_dts_min, hm, hm_dts_min_link);
+  hm->hm_dts_min = 1;
+
+  while((l = TAILQ_LAST(&hmq->hmq_dts_max, htsp_msg_queue)) != NULL &&
+        l->hm_dts <= hm->hm_dts) {
+    TAILQ_REMOVE(&hmq->hmq_dts_max, l, hm_dts_max_link);
+    l->hm_dts_max = 0;
+  }
+  TAILQ_INSERT_TAIL(&hmq->hmq_dts_max, hm, hm_dts_max_link);
+  hm->hm_dts_max = 1;
+}
+
+/**
+ * hm is the oldest message in the queue
+ */
+static void
+htsp_dts_remove(htsp_msg_q_t *hmq, htsp_msg_t *hm)
+{
+  if(hm->hm_dts_min)
+    TAILQ_REMOVE(&hmq->hmq_dts_min, hm, hm_dts_min_link);
+  if(hm->hm_dts_max)
+    TAILQ_REMOVE(&hmq->hmq_dts_max, hm, hm_dts_max_link);
+}
+
+/**
+ * DTS span of the queue, in the subscription's time base
+ */
+static int64_t
+htsp_dts_delay(htsp_msg_q_t *hmq)
+{
+  htsp_msg_t *min = TAILQ_FIRST(&hmq->hmq_dts_min);
+  htsp_msg_t *max = TAILQ_FIRST(&hmq->hmq_dts_max);
+
+  if(min == NULL || max == NULL)
+    return 0;
+  return max->hm_dts - min->hm_dts;
+}
+
+/**
+ *
+ */
+static void
+htsp_enqueue(htsp_connection_t *htsp, htsp_msg_t *hm, htsp_msg_q_t *hmq)
+{
+  int payloadsize = hm->hm_payloadsize;
 
-  hm->hm_msg = m;
-  hm->hm_pb = pb;
-  if(pb != NULL)
-    pktbuf_ref_inc(pb);
-  hm->hm_payloadsize = payloadsize;
-  
   pthread_mutex_lock(&htsp->htsp_out_mutex);
 
   TAILQ_INSERT_TAIL(&hmq->hmq_q, hm, hm_link);
+  htsp_dts_add(hmq, hm);
 
   if(hmq->hmq_length == 0) {
     /* Activate queue */
@@ -374,6 +463,26 @@ htsp_send(htsp_connection_t *htsp, htsmsg_t *m, pktbuf_t *pb,
   pthread_mutex_unlock(&htsp->htsp_out_mutex);
 }
 
+/**
+ *
+ */
+static void
+htsp_send(htsp_connection_t *htsp, htsmsg_t *m, pktbuf_t *pb,
+	  htsp_msg_q_t *hmq, int payloadsize)
+{
+  htsp_msg_t *hm = malloc(sizeof(htsp_msg_t));
+
+  hm->hm_msg = m;
+  hm->hm_pb = pb;
+  if(pb != NULL)
+    pktbuf_ref_inc(pb);
+  hm->hm_payloadsize = payloadsize;
+  hm->hm_dts = PTS_UNSET;
+  hm->hm_hdrlen = 0;
+
+  htsp_enqueue(htsp, hm, hmq);
+}
+
 /**
  *
  */
@@ -1047,7 +1156,7 @@ htsp_method_epgQuery(htsp_connection_t *htsp, htsmsg_t *in)
   full = htsmsg_get_u32_or_default(in, "full", 0);
 
   //do the query
-  epg_query0(&eqr, ch, ct, eg, query, lang);
+  epg_query0(&eqr, ch, ct, eg, query, lang, 0, 0);
 
   // create reply
   out = htsmsg_create_map();
@@ -1363,6 +1472,7 @@ htsp_method_subscribe(htsp_connection_t *htsp, htsmsg_t *in)
   hs->hs_90khz = req90khz;
   hs->hs_queue_depth = htsmsg_get_u32_or_default(in, "queueDepth",
 						 HTSP_DEFAULT_QUEUE_DEPTH);
+  hs->hs_queue_delay = htsmsg_get_u32_or_default(in, "queueDelay", 0);
   htsp_init_queue(&hs->hs_q, 0);
 
   hs->hs_sid = sid;
@@ -1371,21 +1481,11 @@ htsp_method_subscribe(htsp_connection_t *htsp, htsmsg_t *in)
 
   streaming_target_t *st = &hs->hs_input;
 
-#if ENABLE_TIMESHIFT
-  if (timeshiftPeriod != 0) {
-    if (timeshiftPeriod == ~0)
-      tvhlog(LOG_DEBUG, "htsp", "using timeshift buffer (unlimited)");
-    else
-      tvhlog(LOG_DEBUG, "htsp", "using timeshift buffer (%u mins)", timeshiftPeriod / 60);
-    st = hs->hs_tshift = timeshift_create(st, timeshiftPeriod);
-    normts = 1;
-  }
-#endif
-
 #if ENABLE_LIBAV
-  if (transcoding_enabled) {
-    transcoder_props_t props;
+  transcoder_props_t props;
+  int transcode = 0;
 
+  if (transcoding_enabled) {
     props.tp_vcodec = streaming_component_txt2type(htsmsg_get_str(in, "videoCodec"));
     props.tp_acodec = streaming_component_txt2type(htsmsg_get_str(in, "audioCodec"));
     props.tp_scodec = streaming_component_txt2type(htsmsg_get_str(in, "subtitleCodec"));
@@ -1397,13 +1497,34 @@ htsp_method_subscribe(htsp_connection_t *htsp, htsmsg_t *in)
     if ((str = htsmsg_get_str(in, "language")))
       strncpy(props.tp_language, str, 3);
 
-    if(props.tp_vcodec != SCT_UNKNOWN ||
-       props.tp_acodec != SCT_UNKNOWN ||
-       props.tp_scodec != SCT_UNKNOWN) {
-      st = hs->hs_transcoder = transcoder_create(st);
-      transcoder_set_properties(st, &props);
-      normts = 1;
-    }
+    transcode = props.tp_vcodec != SCT_UNKNOWN ||
+                props.tp_acodec != SCT_UNKNOWN ||
+                props.tp_scodec != SCT_UNKNOWN;
+  }
+#endif
+
+#if ENABLE_TIMESHIFT
+  if (timeshiftPeriod != 0) {
+    channel_t *tsch = ch;
+    if (timeshiftPeriod == ~0)
+      tvhlog(LOG_DEBUG, "htsp", "using timeshift buffer (unlimited)");
+    else
+      tvhlog(LOG_DEBUG, "htsp", "using timeshift buffer (%u mins)", timeshiftPeriod / 60);
+#if ENABLE_LIBAV
+    /* Transcoded streams can't share the channel buffer */
+    if (transcode)
+      tsch = NULL;
+#endif
+    st = hs->hs_tshift = timeshift_create(st, timeshiftPeriod, tsch);
+    normts = 1;
+  }
+#endif
+
+#if ENABLE_LIBAV
+  if (transcode) {
+    st = hs->hs_transcoder = transcoder_create(st);
+    transcoder_set_properties(st, &props);
+    normts = 1;
   }
 #endif
 
@@ -1416,6 +1537,10 @@ htsp_method_subscribe(htsp_connection_t *htsp, htsmsg_t *in)
 					      htsp->htsp_peername,
 					      htsp->htsp_username,
 					      htsp->htsp_clientname);
+#if ENABLE_LIBAV
+  if(hs->hs_s != NULL)
+    hs->hs_s->ths_transcoder = hs->hs_transcoder;
+#endif
   return NULL;
 }
 
@@ -1981,22 +2106,54 @@ readmsg:
 }
 
 /**
- *
+ * Pick the next message to send, htsp_out_mutex must be held
+ */
+static htsp_msg_t *
+htsp_write_next(htsp_connection_t *htsp)
+{
+  htsp_msg_q_t *hmq;
+  htsp_msg_t *hm;
+
+  if((hmq = TAILQ_FIRST(&htsp->htsp_active_output_queues)) == NULL)
+    return NULL;
+
+  hm = TAILQ_FIRST(&hmq->hmq_q);
+  TAILQ_REMOVE(&hmq->hmq_q, hm, hm_link);
+  htsp_dts_remove(hmq, hm);
+  hmq->hmq_length--;
+  hmq->hmq_payload -= hm->hm_payloadsize;
+
+  TAILQ_REMOVE(&htsp->htsp_active_output_queues, hmq, hmq_link);
+  if(hmq->hmq_length) {
+    /* Still messages to be sent, put back in active queues */
+    if(hmq->hmq_strict_prio) {
+      TAILQ_INSERT_HEAD(&htsp->htsp_active_output_queues, hmq, hmq_link);
+    } else {
+      TAILQ_INSERT_TAIL(&htsp->htsp_active_output_queues, hmq, hmq_link);
+    }
+  }
+  return hm;
+}
+
+/**
+ * Messages are sent in batches of up to HTSP_WRITE_BATCH_MSGS messages
+ * or HTSP_WRITE_BATCH_BYTES bytes with a single vectored write
  */
 static void *
 htsp_write_scheduler(void *aux)
 {
   htsp_connection_t *htsp = aux;
-  htsp_msg_q_t *hmq;
-  htsp_msg_t *hm;
-  void *dptr;
-  size_t dlen;
+  htsp_msg_t *hm, *batch[HTSP_WRITE_BATCH_MSGS];
+  void *data[HTSP_WRITE_BATCH_MSGS];
+  struct iovec iov[HTSP_WRITE_BATCH_MSGS * 2];
+  size_t dlen, bytes;
+  int i, n, niov, r = 0;
 
   pthread_mutex_lock(&htsp->htsp_out_mutex);
 
   while(1) {
 
-    if((hmq = TAILQ_FIRST(&htsp->htsp_active_output_queues)) == NULL) {
+    if(TAILQ_FIRST(&htsp->htsp_active_output_queues) == NULL) {
       /* No active queues at all */
       if(!htsp->htsp_writer_run)
 	      break; /* Should not run anymore, bail out */
@@ -2006,38 +2163,59 @@ htsp_write_scheduler(void *aux)
       continue;
     }
 
-    hm = TAILQ_FIRST(&hmq->hmq_q);
-    TAILQ_REMOVE(&hmq->hmq_q, hm, hm_link);
-    hmq->hmq_length--;
-    hmq->hmq_payload -= hm->hm_payloadsize;
+    bytes = 0;
+    for(n = 0; n < HTSP_WRITE_BATCH_MSGS && bytes < HTSP_WRITE_BATCH_BYTES; n++) {
+      if((hm = htsp_write_next(htsp)) == NULL)
+        break;
+      batch[n] = hm;
+      bytes += hm->hm_payloadsize;
+    }
 
-    TAILQ_REMOVE(&htsp->htsp_active_output_queues, hmq, hmq_link);
-    if(hmq->hmq_length) {
-      /* Still messages to be sent, put back in active queues */
-      if(hmq->hmq_strict_prio) {
-	      TAILQ_INSERT_HEAD(&htsp->htsp_active_output_queues, hmq, hmq_link);
-      } else {
-        TAILQ_INSERT_TAIL(&htsp->htsp_active_output_queues, hmq, hmq_link);
+    pthread_mutex_unlock(&htsp->htsp_out_mutex);
+
+    bytes = niov = 0;
+    for(i = 0; i < n; i++) {
+      hm = batch[i];
+      data[i] = NULL;
+
+      if (hm->hm_msg == NULL) {
+        /* Pre-serialized muxpkt, no need to copy the payload */
+        iov[niov].iov_base   = hm->hm_hdr;
+        iov[niov++].iov_len  = hm->hm_hdrlen;
+        iov[niov].iov_base   = pktbuf_ptr(hm->hm_pb);
+        iov[niov++].iov_len  = pktbuf_len(hm->hm_pb);
+        bytes += hm->hm_hdrlen + pktbuf_len(hm->hm_pb);
+        continue;
+      }
+
+      if (htsmsg_binary_serialize(hm->hm_msg, &data[i], &dlen, INT32_MAX)) {
+        tvhlog(LOG_WARNING, "htsp", "%s: failed to serialize data",
+               htsp->htsp_logname);
+        continue;
       }
+      iov[niov].iov_base  = data[i];
+      iov[niov++].iov_len = dlen;
+      bytes += dlen;
     }
 
-    pthread_mutex_unlock(&htsp->htsp_out_mutex);
+    r = tvh_writev(htsp->htsp_fd, iov, niov);
 
-    if (htsmsg_binary_serialize(hm->hm_msg, &dptr, &dlen, INT32_MAX) != 0) {
-      tvhlog(LOG_WARNING, "htsp", "%s: failed to serialize data",
-             htsp->htsp_logname);
+    for(i = 0; i < n; i++) {
+      free(data[i]);
+      htsp_msg_destroy(batch[i]);
     }
 
-    htsp_msg_destroy(hm);
+    pthread_mutex_lock(&htsp->htsp_out_mutex);
 
-    if (tvh_write(htsp->htsp_fd, dptr, dlen)) {
+    if (r) {
       tvhlog(LOG_INFO, "htsp", "%s: Write error -- %s",
              htsp->htsp_logname, strerror(errno));
       break;
     }
 
-    free(dptr);
-    pthread_mutex_lock(&htsp->htsp_out_mutex);
+    htsp->htsp_stat_writes++;
+    htsp->htsp_stat_msgs  += n;
+    htsp->htsp_stat_bytes += bytes;
   }
   // Shutdown socket to make receive thread terminate entire HTSP connection
 
@@ -2046,6 +2224,32 @@ htsp_write_scheduler(void *aux)
   return NULL;
 }
 
+/**
+ * Write statistics for statedump, global_lock must be held
+ */
+void
+htsp_dump(htsbuf_queue_t *hq)
+{
+  htsp_connection_t *htsp;
+  uint64_t writes, msgs, bytes;
+
+  htsbuf_qprintf(hq, "%-40s %12s %10s %12s\n",
+                 "Connection", "Writes", "Msgs/write", "Bytes/write");
+
+  LIST_FOREACH(htsp, &htsp_connections, htsp_link) {
+    pthread_mutex_lock(&htsp->htsp_out_mutex);
+    writes = htsp->htsp_stat_writes;
+    msgs   = htsp->htsp_stat_msgs;
+    bytes  = htsp->htsp_stat_bytes;
+    pthread_mutex_unlock(&htsp->htsp_out_mutex);
+
+    htsbuf_qprintf(hq, "%-40s %12"PRIu64" %10.1f %12"PRIu64"\n",
+                   htsp->htsp_logname, writes,
+                   writes ? (double)msgs / writes : 0.0,
+                   writes ? bytes / writes : 0);
+  }
+}
+
 /**
  *
  */
@@ -2088,6 +2292,15 @@ htsp_serve(int fd, void *opaque, struct sockaddr_storage *source,
 
   tvhlog(LOG_INFO, "htsp", "%s: Disconnected", htsp.htsp_logname);
 
+  pthread_mutex_lock(&htsp.htsp_out_mutex);
+  if(htsp.htsp_stat_writes)
+    tvhlog(LOG_DEBUG, "htsp",
+           "%s: %"PRIu64" writes, %.1f messages and %"PRIu64" bytes per write",
+           htsp.htsp_logname, htsp.htsp_stat_writes,
+           (double)htsp.htsp_stat_msgs / htsp.htsp_stat_writes,
+           htsp.htsp_stat_bytes / htsp.htsp_stat_writes);
+  pthread_mutex_unlock(&htsp.htsp_out_mutex);
+
   /**
    * Ok, we're back, other end disconnected. Clean up stuff.
    */
@@ -2345,7 +2558,54 @@ const static char frametypearray[PKT_NTYPES] = {
 };
 
 /**
- * Build a htsmsg from a th_pkt and enqueue it on our HTSP service
+ * Binary htsmsg field encoders for the muxpkt fast path,
+ * see htsmsg_binary_write()
+ */
+static uint8_t *
+htsp_bin_field(uint8_t *ptr, int type, const char *name, uint32_t len)
+{
+  int namelen = strlen(name);
+
+  *ptr++ = type;
+  *ptr++ = namelen;
+  *ptr++ = len >> 24;
+  *ptr++ = len >> 16;
+  *ptr++ = len >> 8;
+  *ptr++ = len;
+  memcpy(ptr, name, namelen);
+  return ptr + namelen;
+}
+
+static uint8_t *
+htsp_bin_str(uint8_t *ptr, const char *name, const char *str)
+{
+  int l = strlen(str);
+
+  ptr = htsp_bin_field(ptr, HMF_STR, name, l);
+  memcpy(ptr, str, l);
+  return ptr + l;
+}
+
+static uint8_t *
+htsp_bin_s64(uint8_t *ptr, const char *name, int64_t s64)
+{
+  uint64_t u64 = s64;
+  int l = 0;
+
+  while(u64 != 0) {
+    l++;
+    u64 = u64 >> 8;
+  }
+  ptr = htsp_bin_field(ptr, HMF_S64, name, l);
+  for(u64 = s64; l > 0; l--) {
+    *ptr++ = u64;
+    u64 = u64 >> 8;
+  }
+  return ptr;
+}
+
+/**
+ * Serialize a th_pkt and enqueue it on our HTSP service
  */
 static void
 htsp_stream_deliver(htsp_subscription_t *hs, th_pkt_t *pkt)
@@ -2353,17 +2613,31 @@ htsp_stream_deliver(htsp_subscription_t *hs, th_pkt_t *pkt)
   htsmsg_t *m;
   htsp_msg_t *hm;
   htsp_connection_t *htsp = hs->hs_htsp;
-  int64_t ts;
+  uint8_t *p;
+  size_t len;
+  int64_t delay;
   int qlen = hs->hs_q.hmq_payload;
+  int qdelay = 0;
 
   if(!htsp_is_stream_enabled(hs, pkt->pkt_componentindex)) {
     pkt_ref_dec(pkt);
     return;
   }
 
+  if(hs->hs_queue_delay) {
+    pthread_mutex_lock(&htsp->htsp_out_mutex);
+    delay = htsp_dts_delay(&hs->hs_q);
+    pthread_mutex_unlock(&htsp->htsp_out_mutex);
+    qdelay = delay / (hs->hs_90khz ? 90 : 1000);
+  }
+
   if((qlen > hs->hs_queue_depth     && pkt->pkt_frametype == PKT_B_FRAME) ||
      (qlen > hs->hs_queue_depth * 2 && pkt->pkt_frametype == PKT_P_FRAME) || 
-     (qlen > hs->hs_queue_depth * 3)) {
+     (qlen > hs->hs_queue_depth * 3) ||
+     (hs->hs_queue_delay &&
+      ((qdelay > hs->hs_queue_delay     && pkt->pkt_frametype == PKT_B_FRAME) ||
+       (qdelay > hs->hs_queue_delay * 2 && pkt->pkt_frametype == PKT_P_FRAME) ||
+       (qdelay > hs->hs_queue_delay * 3)))) {
 
     hs->hs_dropstats[pkt->pkt_frametype]++;
 
@@ -2372,37 +2646,49 @@ htsp_stream_deliver(htsp_subscription_t *hs, th_pkt_t *pkt)
     return;
   }
 
-  m = htsmsg_create_map();
- 
-  htsmsg_add_str(m, "method", "muxpkt");
-  htsmsg_add_u32(m, "subscriptionId", hs->hs_sid);
-  htsmsg_add_u32(m, "frametype", frametypearray[pkt->pkt_frametype]);
+  pkt = pkt_merge_header(pkt);
 
-  htsmsg_add_u32(m, "stream", pkt->pkt_componentindex);
-  htsmsg_add_u32(m, "com", pkt->pkt_commercial);
+  /**
+   * The header is serialized here, in the same field order htsmsg would
+   * use, and the payload is written straight from the pktbuf
+   */
+  hm = malloc(sizeof(htsp_msg_t) + HTSP_MUXPKT_HDR_MAX);
+  hm->hm_msg = NULL;
+  hm->hm_pb = pkt->pkt_payload;
+  pktbuf_ref_inc(pkt->pkt_payload);
+  hm->hm_payloadsize = pktbuf_len(pkt->pkt_payload);
+  hm->hm_dts = PTS_UNSET;
+
+  p = hm->hm_hdr + 4;
+  p = htsp_bin_str(p, "method", "muxpkt");
+  p = htsp_bin_s64(p, "subscriptionId", hs->hs_sid);
+  p = htsp_bin_s64(p, "frametype", frametypearray[pkt->pkt_frametype]);
+  p = htsp_bin_s64(p, "stream", pkt->pkt_componentindex);
+  p = htsp_bin_s64(p, "com", pkt->pkt_commercial);
 
   if(pkt->pkt_pts != PTS_UNSET) {
     int64_t pts = hs->hs_90khz ? pkt->pkt_pts : ts_rescale(pkt->pkt_pts, 1000000);
-    htsmsg_add_s64(m, "pts", pts);
+    p = htsp_bin_s64(p, "pts", pts);
   }
 
   if(pkt->pkt_dts != PTS_UNSET) {
     int64_t dts = hs->hs_90khz ? pkt->pkt_dts : ts_rescale(pkt->pkt_dts, 1000000);
-    htsmsg_add_s64(m, "dts", dts);
+    p = htsp_bin_s64(p, "dts", dts);
+    hm->hm_dts = dts;
   }
 
   uint32_t dur = hs->hs_90khz ? pkt->pkt_duration : ts_rescale(pkt->pkt_duration, 1000000);
-  htsmsg_add_u32(m, "duration", dur);
-  
-  pkt = pkt_merge_header(pkt);
+  p = htsp_bin_s64(p, "duration", dur);
+  p = htsp_bin_field(p, HMF_BIN, "payload", hm->hm_payloadsize);
 
-  /**
-   * Since we will serialize directly we use 'binptr' which is a binary
-   * object that just points to data, thus avoiding a copy.
-   */
-  htsmsg_add_binptr(m, "payload", pktbuf_ptr(pkt->pkt_payload),
-		    pktbuf_len(pkt->pkt_payload));
-  htsp_send(htsp, m, pkt->pkt_payload, &hs->hs_q, pktbuf_len(pkt->pkt_payload));
+  hm->hm_hdrlen = p - hm->hm_hdr;
+  len = hm->hm_hdrlen - 4 + hm->hm_payloadsize;
+  hm->hm_hdr[0] = len >> 24;
+  hm->hm_hdr[1] = len >> 16;
+  hm->hm_hdr[2] = len >> 8;
+  hm->hm_hdr[3] = len;
+
+  htsp_enqueue(htsp, hm, &hs->hs_q);
 
   if(hs->hs_last_report != dispatch_clock) {
 
@@ -2421,32 +2707,11 @@ htsp_stream_deliver(htsp_subscription_t *hs, th_pkt_t *pkt)
      */
     
     pthread_mutex_lock(&htsp->htsp_out_mutex);
-
-    int64_t min_dts = PTS_UNSET;
-    int64_t max_dts = PTS_UNSET;
-    TAILQ_FOREACH(hm, &hs->hs_q.hmq_q, hm_link) {
-      if(!hm->hm_msg)
-	continue;
-      if(htsmsg_get_s64(hm->hm_msg, "dts", &ts))
-	continue;
-      if(ts == PTS_UNSET)
-	continue;
-  
-      if(min_dts == PTS_UNSET)
-	min_dts = ts;
-      else
-	min_dts = MIN(ts, min_dts);
-
-      if(max_dts == PTS_UNSET)
-	max_dts = ts;
-      else
-	max_dts = MAX(ts, max_dts);
-    }
-
-    htsmsg_add_s64(m, "delay", max_dts - min_dts);
-
+    delay = htsp_dts_delay(&hs->hs_q);
     pthread_mutex_unlock(&htsp->htsp_out_mutex);
 
+    htsmsg_add_s64(m, "delay", delay);
+
     htsmsg_add_u32(m, "Bdrops", hs->hs_dropstats[PKT_B_FRAME]);
     htsmsg_add_u32(m, "Pdrops", hs->hs_dropstats[PKT_P_FRAME]);
     htsmsg_add_u32(m, "Idrops", hs->hs_dropstats[PKT_I_FRAME]);
@@ -2647,6 +2912,7 @@ htsp_subscription_timeshift_status(htsp_subscription_t *hs, timeshift_status_t *
     htsmsg_add_s64(m, "start", hs->hs_90khz ? status->pts_start : ts_rescale(status->pts_start, 1000000)) ;
   if (status->pts_end != PTS_UNSET)
     htsmsg_add_s64(m, "end", hs->hs_90khz ? status->pts_end : ts_rescale(status->pts_end, 1000000)) ;
+  htsmsg_add_s64(m, "indexSize", status->index_size);
   htsp_send(hs->hs_htsp, m, NULL, &hs->hs_q, 0);
 }
 #endif
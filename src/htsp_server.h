@@ -21,6 +21,7 @@
 
 #include "epg.h"
 #include "dvr/dvr.h"
+#include "htsbuf.h"
 
 void htsp_init(const char *bindaddr);
 
@@ -42,4 +43,6 @@ void htsp_event_add(epg_broadcast_t *ebc);
 void htsp_event_update(epg_broadcast_t *ebc);
 void htsp_event_delete(epg_broadcast_t *ebc);
 
+void htsp_dump(htsbuf_queue_t *hq);
+
 #endif /* HTSP_H_ */
@@ -33,9 +33,41 @@
 #include "tcp.h"
 #include "http.h"
 #include "access.h"
+#include "tvhpoll.h"
+#include "atomic.h"
+
+#define HTTP_WORKERS       8
+#define HTTP_POLL_EVENTS   64
+#define HTTP_HEADER_MAX    (64 * 1024)
+#define HTTP_POST_MAX      (16 * 1024 * 1024)
+#define HTTP_IDLE_TIMEOUT  (60 * 1000000LL)
+#define HTTP_HIST_BUCKETS  9
 
 static void *http_server;
 
+static tvhpoll_t *http_poll;
+
+/**
+ * Connections waiting in the poller and requests waiting for a worker
+ */
+static TAILQ_HEAD(, http_connection) http_idle;
+static TAILQ_HEAD(, http_connection) http_jobs;
+static pthread_mutex_t http_mutex;
+static pthread_cond_t  http_cond;
+static int http_jobs_count;
+static int http_workers;
+static int http_workers_idle;
+static int http_workers_detached;
+
+static int      http_conn_accepted;
+static int      http_conn_active;
+static uint64_t http_requests;
+static int64_t  http_wait_sum;
+static int64_t  http_wait_max;
+static int      http_hist[HTTP_HIST_BUCKETS];
+static const int http_hist_limits[HTTP_HIST_BUCKETS - 1] =
+  { 1, 5, 10, 50, 100, 500, 1000, 5000 };
+
 static LIST_HEAD(, http_path) http_paths;
 
 static struct strtab HTTP_cmdtab[] = {
@@ -394,19 +426,8 @@ http_cmd_post(http_connection_t *hc, htsbuf_queue_t *spill)
   char *remain, *args, *v, *argv[2];
   int n;
 
-  /* Set keep-alive status */
-  v = http_arg_get(&hc->hc_args, "Content-Length");
-  if(v == NULL) {
-    /* No content length in POST, make us disconnect */
-    return -1;
-  }
-
-  hc->hc_post_len = atoi(v);
-  if(hc->hc_post_len > 16 * 1024 * 1024) {
-    /* Bail out if POST data > 16 Mb */
-    hc->hc_keep_alive = 0;
-    return -1;
-  }
+  /* Content-Length was checked by http_parse_request(), the data is
+     already buffered in the spill queue */
 
   /* Allocate space for data, we add a terminating null char to ease
      string processing on the content */
@@ -708,54 +729,241 @@ http_parse_get_args(http_connection_t *hc, char *args)
 
 
 /**
+ * Check if the spill queue holds a complete request header
+ */
+static int
+http_header_complete(htsbuf_queue_t *hq)
+{
+  htsbuf_data_t *hd;
+  int i, nl = 0;
+
+  TAILQ_FOREACH(hd, &hq->hq_q, hd_link)
+    for(i = hd->hd_data_off; i < hd->hd_data_len; i++) {
+      if(hd->hd_data[i] == '\n') {
+        if(++nl == 2)
+          return 1;
+      } else if(hd->hd_data[i] != '\r') {
+        nl = 0;
+      }
+    }
+  return 0;
+}
+
+
+/**
+ * Parse the request line and headers once they are fully buffered
  *
+ * Returns 1 when the request (including POST data) is complete,
+ * 0 if more data is needed and -1 if we should disconnect
  */
-static void
-http_serve_requests(http_connection_t *hc, htsbuf_queue_t *spill)
+static int
+http_parse_request(http_connection_t *hc)
 {
-  char cmdline[1024];
   char hdrline[1024];
-  char *argv[3], *c;
-  int n;
+  char *argv[3], *c, *v;
 
-  htsbuf_queue_init(&hc->hc_reply, 0);
+  if(hc->hc_state == HTTP_CON_WAIT_REQUEST ||
+     hc->hc_state == HTTP_CON_READ_HEADER) {
 
-  do {
-    hc->hc_no_output  = 0;
+    if(!http_header_complete(&hc->hc_spill)) {
+      if(hc->hc_spill.hq_size > HTTP_HEADER_MAX)
+        return -1;
+      hc->hc_state = hc->hc_spill.hq_size ? HTTP_CON_READ_HEADER
+                                          : HTTP_CON_WAIT_REQUEST;
+      return 0;
+    }
 
-    if(tcp_read_line(hc->hc_fd, cmdline, sizeof(cmdline), spill) < 0)
-      return;
+    /* The lines are buffered, tcp_read_line() does not touch the socket */
+    if(tcp_read_line(hc->hc_fd, hc->hc_cmdline, sizeof(hc->hc_cmdline),
+                     &hc->hc_spill) < 0)
+      return -1;
+
+    if(http_tokenize(hc->hc_cmdline, argv, 3, -1) != 3)
+      return -1;
 
-    if((n = http_tokenize(cmdline, argv, 3, -1)) != 3)
-      return;
-    
     if((hc->hc_cmd = str2val(argv[0], HTTP_cmdtab)) == -1)
-      return;
+      return -1;
     hc->hc_url = argv[1];
     if((hc->hc_version = str2val(argv[2], HTTP_versiontab)) == -1)
-      return;
+      return -1;
 
     /* parse header */
     while(1) {
-      if(tcp_read_line(hc->hc_fd, hdrline, sizeof(hdrline), spill) < 0)
-	return;
+      if(tcp_read_line(hc->hc_fd, hdrline, sizeof(hdrline),
+                       &hc->hc_spill) < 0)
+        return -1;
 
       if(hdrline[0] == 0)
-	break; /* header complete */
+        break; /* header complete */
 
-      if((n = http_tokenize(hdrline, argv, 2, -1)) < 2)
-	continue;
+      if(http_tokenize(hdrline, argv, 2, -1) < 2)
+        continue;
 
       if((c = strrchr(argv[0], ':')) == NULL)
-	return;
+        return -1;
 
       *c = 0;
       http_arg_set(&hc->hc_args, argv[0], argv[1]);
     }
 
-    if(process_request(hc, spill))
+    hc->hc_state = HTTP_CON_END;
+
+    if(hc->hc_cmd == HTTP_CMD_POST) {
+      /* No content length in POST, make us disconnect */
+      if((v = http_arg_get(&hc->hc_args, "Content-Length")) == NULL)
+        return -1;
+
+      /* Bail out if POST data > 16 Mb */
+      hc->hc_post_len = atoi(v);
+      if(hc->hc_post_len > HTTP_POST_MAX)
+        return -1;
+
+      hc->hc_state = HTTP_CON_POST_DATA;
+    }
+  }
+
+  if(hc->hc_state == HTTP_CON_POST_DATA) {
+    if(hc->hc_spill.hq_size < hc->hc_post_len)
+      return 0;
+    hc->hc_state = HTTP_CON_END;
+  }
+
+  return 1;
+}
+
+
+/**
+ * Read whatever the socket has for us, never blocks
+ */
+static int
+http_conn_fill(http_connection_t *hc)
+{
+  char buf[4096];
+  int r;
+
+  while(1) {
+    r = recv(hc->hc_fd, buf, sizeof(buf), MSG_DONTWAIT);
+    if(r > 0) {
+      htsbuf_append(&hc->hc_spill, buf, r);
+      if(r < sizeof(buf))
+        return 0;
+    } else if(r == 0) {
+      return -1;
+    } else if(errno == EAGAIN || errno == EWOULDBLOCK) {
+      return 0;
+    } else if(errno != EINTR) {
+      return -1;
+    }
+  }
+}
+
+
+/**
+ *
+ */
+static void
+http_conn_destroy(http_connection_t *hc)
+{
+  free(hc->hc_post_data);
+  free(hc->hc_username);
+  free(hc->hc_password);
+
+  http_arg_flush(&hc->hc_args);
+  http_arg_flush(&hc->hc_req_args);
+
+  htsbuf_queue_flush(&hc->hc_reply);
+  htsbuf_queue_flush(&hc->hc_spill);
+  close(hc->hc_fd);
+  free(hc);
+
+  atomic_add(&http_conn_active, -1);
+}
+
+
+/**
+ * Hand a connection (back) to the poller
+ */
+static void
+http_conn_idle(http_connection_t *hc)
+{
+  tvhpoll_event_t ev;
+
+  pthread_mutex_lock(&http_mutex);
+  hc->hc_time = getmonoclock();
+  TAILQ_INSERT_TAIL(&http_idle, hc, hc_link);
+  pthread_mutex_unlock(&http_mutex);
+
+  memset(&ev, 0, sizeof(ev));
+  ev.fd       = hc->hc_fd;
+  ev.events   = TVHPOLL_IN;
+  ev.data.ptr = hc;
+  if(tvhpoll_add(http_poll, &ev, 1)) {
+    tvhlog(LOG_ERR, "HTTP", "unable to poll connection: %s",
+           strerror(errno));
+    pthread_mutex_lock(&http_mutex);
+    TAILQ_REMOVE(&http_idle, hc, hc_link);
+    pthread_mutex_unlock(&http_mutex);
+    http_conn_destroy(hc);
+  }
+}
+
+
+/**
+ * Take a connection out of the poller
+ */
+static void
+http_conn_unpoll(http_connection_t *hc)
+{
+  tvhpoll_event_t ev;
+
+  memset(&ev, 0, sizeof(ev));
+  ev.fd = hc->hc_fd;
+  tvhpoll_rem(http_poll, &ev, 1);
+}
+
+
+/**
+ *
+ */
+static void
+http_record(int64_t wait, int64_t run)
+{
+  int i, ms = run / 1000;
+
+  for(i = 0; i < HTTP_HIST_BUCKETS - 1; i++)
+    if(ms < http_hist_limits[i])
       break;
 
+  pthread_mutex_lock(&http_mutex);
+  http_requests++;
+  http_hist[i]++;
+  http_wait_sum += wait;
+  if(wait > http_wait_max)
+    http_wait_max = wait;
+  pthread_mutex_unlock(&http_mutex);
+}
+
+
+/**
+ * Run the buffered requests of a connection, returns with the
+ * connection either closed or handed back to the poller
+ *
+ * Returns non-zero if the calling thread has left the worker pool
+ */
+static int
+http_serve_requests(http_connection_t *hc)
+{
+  int64_t start;
+  int r, detached;
+
+  do {
+    hc->hc_no_output = 0;
+
+    start = getmonoclock();
+    r = process_request(hc, &hc->hc_spill);
+    if(!hc->hc_detached)
+      http_record(start - hc->hc_time, getmonoclock() - start);
+
     free(hc->hc_post_data);
     hc->hc_post_data = NULL;
 
@@ -770,44 +978,233 @@ http_serve_requests(http_connection_t *hc, htsbuf_queue_t *spill)
     free(hc->hc_password);
     hc->hc_password = NULL;
 
-  } while(hc->hc_keep_alive);
-  
+    hc->hc_state = HTTP_CON_WAIT_REQUEST;
+    detached = hc->hc_detached;
+
+    if(r || !hc->hc_keep_alive) {
+      http_conn_destroy(hc);
+      return detached;
+    }
+
+    /* Pipelined requests are served right away */
+    hc->hc_time = getmonoclock();
+  } while((r = http_parse_request(hc)) > 0);
+
+  if(r < 0)
+    http_conn_destroy(hc);
+  else
+    http_conn_idle(hc);
+  return detached;
+}
+
+
+/**
+ *
+ */
+static void *http_worker(void *aux);
+
+static void
+http_worker_spawn(void)
+{
+  pthread_attr_t attr;
+  pthread_t tid;
+
+  lock_assert(&http_mutex);
+
+  http_workers++;
+  pthread_attr_init(&attr);
+  pthread_attr_setdetachstate(&attr, PTHREAD_CREATE_DETACHED);
+  if(pthread_create(&tid, &attr, http_worker, NULL))
+    http_workers--;
+  pthread_attr_destroy(&attr);
+}
+
+
+/**
+ * Worker thread, the pool grows on demand up to HTTP_WORKERS
+ */
+static void *
+http_worker(void *aux)
+{
+  http_connection_t *hc;
+  int detached;
+
+  pthread_mutex_lock(&http_mutex);
+  while(1) {
+    while((hc = TAILQ_FIRST(&http_jobs)) == NULL) {
+      http_workers_idle++;
+      pthread_cond_wait(&http_cond, &http_mutex);
+      http_workers_idle--;
+    }
+    TAILQ_REMOVE(&http_jobs, hc, hc_link);
+    http_jobs_count--;
+    pthread_mutex_unlock(&http_mutex);
+
+    hc->hc_detached = 0;
+    detached = http_serve_requests(hc);
+
+    pthread_mutex_lock(&http_mutex);
+    if(detached) {
+      http_workers_detached--;
+      /* Rejoin the pool if there is room, otherwise we are done */
+      if(http_workers >= HTTP_WORKERS)
+        break;
+      http_workers++;
+    }
+  }
+  pthread_mutex_unlock(&http_mutex);
+  return NULL;
+}
+
+
+/**
+ * Queue a complete request for the worker pool
+ */
+static void
+http_dispatch(http_connection_t *hc)
+{
+  pthread_mutex_lock(&http_mutex);
+  hc->hc_time = getmonoclock();
+  TAILQ_INSERT_TAIL(&http_jobs, hc, hc_link);
+  http_jobs_count++;
+  if(http_jobs_count > http_workers_idle && http_workers < HTTP_WORKERS)
+    http_worker_spawn();
+  pthread_cond_signal(&http_cond);
+  pthread_mutex_unlock(&http_mutex);
 }
 
 
 /**
  *
  */
+void
+http_worker_detach(http_connection_t *hc)
+{
+  if(hc->hc_detached)
+    return;
+  hc->hc_detached = 1;
+
+  pthread_mutex_lock(&http_mutex);
+  http_workers--;
+  http_workers_detached++;
+  if(http_jobs_count > http_workers_idle && http_workers < HTTP_WORKERS)
+    http_worker_spawn();
+  pthread_mutex_unlock(&http_mutex);
+}
+
+
+/**
+ * Poller thread, reads and parses requests of all idle connections
+ */
+static void *
+http_server_loop(void *aux)
+{
+  tvhpoll_event_t ev[HTTP_POLL_EVENTS];
+  http_connection_t *hc;
+  int64_t now;
+  int i, n, r;
+
+  while(1) {
+    n = tvhpoll_wait(http_poll, ev, HTTP_POLL_EVENTS, 1000);
+    if(n < 0) {
+      if(errno != EINTR)
+        tvhlog(LOG_ERR, "HTTP", "poll failed: %s", strerror(errno));
+      n = 0;
+    }
+
+    for(i = 0; i < n; i++) {
+      hc = ev[i].data.ptr;
+
+      pthread_mutex_lock(&http_mutex);
+      TAILQ_REMOVE(&http_idle, hc, hc_link);
+      pthread_mutex_unlock(&http_mutex);
+
+      if((r = http_conn_fill(hc)) == 0)
+        r = http_parse_request(hc);
+
+      if(r == 0) {
+        pthread_mutex_lock(&http_mutex);
+        hc->hc_time = getmonoclock();
+        TAILQ_INSERT_TAIL(&http_idle, hc, hc_link);
+        pthread_mutex_unlock(&http_mutex);
+        continue;
+      }
+
+      http_conn_unpoll(hc);
+      if(r > 0)
+        http_dispatch(hc);
+      else
+        http_conn_destroy(hc);
+    }
+
+    /* Drop connections that have been quiet for too long */
+    now = getmonoclock();
+    pthread_mutex_lock(&http_mutex);
+    while((hc = TAILQ_FIRST(&http_idle)) != NULL &&
+          hc->hc_time + HTTP_IDLE_TIMEOUT < now) {
+      TAILQ_REMOVE(&http_idle, hc, hc_link);
+      pthread_mutex_unlock(&http_mutex);
+      http_conn_unpoll(hc);
+      http_conn_destroy(hc);
+      pthread_mutex_lock(&http_mutex);
+    }
+    pthread_mutex_unlock(&http_mutex);
+  }
+  return NULL;
+}
+
+
+/**
+ * Accept callback, invoked from the tcp server thread
+ */
 static void
 http_serve(int fd, void *opaque, struct sockaddr_storage *peer, 
 	   struct sockaddr_storage *self)
 {
-  htsbuf_queue_t spill;
-  http_connection_t hc;
-  
-  memset(&hc, 0, sizeof(http_connection_t));
+  http_connection_t *hc = calloc(1, sizeof(http_connection_t));
 
-  TAILQ_INIT(&hc.hc_args);
-  TAILQ_INIT(&hc.hc_req_args);
-
-  hc.hc_fd = fd;
-  hc.hc_peer = peer;
-  hc.hc_self = self;
+  TAILQ_INIT(&hc->hc_args);
+  TAILQ_INIT(&hc->hc_req_args);
+  htsbuf_queue_init(&hc->hc_reply, 0);
+  htsbuf_queue_init(&hc->hc_spill, 0);
 
-  htsbuf_queue_init(&spill, 0);
+  hc->hc_fd = fd;
+  hc->hc_peer_addr = *peer;
+  hc->hc_self_addr = *self;
+  hc->hc_peer = &hc->hc_peer_addr;
+  hc->hc_self = &hc->hc_self_addr;
 
-  http_serve_requests(&hc, &spill);
+  atomic_add(&http_conn_accepted, 1);
+  atomic_add(&http_conn_active, 1);
 
-  free(hc.hc_post_data);
-  free(hc.hc_username);
-  free(hc.hc_password);
+  http_conn_idle(hc);
+}
 
-  http_arg_flush(&hc.hc_args);
-  http_arg_flush(&hc.hc_req_args);
 
-  htsbuf_queue_flush(&hc.hc_reply);
-  htsbuf_queue_flush(&spill);
-  close(fd);
+/**
+ *
+ */
+void
+http_server_dump(htsbuf_queue_t *hq)
+{
+  int i;
+
+  pthread_mutex_lock(&http_mutex);
+  htsbuf_qprintf(hq, "Connections: %d accepted, %d active\n",
+                 http_conn_accepted, http_conn_active);
+  htsbuf_qprintf(hq, "Workers: %d (%d idle, max %d), %d detached, "
+                 "%d queued\n", http_workers, http_workers_idle,
+                 HTTP_WORKERS, http_workers_detached, http_jobs_count);
+  htsbuf_qprintf(hq, "Requests: %"PRIu64", queue wait avg %"PRId64"us "
+                 "max %"PRId64"us\n", http_requests,
+                 http_requests ? http_wait_sum / (int64_t)http_requests : 0,
+                 http_wait_max);
+
+  htsbuf_qprintf(hq, "Handler latency:");
+  for(i = 0; i < HTTP_HIST_BUCKETS - 1; i++)
+    htsbuf_qprintf(hq, " <%dms:%d", http_hist_limits[i], http_hist[i]);
+  htsbuf_qprintf(hq, " more:%d\n", http_hist[i]);
+  pthread_mutex_unlock(&http_mutex);
 }
 
 
@@ -817,5 +1214,16 @@ http_serve(int fd, void *opaque, struct sockaddr_storage *peer,
 void
 http_server_init(const char *bindaddr)
 {
-  http_server = tcp_server_create(bindaddr, tvheadend_webui_port, http_serve, NULL);
+  pthread_t tid;
+
+  TAILQ_INIT(&http_idle);
+  TAILQ_INIT(&http_jobs);
+  pthread_mutex_init(&http_mutex, NULL);
+  pthread_cond_init(&http_cond, NULL);
+
+  http_poll = tvhpoll_create(HTTP_POLL_EVENTS);
+  pthread_create(&tid, NULL, http_server_loop, NULL);
+
+  http_server = tcp_server_create_inline(bindaddr, tvheadend_webui_port,
+                                         http_serve, NULL);
 }
@@ -19,6 +19,8 @@
 #ifndef HTTP_H_
 #define HTTP_H_
 
+#include <sys/socket.h>
+
 #include "htsbuf.h"
 
 TAILQ_HEAD(http_arg_list, http_arg);
@@ -38,11 +40,19 @@ typedef struct http_arg {
 
 
 typedef struct http_connection {
+  TAILQ_ENTRY(http_connection) hc_link;
   int hc_fd;
   struct sockaddr_storage *hc_peer;
   struct sockaddr_storage *hc_self;
+  struct sockaddr_storage hc_peer_addr;
+  struct sockaddr_storage hc_self_addr;
   char *hc_representative;
 
+  htsbuf_queue_t hc_spill;          /* Received but not yet parsed data */
+  char hc_cmdline[1024];            /* Request line, hc_url points here */
+  int64_t hc_time;                  /* Last activity or dispatch time */
+  int hc_detached;                  /* Handler left the worker pool */
+
   char *hc_url;
   char *hc_url_orig;
   int hc_keep_alive;
@@ -56,7 +66,7 @@ typedef struct http_connection {
   enum {
     HTTP_CON_WAIT_REQUEST,
     HTTP_CON_READ_HEADER,
-    HTTP_CON_END,
+    HTTP_CON_END,                   /* Request complete, ready to run */
     HTTP_CON_POST_DATA,
   } hc_state;
 
@@ -135,6 +145,15 @@ http_path_t *http_path_add(const char *path, void *opaque,
 
 void http_server_init(const char *bindaddr);
 
+/**
+ * Called by handlers that run for a long time (streaming, long polls),
+ * the calling thread leaves the worker pool so that it keeps serving
+ * other requests
+ */
+void http_worker_detach(http_connection_t *hc);
+
+void http_server_dump(htsbuf_queue_t *hq);
+
 int http_access_verify(http_connection_t *hc, int mask);
 
 void http_deescape(char *s);
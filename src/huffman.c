@@ -29,6 +29,7 @@ void huffman_tree_destroy ( huffman_node_t *n )
   huffman_tree_destroy(n->b0);
   huffman_tree_destroy(n->b1);
   if (n->data) free(n->data);
+  if (n->lut)  free(n->lut);
   free(n);
 }
 
@@ -42,8 +43,45 @@ huffman_node_t *huffman_tree_load ( const char *path )
   return ret;
 }
 
+/*
+ * Fill the lookup table for all codes continuing at node, sub tables are
+ * appended to the lut array, returns the offset of the table
+ */
+static uint32_t _huffman_lut_build
+  ( huffman_node_t *node, int bits, huffman_lut_t **lut, uint32_t *size )
+{
+  uint32_t i, off = *size, sub;
+  int d;
+  huffman_node_t *n;
+
+  *size += 1 << bits;
+  *lut   = realloc(*lut, *size * sizeof(huffman_lut_t));
+  memset(*lut + off, 0, (1 << bits) * sizeof(huffman_lut_t));
+
+  for (i = 0; i < (1 << bits); i++) {
+    n = node;
+    for (d = 0; d < bits; d++) {
+      n = (i & (1 << (bits - d - 1))) ? n->b1 : n->b0;
+      if (!n || n->data) break;
+    }
+    if (!n) continue;
+    if (n->data) {
+      (*lut)[off + i].data = n->data;
+      (*lut)[off + i].len  = d + 1;
+    } else {
+      /* Longer code, the array may move */
+      sub = _huffman_lut_build(n, HUFFMAN_SUB_BITS, lut, size);
+      (*lut)[off + i].sub      = sub;
+      (*lut)[off + i].len      = bits;
+      (*lut)[off + i].sub_bits = HUFFMAN_SUB_BITS;
+    }
+  }
+  return off;
+}
+
 huffman_node_t *huffman_tree_build ( htsmsg_t *m )
 {
+  uint32_t size = 0;
   const char *code, *data, *c;
   htsmsg_t *e;
   htsmsg_field_t *f;
@@ -71,6 +109,7 @@ huffman_node_t *huffman_tree_build ( htsmsg_t *m )
       node->data = strdup(data);
     }
   }
+  _huffman_lut_build(root, HUFFMAN_ROOT_BITS, &root->lut, &size);
   return root; 
 }
 
@@ -78,33 +117,48 @@ char *huffman_decode
   ( huffman_node_t *tree, const uint8_t *data, size_t len, uint8_t mask,
     char *outb, int outl )
 {
-  char           *ret  = outb;
-  huffman_node_t *node = tree;
+  char                *ret = outb;
+  const huffman_lut_t *e;
+  const char          *t;
+  const uint8_t       *end = data + len;
+  uint64_t             acc = 0;   // bit buffer, msb first
+  int                  avail = 0, pad = 0, bits;
+  uint32_t             off;
   if (!len) return NULL;
 
+  /* Skip the bits above the mask in the first byte */
+  for (bits = 0; bits < 8 && !(mask & (0x80 >> bits)); bits++);
+  if (bits < 8) {
+    acc   = (uint64_t)*data << (56 + bits);
+    avail = 8 - bits;
+  }
+  data++;
+
   outl--; // leave space for NULL
-  while (len) {
-    len--;
-    while (mask) {
-      if (*data & mask) {
-        node = node->b1;
-      } else {
-        node = node->b0;
-      }
-      mask >>= 1;
-      if (!node) goto end;
-      if (node->data) {
-        char *t = node->data;
-        while (*t && outl) {
-          *outb = *t;
-          outb++; t++; outl--;
-        }
-        if (!outl) goto end;
-        node = tree;
-      }
+  while (1) {
+    /* Refill, past the end with zero bits which are never consumed */
+    while (avail <= 56) {
+      if (data < end)
+        acc |= (uint64_t)*data++ << (56 - avail);
+      else
+        pad += 8;
+      avail += 8;
+    }
+    if (avail == pad) break;
+    off  = 0;
+    bits = HUFFMAN_ROOT_BITS;
+    while (1) {
+      e = &tree->lut[off + (acc >> (64 - bits))];
+      if (!e->len || e->len > avail - pad) goto end;
+      acc   <<= e->len;
+      avail  -= e->len;
+      if (e->data) break;
+      off  = e->sub;
+      bits = e->sub_bits;
     }
-    mask = 0x80;
-    data++;
+    for (t = e->data; *t && outl; t++, outl--)
+      *outb++ = *t;
+    if (!outl) goto end;
   }
 end:
   *outb = '\0';
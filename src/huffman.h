@@ -22,11 +22,28 @@
 #include <sys/types.h>
 #include "htsmsg.h"
 
+/* Index bits of the root and the sub lookup tables */
+#define HUFFMAN_ROOT_BITS 10
+#define HUFFMAN_SUB_BITS   6
+
+/*
+ * Lookup table entry, either a complete code (data set), a longer code
+ * continued in a sub table (sub set) or an invalid code (neither)
+ */
+typedef struct huffman_lut
+{
+  const char *data;
+  uint32_t    sub;
+  uint8_t     len;      // bits consumed
+  uint8_t     sub_bits;
+} huffman_lut_t;
+
 typedef struct huffman_node
 {
   struct huffman_node *b0;
   struct huffman_node *b1;
   char                *data;
+  huffman_lut_t       *lut;   // root only, built by huffman_tree_build()
 } huffman_node_t;
 
 void huffman_tree_destroy ( huffman_node_t *tree );
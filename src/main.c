@@ -58,6 +58,8 @@
 #include "trap.h"
 #include "settings.h"
 #include "ffdecsa/FFdecsa.h"
+#include "tvhcsa.h"
+#include "parser_sc.h"
 #include "muxes.h"
 #include "config2.h"
 #include "imagecache.h"
@@ -420,7 +422,8 @@ main(int argc, char **argv)
               opt_noacl        = 0,
               opt_trace        = 0,
               opt_fileline     = 0,
-              opt_ipv6         = 0;
+              opt_ipv6         = 0,
+              opt_snapshot     = 0;
   const char *opt_config       = NULL,
              *opt_user         = NULL,
              *opt_group        = NULL,
@@ -451,6 +454,9 @@ main(int argc, char **argv)
 	                      "to your Tvheadend installation until you edit\n"
 	                      "the access-control from within the Tvheadend UI",
       OPT_BOOL, &opt_firstrun },
+    {   0, "snapshot",  "Keep a binary snapshot of the configuration\n"
+                        "for faster startup",
+      OPT_BOOL, &opt_snapshot },
 #if ENABLE_LINUXDVB
     { 'a', "adapters",  "Only use specified DVB adapters (comma separated)",
       OPT_STR, &opt_dvb_adapters },
@@ -655,7 +661,7 @@ main(int argc, char **argv)
     tvhlog_options &= ~TVHLOG_OPT_DECORATE;
   
   /* Initialise configuration */
-  hts_settings_init(opt_config);
+  hts_settings_init(opt_config, opt_snapshot);
 
   /* Setup global mutexes */
   pthread_mutex_init(&ffmpeg_lock, NULL);
@@ -676,8 +682,17 @@ main(int argc, char **argv)
    * Initialize subsystems
    */
 
+  tvh_crc32_init();
+
+  pkt_init();
+
+  parser_sc_init();
+
+  streaming_init();
+
 #if ENABLE_LIBAV
   libav_init();
+  transcoder_init(0);
 #endif
 
   config_init();
@@ -715,10 +730,12 @@ main(int argc, char **argv)
 
 #if ENABLE_CWC
   cwc_init();
+  cwc_set_ecm_parallel(config_get_descrambler_ecm_parallel());
   capmt_init();
 #if (!ENABLE_DVBCSA)
   ffdecsa_init();
 #endif
+  tvhcsa_init(config_get_descrambler_threads());
 #endif
 
   epggrab_init();
@@ -740,6 +757,8 @@ main(int argc, char **argv)
 
   epg_updated(); // cleanup now all prev ref's should have been created
 
+  hts_settings_startup_done();
+
   pthread_mutex_unlock(&global_lock);
 
   /**
@@ -775,6 +794,7 @@ main(int argc, char **argv)
   timeshift_term();
 #endif
   pthread_mutex_unlock(&global_lock);
+  epg_save_wait();
 
   tvhlog(LOG_NOTICE, "STOP", "Exiting HTS Tvheadend");
 
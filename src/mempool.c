@@ -0,0 +1,213 @@
+/*
+ *  tvheadend, per-thread object pools
+ *  Copyright (C) 2013
+ *
+ *  This program is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include <pthread.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "tvheadend.h"
+#include "atomic.h"
+#include "mempool.h"
+
+/* Max. bytes kept in a single batch and in the shared depot */
+#define MEMPOOL_BATCH_BYTES  (64 * 1024)
+#define MEMPOOL_DEPOT_BYTES  (4 * 1024 * 1024)
+
+/*
+ * Free objects are chained via their first word, the second word of
+ * the first object in a batch chains the batches in the depot
+ */
+#define MP_NEXT(p)  (((void **)(p))[0])
+#define MP_BATCH(p) (((void **)(p))[1])
+
+typedef struct mempool_cache {
+  mempool_t *mc_pool;
+  void      *mc_list;
+  int        mc_count;
+} mempool_cache_t;
+
+struct mempool {
+  TAILQ_ENTRY(mempool) mp_link;
+  const char     *mp_name;
+  size_t          mp_size;
+  int             mp_batch;
+  int             mp_depot_max;
+
+  pthread_key_t   mp_key;
+
+  pthread_mutex_t mp_mutex;
+  void           *mp_depot;
+  int             mp_depot_count;
+
+  int             mp_live;
+  int             mp_highwater;
+  int             mp_hits;
+  int             mp_misses;
+};
+
+static TAILQ_HEAD(, mempool) mempools = TAILQ_HEAD_INITIALIZER(mempools);
+
+/**
+ * Thread exit, hand the cached objects back to the system
+ */
+static void
+mempool_cache_destroy(void *aux)
+{
+  mempool_cache_t *mc = aux;
+  void *p;
+
+  while((p = mc->mc_list) != NULL) {
+    mc->mc_list = MP_NEXT(p);
+    free(p);
+  }
+  free(mc);
+}
+
+/**
+ *
+ */
+static inline mempool_cache_t *
+mempool_cache_get(mempool_t *mp)
+{
+  mempool_cache_t *mc = pthread_getspecific(mp->mp_key);
+
+  if(mc == NULL) {
+    mc = calloc(1, sizeof(mempool_cache_t));
+    mc->mc_pool = mp;
+    pthread_setspecific(mp->mp_key, mc);
+  }
+  return mc;
+}
+
+/**
+ *
+ */
+mempool_t *
+mempool_create(const char *name, size_t size)
+{
+  mempool_t *mp = calloc(1, sizeof(mempool_t));
+
+  if(size < 2 * sizeof(void *))
+    size = 2 * sizeof(void *);
+
+  mp->mp_name      = name;
+  mp->mp_size      = size;
+  mp->mp_batch     = MAX(4, MIN(32, MEMPOOL_BATCH_BYTES / size));
+  mp->mp_depot_max = MAX(1, MEMPOOL_DEPOT_BYTES / (mp->mp_batch * size));
+
+  pthread_mutex_init(&mp->mp_mutex, NULL);
+  pthread_key_create(&mp->mp_key, mempool_cache_destroy);
+
+  TAILQ_INSERT_TAIL(&mempools, mp, mp_link);
+  return mp;
+}
+
+/**
+ *
+ */
+void *
+mempool_alloc(mempool_t *mp)
+{
+  mempool_cache_t *mc = mempool_cache_get(mp);
+  void *p;
+  int live;
+
+  if(mc->mc_list == NULL && mp->mp_depot != NULL) {
+    pthread_mutex_lock(&mp->mp_mutex);
+    if((p = mp->mp_depot) != NULL) {
+      mp->mp_depot = MP_BATCH(p);
+      mp->mp_depot_count--;
+      mc->mc_list  = p;
+      mc->mc_count = mp->mp_batch;
+    }
+    pthread_mutex_unlock(&mp->mp_mutex);
+  }
+
+  if((p = mc->mc_list) != NULL) {
+    mc->mc_list = MP_NEXT(p);
+    mc->mc_count--;
+    atomic_add(&mp->mp_hits, 1);
+  } else {
+    p = malloc(mp->mp_size);
+    atomic_add(&mp->mp_misses, 1);
+  }
+
+  live = atomic_add(&mp->mp_live, 1) + 1;
+  if(live > mp->mp_highwater)
+    mp->mp_highwater = live;
+  return p;
+}
+
+/**
+ *
+ */
+void
+mempool_free(mempool_t *mp, void *ptr)
+{
+  mempool_cache_t *mc = mempool_cache_get(mp);
+  void *batch, *p;
+  int i;
+
+  atomic_add(&mp->mp_live, -1);
+
+  MP_NEXT(ptr) = mc->mc_list;
+  mc->mc_list  = ptr;
+  if(++mc->mc_count < 2 * mp->mp_batch)
+    return;
+
+  /* Move a batch to the depot, or back to the system if that is full */
+  batch = p = mc->mc_list;
+  for(i = 1; i < mp->mp_batch; i++)
+    p = MP_NEXT(p);
+  mc->mc_list   = MP_NEXT(p);
+  mc->mc_count -= mp->mp_batch;
+  MP_NEXT(p)    = NULL;
+
+  pthread_mutex_lock(&mp->mp_mutex);
+  if(mp->mp_depot_count < mp->mp_depot_max) {
+    MP_BATCH(batch) = mp->mp_depot;
+    mp->mp_depot    = batch;
+    mp->mp_depot_count++;
+    batch = NULL;
+  }
+  pthread_mutex_unlock(&mp->mp_mutex);
+
+  while((p = batch) != NULL) {
+    batch = MP_NEXT(p);
+    free(p);
+  }
+}
+
+/**
+ *
+ */
+void
+mempool_dump(htsbuf_queue_t *hq)
+{
+  mempool_t *mp;
+
+  htsbuf_qprintf(hq, "%-20s %8s %8s %10s %12s %12s %8s\n",
+                 "Pool", "Size", "Live", "High-water", "Hits", "Misses",
+                 "Depot");
+
+  TAILQ_FOREACH(mp, &mempools, mp_link)
+    htsbuf_qprintf(hq, "%-20s %8zu %8d %10d %12u %12u %8d\n",
+                   mp->mp_name, mp->mp_size, mp->mp_live, mp->mp_highwater,
+                   (unsigned int)mp->mp_hits, (unsigned int)mp->mp_misses,
+                   mp->mp_depot_count * mp->mp_batch);
+}
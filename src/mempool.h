@@ -0,0 +1,46 @@
+/*
+ *  tvheadend, per-thread object pools
+ *  Copyright (C) 2013
+ *
+ *  This program is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef __TVH_MEMPOOL_H__
+#define __TVH_MEMPOOL_H__
+
+#include "htsbuf.h"
+
+struct mempool;
+
+typedef struct mempool mempool_t;
+
+/**
+ * Create a pool of fixed size objects
+ *
+ * Each thread keeps a small cache of free objects, surplus objects are
+ * moved in batches to a shared depot where other threads pick them up.
+ * Must be called before any thread uses the pool.
+ */
+mempool_t *mempool_create ( const char *name, size_t size );
+
+void      *mempool_alloc  ( mempool_t *mp );
+
+void       mempool_free   ( mempool_t *mp, void *ptr );
+
+/**
+ * Dump counters of all pools (for statedump)
+ */
+void       mempool_dump   ( htsbuf_queue_t *hq );
+
+#endif /* __TVH_MEMPOOL_H__ */
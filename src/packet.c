@@ -21,6 +21,44 @@
 #include "packet.h"
 #include "string.h"
 #include "atomic.h"
+#include "mempool.h"
+
+/*
+ * Object pools, payloads are rounded up to the next size class.
+ * Larger payloads are plain malloc()s
+ */
+static const size_t pktbuf_classes[] = { 256, 1024, 4096, 20480, 65536 };
+#define PKTBUF_NCLASSES (sizeof(pktbuf_classes) / sizeof(pktbuf_classes[0]))
+
+static mempool_t *pkt_pool;
+static mempool_t *pktref_pool;
+static mempool_t *pktbuf_pool;
+static mempool_t *pktbuf_data_pool[PKTBUF_NCLASSES];
+
+static pthread_mutex_t pktbuf_derive_lock = PTHREAD_MUTEX_INITIALIZER;
+static int pktbuf_derive_made[PKTBUF_NDERIVED];
+static int pktbuf_derive_shared[PKTBUF_NDERIVED];
+static const char *pktbuf_derive_names[PKTBUF_NDERIVED] = {
+  "AVCC conversion", "Header merge"
+};
+
+/**
+ *
+ */
+void
+pkt_init(void)
+{
+  static char names[PKTBUF_NCLASSES][32];
+  int i;
+
+  pkt_pool    = mempool_create("th_pkt_t", sizeof(th_pkt_t));
+  pktref_pool = mempool_create("th_pktref_t", sizeof(th_pktref_t));
+  pktbuf_pool = mempool_create("pktbuf_t", sizeof(pktbuf_t));
+  for(i = 0; i < PKTBUF_NCLASSES; i++) {
+    snprintf(names[i], sizeof(names[i]), "pktbuf data %zu", pktbuf_classes[i]);
+    pktbuf_data_pool[i] = mempool_create(names[i], pktbuf_classes[i]);
+  }
+}
 
 /*
  *
@@ -33,7 +71,7 @@ pkt_destroy(th_pkt_t *pkt)
 
   if(pkt->pkt_header != NULL)
     pktbuf_ref_dec(pkt->pkt_header);
-  free(pkt);
+  mempool_free(pkt_pool, pkt);
 }
 
 
@@ -46,7 +84,8 @@ pkt_alloc(const void *data, size_t datalen, int64_t pts, int64_t dts)
 {
   th_pkt_t *pkt;
 
-  pkt = calloc(1, sizeof(th_pkt_t));
+  pkt = mempool_alloc(pkt_pool);
+  memset(pkt, 0, sizeof(th_pkt_t));
   if(datalen)
     pkt->pkt_payload = pktbuf_alloc(data, datalen);
   pkt->pkt_dts = dts;
@@ -96,7 +135,7 @@ pktref_clear_queue(struct th_pktref_queue *q)
   while((pr = TAILQ_FIRST(q)) != NULL) {
     TAILQ_REMOVE(q, pr, pr_link);
     pkt_ref_dec(pr->pr_pkt);
-    free(pr);
+    mempool_free(pktref_pool, pr);
   }
 }
 
@@ -107,7 +146,7 @@ pktref_clear_queue(struct th_pktref_queue *q)
 void
 pktref_enqueue(struct th_pktref_queue *q, th_pkt_t *pkt)
 {
-  th_pktref_t *pr = malloc(sizeof(th_pktref_t));
+  th_pktref_t *pr = mempool_alloc(pktref_pool);
   pr->pr_pkt = pkt;
   TAILQ_INSERT_TAIL(q, pr, pr_link);
 }
@@ -121,10 +160,23 @@ pktref_remove(struct th_pktref_queue *q, th_pktref_t *pr)
 {
   TAILQ_REMOVE(q, pr, pr_link);
   pkt_ref_dec(pr->pr_pkt);
-  free(pr);
+  mempool_free(pktref_pool, pr);
 }
 
 
+/**
+ *
+ */
+static pktbuf_t *
+pkt_merge_buf(const pktbuf_t *pb, const pktbuf_t *hdr)
+{
+  pktbuf_t *n = pktbuf_alloc(NULL, pktbuf_len(hdr) + pktbuf_len(pb));
+
+  memcpy(pktbuf_ptr(n), pktbuf_ptr(hdr), pktbuf_len(hdr));
+  memcpy(pktbuf_ptr(n) + pktbuf_len(hdr), pktbuf_ptr(pb), pktbuf_len(pb));
+  return n;
+}
+
 /**
  *
  */
@@ -132,27 +184,17 @@ th_pkt_t *
 pkt_merge_header(th_pkt_t *pkt)
 {
   th_pkt_t *n;
-  size_t s;
 
   if(pkt->pkt_header == NULL)
     return pkt;
 
-  n = malloc(sizeof(th_pkt_t));
+  n = mempool_alloc(pkt_pool);
   *n = *pkt;
 
   n->pkt_refcount = 1;
   n->pkt_header = NULL;
-
-  s = pktbuf_len(pkt->pkt_payload) + pktbuf_len(pkt->pkt_header);
-  n->pkt_payload = pktbuf_alloc(NULL, s);
-
-  memcpy(pktbuf_ptr(n->pkt_payload),
-	 pktbuf_ptr(pkt->pkt_header),
-	 pktbuf_len(pkt->pkt_header));
-
-  memcpy(pktbuf_ptr(n->pkt_payload) + pktbuf_len(pkt->pkt_header),
-	 pktbuf_ptr(pkt->pkt_payload),
-	 pktbuf_len(pkt->pkt_payload));
+  n->pkt_payload = pktbuf_derive(pkt->pkt_payload, pkt->pkt_header,
+                                 PKTBUF_MERGED, pkt_merge_buf);
 
   pkt_ref_dec(pkt);
   return n;
@@ -166,7 +208,7 @@ pkt_merge_header(th_pkt_t *pkt)
 th_pkt_t *
 pkt_copy_shallow(th_pkt_t *pkt)
 {
-  th_pkt_t *n = malloc(sizeof(th_pkt_t));
+  th_pkt_t *n = mempool_alloc(pkt_pool);
   *n = *pkt;
 
   n->pkt_refcount = 1;
@@ -187,19 +229,40 @@ pkt_copy_shallow(th_pkt_t *pkt)
 th_pktref_t *
 pktref_create(th_pkt_t *pkt)
 {
-  th_pktref_t *pr = malloc(sizeof(th_pktref_t));
+  th_pktref_t *pr = mempool_alloc(pktref_pool);
   pr->pr_pkt = pkt;
   return pr;
 }
 
 
+/**
+ * Free the reference only, the packet reference is kept by the caller
+ */
+void
+pktref_free(th_pktref_t *pr)
+{
+  mempool_free(pktref_pool, pr);
+}
+
+
 
 void 
 pktbuf_ref_dec(pktbuf_t *pb)
 {
+  int i;
+
   if((atomic_add(&pb->pb_refcount, -1)) == 1) {
-    free(pb->pb_data);
-    free(pb);
+    for(i = 0; i < PKTBUF_NDERIVED; i++) {
+      if(pb->pb_derived[i] != NULL)
+        pktbuf_ref_dec(pb->pb_derived[i]);
+      if(pb->pb_derived_hdr[i] != NULL)
+        pktbuf_ref_dec(pb->pb_derived_hdr[i]);
+    }
+    if(pb->pb_pool >= 0)
+      mempool_free(pktbuf_data_pool[pb->pb_pool], pb->pb_data);
+    else
+      free(pb->pb_data);
+    mempool_free(pktbuf_pool, pb);
   }
 }
 
@@ -212,12 +275,26 @@ pktbuf_ref_inc(pktbuf_t *pb)
 pktbuf_t *
 pktbuf_alloc(const void *data, size_t size)
 {
-  pktbuf_t *pb = malloc(sizeof(pktbuf_t));
+  pktbuf_t *pb = mempool_alloc(pktbuf_pool);
+  int i;
+
   pb->pb_refcount = 1;
   pb->pb_size = size;
+  pb->pb_data = NULL;
+  pb->pb_pool = -1;
+  memset(pb->pb_derived, 0, sizeof(pb->pb_derived));
+  memset(pb->pb_derived_hdr, 0, sizeof(pb->pb_derived_hdr));
 
   if(size > 0) {
-    pb->pb_data = malloc(size);
+    for(i = 0; i < PKTBUF_NCLASSES; i++)
+      if(size <= pktbuf_classes[i])
+        break;
+    if(i < PKTBUF_NCLASSES) {
+      pb->pb_data = mempool_alloc(pktbuf_data_pool[i]);
+      pb->pb_pool = i;
+    } else {
+      pb->pb_data = malloc(size);
+    }
     if(data != NULL)
       memcpy(pb->pb_data, data, size);
   }
@@ -227,9 +304,60 @@ pktbuf_alloc(const void *data, size_t size)
 pktbuf_t *
 pktbuf_make(void *data, size_t size)
 {
-  pktbuf_t *pb = malloc(sizeof(pktbuf_t));
+  pktbuf_t *pb = mempool_alloc(pktbuf_pool);
   pb->pb_refcount = 1;
   pb->pb_size = size;
   pb->pb_data = data;
+  pb->pb_pool = -1;
+  memset(pb->pb_derived, 0, sizeof(pb->pb_derived));
+  memset(pb->pb_derived_hdr, 0, sizeof(pb->pb_derived_hdr));
   return pb;
 }
+
+/**
+ * The conversion itself runs unlocked, if two threads race the
+ * result of the first one is kept in the cache
+ */
+pktbuf_t *
+pktbuf_derive(pktbuf_t *pb, pktbuf_t *hdr, int form, pktbuf_derive_cb_t *cb)
+{
+  pktbuf_t *d;
+
+  pthread_mutex_lock(&pktbuf_derive_lock);
+  if((d = pb->pb_derived[form]) != NULL && pb->pb_derived_hdr[form] == hdr) {
+    pktbuf_ref_inc(d);
+    pthread_mutex_unlock(&pktbuf_derive_lock);
+    atomic_add(&pktbuf_derive_shared[form], 1);
+    return d;
+  }
+  pthread_mutex_unlock(&pktbuf_derive_lock);
+
+  d = cb(pb, hdr);
+  atomic_add(&pktbuf_derive_made[form], 1);
+
+  pthread_mutex_lock(&pktbuf_derive_lock);
+  if(pb->pb_derived[form] == NULL) {
+    pb->pb_derived[form] = d;
+    pktbuf_ref_inc(d);
+    /* Keep the header referenced so its address stays a valid key */
+    if((pb->pb_derived_hdr[form] = hdr) != NULL)
+      pktbuf_ref_inc(hdr);
+  }
+  pthread_mutex_unlock(&pktbuf_derive_lock);
+  return d;
+}
+
+/**
+ *
+ */
+void
+pkt_dump(htsbuf_queue_t *hq)
+{
+  int i;
+
+  htsbuf_qprintf(hq, "%-20s %12s %12s\n", "Form", "Computed", "Shared");
+  for(i = 0; i < PKTBUF_NDERIVED; i++)
+    htsbuf_qprintf(hq, "%-20s %12u %12u\n", pktbuf_derive_names[i],
+                   (unsigned int)pktbuf_derive_made[i],
+                   (unsigned int)pktbuf_derive_shared[i]);
+}
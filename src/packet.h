@@ -19,13 +19,30 @@
 #ifndef PACKET_H_
 #define PACKET_H_
 
+#include "htsbuf.h"
+
+/**
+ * Derived forms of a buffer, computed once and shared between all
+ * packets referring to the buffer
+ */
+#define PKTBUF_AVCC     0 // H264 Annex-B to AVCC (avcC record for headers)
+#define PKTBUF_MERGED   1 // Packet header prepended to the payload
+#define PKTBUF_NDERIVED 2
 
 typedef struct pktbuf {
   int pb_refcount;
   uint8_t *pb_data;
   size_t pb_size;
+  int pb_pool;     // Payload size class, -1 if malloc()ed
+
+  /* Protected via the derive lock in packet.c */
+  struct pktbuf *pb_derived[PKTBUF_NDERIVED];
+  struct pktbuf *pb_derived_hdr[PKTBUF_NDERIVED]; // Header used to derive
 } pktbuf_t;
 
+typedef pktbuf_t *(pktbuf_derive_cb_t)(const pktbuf_t *pb,
+                                       const pktbuf_t *hdr);
+
 
 
 /**
@@ -80,6 +97,8 @@ typedef struct th_pktref {
 /**
  *
  */
+void pkt_init(void);
+
 void pkt_ref_dec(th_pkt_t *pkt);
 
 void pkt_ref_inc(th_pkt_t *pkt);
@@ -102,6 +121,8 @@ th_pkt_t *pkt_copy_shallow(th_pkt_t *pkt);
 
 th_pktref_t *pktref_create(th_pkt_t *pkt);
 
+void pktref_free(th_pktref_t *pr);
+
 void pktbuf_ref_dec(pktbuf_t *pb);
 
 void pktbuf_ref_inc(pktbuf_t *pb);
@@ -110,6 +131,15 @@ pktbuf_t *pktbuf_alloc(const void *data, size_t size);
 
 pktbuf_t *pktbuf_make(void *data, size_t size);
 
+/**
+ * Return (a new reference to) the given form of pb, derived with hdr.
+ * The result is cached on pb so other packets sharing the buffer reuse it
+ */
+pktbuf_t *pktbuf_derive(pktbuf_t *pb, pktbuf_t *hdr, int form,
+                        pktbuf_derive_cb_t *cb);
+
+void pkt_dump(htsbuf_queue_t *hq);
+
 #define pktbuf_len(pb) ((pb)->pb_size)
 #define pktbuf_ptr(pb) ((pb)->pb_data)
 
@@ -0,0 +1,72 @@
+/*
+ *  Start code scanning
+ *  Copyright (C) 2013
+ *
+ *  This program is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "tvheadend.h"
+#include "parser_sc.h"
+
+int (*parser_sc_scan)(const uint8_t *data, int len) = parser_sc_scan_c;
+
+/**
+ * Plain C version, also used for the tail of the vector versions
+ */
+int
+parser_sc_scan_c(const uint8_t *data, int len)
+{
+  int i = 3;
+
+  while(i < len) {
+    /* data[i-1] must be 01 and data[i-3], data[i-2] zero, anything
+       but a zero at data[i-1] rules out the next two positions too */
+    if(data[i-1] == 0)
+      i++;
+    else if(data[i-1] > 1 || data[i-2] || data[i-3])
+      i += 3;
+    else
+      return i;
+  }
+  return len;
+}
+
+/**
+ *
+ */
+void
+parser_sc_init(void)
+{
+#if defined(__i386__) || defined(__x86_64__)
+  __builtin_cpu_init();
+
+#ifdef CONFIG_AVX2
+  if(__builtin_cpu_supports("avx2")) {
+    parser_sc_scan = parser_sc_scan_avx2;
+    tvhlog(LOG_INFO, "parser", "Using AVX2 start code scanner");
+    return;
+  }
+#endif
+
+#ifdef CONFIG_SSE2
+  if(__builtin_cpu_supports("sse2")) {
+    parser_sc_scan = parser_sc_scan_sse2;
+    tvhlog(LOG_INFO, "parser", "Using SSE2 start code scanner");
+    return;
+  }
+#endif
+#endif
+
+  tvhlog(LOG_INFO, "parser", "Using plain C start code scanner");
+}
@@ -0,0 +1,55 @@
+/*
+ *  Start code scanning
+ *  Copyright (C) 2013
+ *
+ *  This program is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef PARSER_SC_H_
+#define PARSER_SC_H_
+
+#include <stdint.h>
+
+/**
+ * Pick the fastest scanner for this CPU
+ */
+void parser_sc_init(void);
+
+/**
+ * Index of the first byte (>= 3) preceded by 00 00 01, len if none
+ */
+extern int (*parser_sc_scan)(const uint8_t *data, int len);
+
+int parser_sc_scan_c(const uint8_t *data, int len);
+int parser_sc_scan_sse2(const uint8_t *data, int len);
+int parser_sc_scan_avx2(const uint8_t *data, int len);
+
+/**
+ * Index of the byte completing the next 0x000001xx start code, len if
+ * there is none. sc holds the previously scanned bytes.
+ */
+static inline int
+parser_sc_find(uint32_t sc, const uint8_t *data, int len)
+{
+  int i;
+
+  for(i = 0; i < len && i < 3; i++) {
+    sc = sc << 8 | data[i];
+    if((sc & 0xffffff00) == 0x00000100)
+      return i;
+  }
+  return len > 3 ? parser_sc_scan(data, len) : len;
+}
+
+#endif /* PARSER_SC_H_ */
@@ -0,0 +1,43 @@
+/*
+ *  Start code scanning, SSE2 version
+ *  Copyright (C) 2013
+ *
+ *  This program is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include <emmintrin.h>
+
+#include "parser_sc.h"
+
+/**
+ * 16 candidate positions per round, each needs 00 00 01 in front
+ */
+int
+parser_sc_scan_sse2(const uint8_t *data, int len)
+{
+  const __m128i zero = _mm_setzero_si128();
+  const __m128i one  = _mm_set1_epi8(1);
+  __m128i a, b, c;
+  int i, m;
+
+  for(i = 0; i + 19 <= len; i += 16) {
+    a = _mm_cmpeq_epi8(_mm_loadu_si128((const __m128i *)(data + i)), zero);
+    b = _mm_cmpeq_epi8(_mm_loadu_si128((const __m128i *)(data + i + 1)), zero);
+    c = _mm_cmpeq_epi8(_mm_loadu_si128((const __m128i *)(data + i + 2)), one);
+    m = _mm_movemask_epi8(_mm_and_si128(_mm_and_si128(a, b), c));
+    if(m)
+      return i + __builtin_ctz(m) + 3;
+  }
+  return i + parser_sc_scan_c(data + i, len - i);
+}
@@ -30,6 +30,7 @@
 #include "parsers.h"
 #include "parser_h264.h"
 #include "parser_latm.h"
+#include "parser_sc.h"
 #include "bitstream.h"
 #include "packet.h"
 #include "streaming.h"
@@ -289,7 +290,7 @@ parse_sc(service_t *t, elementary_stream_t *st, const uint8_t *data, int len,
 	 packet_parser_t *vp)
 {
   uint32_t sc = st->es_startcond;
-  int i, r;
+  int i, j, n, r;
   sbuf_alloc(&st->es_buf, len);
 
   for(i = 0; i < len; i++) {
@@ -321,6 +322,18 @@ parse_sc(service_t *t, elementary_stream_t *st, const uint8_t *data, int len,
       continue;
     }
 
+    /* Copy everything up to the byte completing a start code in one go */
+    n = parser_sc_find(sc, data + i, len - i);
+    if(n > 0) {
+      memcpy(st->es_buf.sb_data + st->es_buf.sb_ptr, data + i, n);
+      st->es_buf.sb_ptr += n;
+      for(j = n > 4 ? n - 4 : 0; j < n; j++)
+	sc = sc << 8 | data[i + j];
+      i += n;
+      if(i == len)
+	break;
+    }
+
     st->es_buf.sb_data[st->es_buf.sb_ptr++] = data[i];
     sc = sc << 8 | data[i];
 
@@ -1410,6 +1423,9 @@ parser_deliver(service_t *t, elementary_stream_t *st, th_pkt_t *pkt, int error)
   /* Forward packet */
   pkt->pkt_componentindex = st->es_index;
 
+  if(t->s_gop_max)
+    service_gop_add(t, st, pkt);
+
   streaming_message_t *sm = streaming_msg_create_pkt(pkt);
 
   streaming_pad_deliver(&t->s_streaming_pad, sm);
@@ -206,7 +206,8 @@ gh_hold(globalheaders_t *gh, streaming_message_t *sm)
     assert(ssc != NULL);
 
     if(ssc->ssc_type == SCT_TELETEXT) {
-      free(sm);
+      sm->sm_data = NULL;
+      streaming_msg_free(sm);
       ssc->ssc_disabled = 1;
       break;
     }
@@ -218,7 +219,8 @@ gh_hold(globalheaders_t *gh, streaming_message_t *sm)
     pr = pktref_create(pkt);
     TAILQ_INSERT_TAIL(&gh->gh_holdq, pr, pr_link);
 
-    free(sm);
+    sm->sm_data = NULL;
+    streaming_msg_free(sm);
 
     if(!headers_complete(gh, gh_queue_delay(gh))) 
       break;
@@ -234,7 +236,7 @@ gh_hold(globalheaders_t *gh, streaming_message_t *sm)
       sm = streaming_msg_create_pkt(pr->pr_pkt);
       streaming_target_deliver2(gh->gh_output, sm);
       pkt_ref_dec(pr->pr_pkt);
-      free(pr);
+      pktref_free(pr);
     }
     gh->gh_passthru = 1;
     break;
@@ -29,6 +29,9 @@
 #include "transcoding.h"
 #include "libav.h"
 
+/* Max. number of messages waiting per transcoder */
+#define TRANSCODER_MAX_QUEUE 256
+
 LIST_HEAD(transcoder_stream_list, transcoder_stream);
 
 typedef struct transcoder_stream {
@@ -96,14 +99,51 @@ typedef struct subtitle_stream {
 
 
 
+typedef struct transcoder_msg {
+  TAILQ_ENTRY(transcoder_msg) tm_link;
+  streaming_message_t        *tm_sm;
+  int64_t                     tm_time;   // when queued
+  int                         tm_video;
+} transcoder_msg_t;
+
+TAILQ_HEAD(transcoder_msg_queue, transcoder_msg);
+
+
 typedef struct transcoder {
   streaming_target_t  t_input;  // must be first
   streaming_target_t *t_output;
 
+  /* Worker side, only touched by the worker owning the transcoder */
   transcoder_props_t            t_props;
   struct transcoder_stream_list t_stream_list;
+
+  /* Input side, only touched by the streaming thread feeding us */
+  int                           t_video_index;
+  loglimiter_t                  t_loglimit;
+
+  /* Protected via transcoder_mutex */
+  struct transcoder_msg_queue   t_queue;
+  int                           t_queue_len;
+  int                           t_drop_video;  // until the next I-frame
+  TAILQ_ENTRY(transcoder)       t_ready_link;
+  int                           t_ready;
+  int                           t_busy;
+  int                           t_dead;
+
+  /* Statistics, protected via transcoder_mutex */
+  uint32_t                      t_frames;
+  int64_t                       t_frames_time;
+  int64_t                       t_latency;     // average, in us
+  uint32_t                      t_drops;
 } transcoder_t;
 
+TAILQ_HEAD(transcoder_queue, transcoder);
+
+static pthread_mutex_t         transcoder_mutex;
+static pthread_cond_t          transcoder_cond;
+static pthread_cond_t          transcoder_idle_cond;
+static struct transcoder_queue transcoder_ready;
+
 
 
 #define WORKING_ENCODER(x) (x == CODEC_ID_H264 || x == CODEC_ID_MPEG2VIDEO || \
@@ -1211,22 +1251,17 @@ transcoder_stop(transcoder_t *t)
 
 
 /**
- * 
+ * Runs on a worker thread
  */
 static void
-transcoder_input(void *opaque, streaming_message_t *sm)
+transcoder_handle(transcoder_t *t, streaming_message_t *sm)
 {
-  transcoder_t *t;
   streaming_start_t *ss;
-  th_pkt_t *pkt;
-
-  t = opaque;
 
   switch (sm->sm_type) {
   case SMT_PACKET:
-    pkt = sm->sm_data;
-    transcoder_packet(t, pkt);
-    pkt_ref_dec(pkt);
+    transcoder_packet(t, sm->sm_data);
+    streaming_msg_free(sm);
     break;
 
   case SMT_START:
@@ -1255,6 +1290,166 @@ transcoder_input(void *opaque, streaming_message_t *sm)
 }
 
 
+/**
+ * Worker thread
+ */
+static void *
+transcoder_thread(void *aux)
+{
+  transcoder_t *t;
+  transcoder_msg_t *tm;
+  int64_t now;
+
+  pthread_mutex_lock(&transcoder_mutex);
+  while(1) {
+
+    if((t = TAILQ_FIRST(&transcoder_ready)) == NULL) {
+      pthread_cond_wait(&transcoder_cond, &transcoder_mutex);
+      continue;
+    }
+
+    TAILQ_REMOVE(&transcoder_ready, t, t_ready_link);
+    t->t_ready = 0;
+    t->t_busy  = 1;
+
+    tm = TAILQ_FIRST(&t->t_queue);
+    TAILQ_REMOVE(&t->t_queue, tm, tm_link);
+    t->t_queue_len--;
+    pthread_mutex_unlock(&transcoder_mutex);
+
+    transcoder_handle(t, tm->tm_sm);
+    now = getmonoclock();
+
+    pthread_mutex_lock(&transcoder_mutex);
+    t->t_latency = (t->t_latency * 7 + (now - tm->tm_time)) / 8;
+    if(tm->tm_video)
+      t->t_frames++;
+    free(tm);
+
+    t->t_busy = 0;
+    if(t->t_dead) {
+      pthread_cond_broadcast(&transcoder_idle_cond);
+      continue;
+    }
+    if(TAILQ_FIRST(&t->t_queue) != NULL) {
+      TAILQ_INSERT_TAIL(&transcoder_ready, t, t_ready_link);
+      t->t_ready = 1;
+    }
+  }
+  return NULL;
+}
+
+
+/**
+ * The video stream index, -1 if none
+ */
+static int
+transcoder_video_index(streaming_start_t *ss)
+{
+  int i;
+
+  for (i = 0; i < ss->ss_num_components; i++)
+    if (SCT_ISVIDEO(ss->ss_components[i].ssc_type))
+      return ss->ss_components[i].ssc_index;
+
+  return -1;
+}
+
+
+/**
+ * Drop policy when the workers can't keep up, transcoder_mutex must be held
+ *
+ * Once the queue is full video is dropped up to the next I-frame, so the
+ * decoder resumes on a clean picture. Other packets are only dropped while
+ * the queue is full, control messages are never dropped.
+ */
+static int
+transcoder_drop(transcoder_t *t, th_pkt_t *pkt, int video)
+{
+  if (!video)
+    return t->t_queue_len >= TRANSCODER_MAX_QUEUE;
+
+  if (t->t_queue_len >= TRANSCODER_MAX_QUEUE)
+    t->t_drop_video = 1;
+  else if (t->t_drop_video && pkt->pkt_frametype == PKT_I_FRAME &&
+	   t->t_queue_len < TRANSCODER_MAX_QUEUE / 2)
+    t->t_drop_video = 0;
+
+  return t->t_drop_video;
+}
+
+
+/**
+ * Queue a message for the worker pool
+ */
+static void
+transcoder_input(void *opaque, streaming_message_t *sm)
+{
+  transcoder_t *t = opaque;
+  transcoder_msg_t *tm;
+  th_pkt_t *pkt = NULL;
+  int video = 0;
+
+  if (sm->sm_type == SMT_START) {
+    t->t_video_index = transcoder_video_index(sm->sm_data);
+  } else if (sm->sm_type == SMT_PACKET) {
+    pkt = sm->sm_data;
+    video = pkt->pkt_componentindex == t->t_video_index;
+  }
+
+  pthread_mutex_lock(&transcoder_mutex);
+  if (pkt && transcoder_drop(t, pkt, video)) {
+    t->t_drops++;
+    pthread_mutex_unlock(&transcoder_mutex);
+    streaming_msg_free(sm);
+    limitedlog(&t->t_loglimit, "transcode", "Transcoder",
+	       "Queue overflow, dropping packets");
+    return;
+  }
+
+  tm = malloc(sizeof(transcoder_msg_t));
+  tm->tm_sm    = sm;
+  tm->tm_time  = getmonoclock();
+  tm->tm_video = video;
+  TAILQ_INSERT_TAIL(&t->t_queue, tm, tm_link);
+  t->t_queue_len++;
+
+  if (!t->t_ready && !t->t_busy) {
+    TAILQ_INSERT_TAIL(&transcoder_ready, t, t_ready_link);
+    t->t_ready = 1;
+    pthread_cond_signal(&transcoder_cond);
+  }
+  pthread_mutex_unlock(&transcoder_mutex);
+}
+
+
+/**
+ * Start the transcoder worker threads (0 = one per CPU)
+ */
+void
+transcoder_init(int threads)
+{
+  pthread_t ptid;
+  int i;
+
+  pthread_mutex_init(&transcoder_mutex, NULL);
+  pthread_cond_init(&transcoder_cond, NULL);
+  pthread_cond_init(&transcoder_idle_cond, NULL);
+  TAILQ_INIT(&transcoder_ready);
+
+  if (threads <= 0)
+    threads = sysconf(_SC_NPROCESSORS_ONLN);
+  if (threads <= 0)
+    threads = 1;
+
+  for (i = 0; i < threads; i++)
+    pthread_create(&ptid, NULL, transcoder_thread, NULL);
+
+  tvhlog(LOG_INFO, "transcode", "Using %d transcoder thread%s",
+	 threads, threads == 1 ? "" : "s");
+}
+
+
 /**
  *
  */
@@ -1264,6 +1459,8 @@ transcoder_create(streaming_target_t *output)
   transcoder_t *t = calloc(1, sizeof(transcoder_t));
 
   t->t_output = output;
+  t->t_video_index = -1;
+  TAILQ_INIT(&t->t_queue);
 
   streaming_target_init(&t->t_input, transcoder_input, t, 0);
 
@@ -1299,12 +1496,54 @@ void
 transcoder_destroy(streaming_target_t *st)
 {
   transcoder_t *t = (transcoder_t *)st;
+  transcoder_msg_t *tm;
+
+  pthread_mutex_lock(&transcoder_mutex);
+  while ((tm = TAILQ_FIRST(&t->t_queue)) != NULL) {
+    TAILQ_REMOVE(&t->t_queue, tm, tm_link);
+    streaming_msg_free(tm->tm_sm);
+    free(tm);
+  }
+  t->t_queue_len = 0;
+  if (t->t_ready) {
+    TAILQ_REMOVE(&transcoder_ready, t, t_ready_link);
+    t->t_ready = 0;
+  }
+  t->t_dead = 1;
+
+  /* The output may go away once we return, wait for the worker */
+  while (t->t_busy)
+    pthread_cond_wait(&transcoder_idle_cond, &transcoder_mutex);
+  pthread_mutex_unlock(&transcoder_mutex);
 
   transcoder_stop(t);
   free(t);
 }
 
 
+/**
+ * 
+ */
+void
+transcoder_get_stats(streaming_target_t *st, htsmsg_t *m)
+{
+  transcoder_t *t = (transcoder_t *)st;
+  int64_t now = getmonoclock();
+  uint32_t fps = 0;
+
+  pthread_mutex_lock(&transcoder_mutex);
+  if (t->t_frames_time && now > t->t_frames_time)
+    fps = (t->t_frames * 1000000LL) / (now - t->t_frames_time);
+  t->t_frames      = 0;
+  t->t_frames_time = now;
+
+  htsmsg_add_u32(m, "tc_fps",     fps);
+  htsmsg_add_u32(m, "tc_latency", t->t_latency / 1000);
+  htsmsg_add_u32(m, "tc_drops",   t->t_drops);
+  pthread_mutex_unlock(&transcoder_mutex);
+}
+
+
 /**
  * 
  */ 
@@ -19,6 +19,9 @@
 
 #include "tvheadend.h"
 #include "htsmsg.h"
+#include "htsbuf.h"
+
+struct channel;
 
 typedef struct transcoder_prop {
   streaming_component_type_t tp_vcodec;
@@ -33,10 +36,49 @@ typedef struct transcoder_prop {
 
 extern uint32_t transcoding_enabled;
 
+/**
+ * Start the transcoder worker threads (0 = one per CPU)
+ *
+ * Messages are queued on the streaming thread and processed on the pool.
+ * A transcoder is only ever owned by one worker at a time, so its output
+ * stays in order.
+ */
+void transcoder_init(int threads);
+
 streaming_target_t *transcoder_create (streaming_target_t *output);
+
+/**
+ * Waits for a running worker, the output may be destroyed afterwards
+ */
 void                transcoder_destroy(streaming_target_t *tr);
 
+/**
+ * Add fps, latency (ms) and drops (for the status page)
+ */
+void transcoder_get_stats(streaming_target_t *tr, htsmsg_t *m);
+
 void transcoder_get_capabilities(htsmsg_t *array);
 void transcoder_set_properties  (streaming_target_t *tr, 
 				 transcoder_props_t *prop);
 
+/**
+ * Shared transcoding sessions, global_lock must be held
+ *
+ * Clients asking for the same channel with identical properties share one
+ * subscription and transcoder, its output is fanned out to all of them.
+ */
+typedef struct transcoder_client transcoder_client_t;
+
+transcoder_client_t *transcoder_session_attach(struct channel *ch,
+					       transcoder_props_t *props,
+					       int weight,
+					       streaming_target_t *output,
+					       const char *hostname,
+					       const char *username,
+					       const char *client);
+void transcoder_session_detach(transcoder_client_t *tc);
+
+/**
+ * Dump active sessions and attached clients (for statedump)
+ */
+void transcoder_session_dump(htsbuf_queue_t *hq);
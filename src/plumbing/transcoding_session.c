@@ -0,0 +1,236 @@
+/**
+ *  Shared transcoding sessions
+ *  Copyright (C) 2013
+ *
+ *  This program is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include <pthread.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "tvheadend.h"
+#include "streaming.h"
+#include "channels.h"
+#include "subscriptions.h"
+#include "transcoding.h"
+#include "tsfix.h"
+
+LIST_HEAD(transcoder_session_list, transcoder_session);
+
+typedef struct transcoder_session {
+  LIST_ENTRY(transcoder_session) tss_link;
+  transcoder_props_t   tss_props;
+  int                  tss_clients;
+
+  th_subscription_t   *tss_s;
+  streaming_target_t  *tss_tsfix;
+  streaming_target_t  *tss_transcoder;
+  streaming_target_t   tss_input;      // transcoder output
+
+  /* Protected via tss_mutex, delivered from a transcoder worker */
+  pthread_mutex_t      tss_mutex;
+  streaming_pad_t      tss_pad;
+  streaming_message_t *tss_start;      // replayed to late joiners
+} transcoder_session_t;
+
+struct transcoder_client {
+  transcoder_session_t *tsc_session;
+  streaming_target_t   *tsc_tsfix;     // rebases timestamps per client
+};
+
+/* Protected via global_lock */
+static struct transcoder_session_list transcoder_sessions;
+
+/**
+ *
+ */
+static int
+transcoder_props_equal(const transcoder_props_t *a, const transcoder_props_t *b)
+{
+  return a->tp_vcodec     == b->tp_vcodec &&
+         a->tp_acodec     == b->tp_acodec &&
+         a->tp_scodec     == b->tp_scodec &&
+         a->tp_channels   == b->tp_channels &&
+         a->tp_bandwidth  == b->tp_bandwidth &&
+         a->tp_resolution == b->tp_resolution &&
+         !strncmp(a->tp_language, b->tp_language, sizeof(a->tp_language));
+}
+
+/**
+ * Transcoder output, fanned out to all clients
+ */
+static void
+transcoder_session_input(void *opaque, streaming_message_t *sm)
+{
+  transcoder_session_t *tss = opaque;
+
+  pthread_mutex_lock(&tss->tss_mutex);
+  if(sm->sm_type == SMT_START) {
+    if(tss->tss_start)
+      streaming_msg_free(tss->tss_start);
+    tss->tss_start = streaming_msg_clone(sm);
+  } else if(sm->sm_type == SMT_STOP && tss->tss_start) {
+    streaming_msg_free(tss->tss_start);
+    tss->tss_start = NULL;
+  }
+  streaming_pad_deliver(&tss->tss_pad, sm);
+  pthread_mutex_unlock(&tss->tss_mutex);
+
+  streaming_msg_free(sm);
+}
+
+/**
+ *
+ */
+static transcoder_session_t *
+transcoder_session_create(channel_t *ch, transcoder_props_t *props,
+                          int weight, const char *hostname,
+                          const char *username, const char *client)
+{
+  transcoder_session_t *tss = calloc(1, sizeof(transcoder_session_t));
+
+  pthread_mutex_init(&tss->tss_mutex, NULL);
+  streaming_pad_init(&tss->tss_pad);
+  streaming_target_init(&tss->tss_input, transcoder_session_input, tss, 0);
+  tss->tss_props = *props;
+
+  tss->tss_transcoder = transcoder_create(&tss->tss_input);
+  transcoder_set_properties(tss->tss_transcoder, props);
+  tss->tss_tsfix = tsfix_create(tss->tss_transcoder);
+
+  tss->tss_s = subscription_create_from_channel(ch, weight, "HTTP transcode",
+                                                tss->tss_tsfix, 0, hostname,
+                                                username, client);
+  if(tss->tss_s == NULL) {
+    transcoder_destroy(tss->tss_transcoder);
+    tsfix_destroy(tss->tss_tsfix);
+    free(tss);
+    return NULL;
+  }
+  tss->tss_s->ths_transcoder = tss->tss_transcoder;
+
+  LIST_INSERT_HEAD(&transcoder_sessions, tss, tss_link);
+  return tss;
+}
+
+/**
+ *
+ */
+static void
+transcoder_session_destroy(transcoder_session_t *tss)
+{
+  LIST_REMOVE(tss, tss_link);
+  subscription_unsubscribe(tss->tss_s);
+  transcoder_destroy(tss->tss_transcoder);
+  tsfix_destroy(tss->tss_tsfix);
+
+  if(tss->tss_start)
+    streaming_msg_free(tss->tss_start);
+  pthread_mutex_destroy(&tss->tss_mutex);
+  free(tss);
+}
+
+/**
+ *
+ */
+transcoder_client_t *
+transcoder_session_attach(channel_t *ch, transcoder_props_t *props,
+                          int weight, streaming_target_t *output,
+                          const char *hostname, const char *username,
+                          const char *client)
+{
+  transcoder_session_t *tss;
+  transcoder_client_t *tc;
+
+  lock_assert(&global_lock);
+
+  LIST_FOREACH(tss, &transcoder_sessions, tss_link)
+    if(tss->tss_s->ths_channel == ch &&
+       transcoder_props_equal(&tss->tss_props, props))
+      break;
+
+  if(tss == NULL &&
+     (tss = transcoder_session_create(ch, props, weight, hostname,
+                                      username, client)) == NULL)
+    return NULL;
+
+  tc = calloc(1, sizeof(transcoder_client_t));
+  tc->tsc_session = tss;
+  tc->tsc_tsfix   = tsfix_create(output);
+  tss->tss_clients++;
+
+  pthread_mutex_lock(&tss->tss_mutex);
+  streaming_target_connect(&tss->tss_pad, tc->tsc_tsfix);
+  if(tss->tss_start)
+    streaming_target_deliver(tc->tsc_tsfix, streaming_msg_clone(tss->tss_start));
+  pthread_mutex_unlock(&tss->tss_mutex);
+
+  if(tss->tss_clients > 1)
+    tvhlog(LOG_INFO, "transcode", "%s: sharing session with %d clients",
+           ch->ch_name, tss->tss_clients);
+  return tc;
+}
+
+/**
+ *
+ */
+void
+transcoder_session_detach(transcoder_client_t *tc)
+{
+  transcoder_session_t *tss = tc->tsc_session;
+
+  lock_assert(&global_lock);
+
+  pthread_mutex_lock(&tss->tss_mutex);
+  streaming_target_disconnect(&tss->tss_pad, tc->tsc_tsfix);
+  pthread_mutex_unlock(&tss->tss_mutex);
+
+  tsfix_destroy(tc->tsc_tsfix);
+  free(tc);
+
+  if(--tss->tss_clients == 0)
+    transcoder_session_destroy(tss);
+}
+
+/**
+ *
+ */
+void
+transcoder_session_dump(htsbuf_queue_t *hq)
+{
+  transcoder_session_t *tss;
+  channel_t *ch;
+  int sessions = 0, clients = 0;
+
+  lock_assert(&global_lock);
+
+  htsbuf_qprintf(hq, "%-30s %-8s %-8s %8s %8s\n",
+                 "Channel", "Video", "Audio", "Height", "Clients");
+
+  LIST_FOREACH(tss, &transcoder_sessions, tss_link) {
+    ch = tss->tss_s->ths_channel;
+    htsbuf_qprintf(hq, "%-30s %-8s %-8s %8d %8d\n",
+                   ch ? ch->ch_name : "<deleted>",
+                   streaming_component_type2txt(tss->tss_props.tp_vcodec),
+                   streaming_component_type2txt(tss->tss_props.tp_acodec),
+                   tss->tss_props.tp_resolution, tss->tss_clients);
+    sessions++;
+    clients += tss->tss_clients;
+  }
+
+  htsbuf_qprintf(hq, "%d session%s, %d client%s\n",
+                 sessions, sessions == 1 ? "" : "s",
+                 clients, clients == 1 ? "" : "s");
+}
@@ -126,6 +126,7 @@ service_stream_destroy(service_t *t, elementary_stream_t *es)
   avgstat_flush(&es->es_cc_errors);
 
   TAILQ_REMOVE(&t->s_components, es, es_link);
+  t->s_components_gen++;
   free(es->es_nicename);
   free(es);
 }
@@ -159,6 +160,8 @@ service_stop(service_t *t)
   TAILQ_FOREACH(st, &t->s_components, es_link)
     stream_clean(st);
 
+  service_gop_flush(t);
+
   sbuf_free(&t->s_tsbuf);
 
   t->s_status = SERVICE_IDLE;
@@ -220,6 +223,7 @@ service_start(service_t *t, unsigned int weight, int force_start)
 
   t->s_status = SERVICE_RUNNING;
   t->s_current_pts = PTS_UNSET;
+  t->s_gop_max = t->s_ch ? t->s_ch->ch_gop_cache * 1024 : 0;
 
   /**
    * Initialize stream
@@ -506,6 +510,7 @@ service_destroy(service_t *t)
 
   avgstat_flush(&t->s_cc_errors);
   avgstat_flush(&t->s_rate);
+  avgstat_flush(&t->s_descramble_rate);
 
   service_unref(t);
 }
@@ -533,8 +538,10 @@ service_create(const char *identifier, int type, int source_type)
   t->s_dvb_charset = NULL;
   t->s_dvb_eit_enable = 1;
   TAILQ_INIT(&t->s_components);
+  TAILQ_INIT(&t->s_gop_queue);
 
   sbuf_init(&t->s_tsbuf);
+  avgstat_init(&t->s_descramble_rate, 10);
 
   streaming_pad_init(&t->s_streaming_pad);
 
@@ -637,6 +644,7 @@ service_stream_create(service_t *t, int pid,
   st->es_type = type;
 
   TAILQ_INSERT_TAIL(&t->s_components, st, es_link);
+  t->s_components_gen++;
   st->es_service = t;
 
   st->es_pid = pid;
@@ -871,6 +879,9 @@ service_restart(service_t *t, int had_components)
     streaming_msg_free(sm);
   }
 
+  /* Component indices may have changed */
+  service_gop_flush(t);
+
   if(t->s_refresh_feed != NULL)
     t->s_refresh_feed(t);
 
@@ -884,6 +895,87 @@ service_restart(service_t *t, int had_components)
 }
 
 
+/**
+ * Keep the packets since the most recent video I-frame
+ */
+void
+service_gop_add(service_t *t, elementary_stream_t *st, th_pkt_t *pkt)
+{
+  lock_assert(&t->s_stream_mutex);
+
+  if(SCT_ISVIDEO(st->es_type) && pkt->pkt_frametype == PKT_I_FRAME)
+    service_gop_flush(t);
+  else if(TAILQ_FIRST(&t->s_gop_queue) == NULL)
+    return; /* Wait for the next I-frame */
+
+  t->s_gop_bytes += pktbuf_len(pkt->pkt_payload);
+  if(t->s_gop_bytes > t->s_gop_max) {
+    /* GOP does not fit, skip it */
+    service_gop_flush(t);
+    t->s_gop_overflows++;
+    return;
+  }
+
+  pkt_ref_inc(pkt);
+  pktref_enqueue(&t->s_gop_queue, pkt);
+  t->s_gop_packets++;
+}
+
+
+/**
+ *
+ */
+void
+service_gop_flush(service_t *t)
+{
+  pktref_clear_queue(&t->s_gop_queue);
+  t->s_gop_bytes   = 0;
+  t->s_gop_packets = 0;
+}
+
+
+/**
+ * Send the cached GOP to a new subscriber, timestamps are left as is
+ * and continue with the live packets that follow
+ */
+int
+service_gop_prime(service_t *t, streaming_target_t *st)
+{
+  th_pktref_t *pr;
+
+  lock_assert(&t->s_stream_mutex);
+
+  if(!t->s_gop_max)
+    return 0;
+
+  if(TAILQ_FIRST(&t->s_gop_queue) == NULL) {
+    t->s_gop_misses++;
+    return 0;
+  }
+
+  TAILQ_FOREACH(pr, &t->s_gop_queue, pr_link)
+    streaming_target_deliver(st, streaming_msg_create_pkt(pr->pr_pkt));
+  t->s_gop_hits++;
+  return 1;
+}
+
+
+/**
+ *
+ */
+void
+service_gop_set_max(service_t *t, size_t max)
+{
+  pthread_mutex_lock(&t->s_stream_mutex);
+  if(t->s_status == SERVICE_RUNNING) {
+    t->s_gop_max = max;
+    if(!max || t->s_gop_bytes > max)
+      service_gop_flush(t);
+  }
+  pthread_mutex_unlock(&t->s_stream_mutex);
+}
+
+
 /**
  * Generate a message containing info about all components
  */
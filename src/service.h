@@ -478,6 +478,12 @@ typedef struct service {
   int s_caid;
   uint16_t s_prefcapid;
 
+  /**
+   * CSA worker pool, clusters waiting and decrypted byte rate
+   */
+  int s_descramble_queue;
+  avgstat_t s_descramble_rate;
+
   /**
    * PCR drift compensation. This should really be per-packet.
    */
@@ -488,6 +494,12 @@ typedef struct service {
    */
   struct elementary_stream_queue s_components;
 
+  /**
+   * Bumped whenever a component is added or removed, lets input code
+   * that caches elementary_stream pointers detect stale lookups.
+   */
+  int s_components_gen;
+
 
   /**
    * Delivery pad, this is were we finally deliver all streaming output
@@ -500,6 +512,18 @@ typedef struct service {
 
   int64_t s_current_pts;
 
+  /**
+   * Packets since the most recent video I-frame, used to prime new
+   * subscribers of a running service. Protected by s_stream_mutex.
+   */
+  struct th_pktref_queue s_gop_queue;
+  size_t s_gop_bytes;
+  size_t s_gop_max;              // 0 = cache disabled
+  int s_gop_packets;
+  int s_gop_hits;
+  int s_gop_misses;
+  int s_gop_overflows;
+
   /**
    * DVB default charset
    * 	used to overide the default ISO6937 per service
@@ -571,6 +595,14 @@ void service_set_enable(service_t *t, int enabled);
 
 void service_restart(service_t *t, int had_components);
 
+void service_gop_add(service_t *t, elementary_stream_t *st, struct th_pkt *pkt);
+
+void service_gop_flush(service_t *t);
+
+int service_gop_prime(service_t *t, struct streaming_target *st);
+
+void service_gop_set_max(service_t *t, size_t max);
+
 void service_stream_destroy(service_t *t, elementary_stream_t *st);
 
 void service_request_save(service_t *t, int restart);
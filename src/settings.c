@@ -26,15 +26,57 @@
 #include <string.h>
 #include <unistd.h>
 #include <dirent.h>
+#include <limits.h>
+#include <pthread.h>
+#include <sys/mman.h>
 
 #include "htsmsg.h"
 #include "htsmsg_json.h"
+#include "htsmsg_binary.h"
 #include "settings.h"
 #include "tvheadend.h"
 #include "filebundle.h"
 
 static char *settingspath;
 
+/*
+ * Binary snapshot of the JSON tree, written in the background once a
+ * burst of saves is over and used to avoid parsing thousands of small
+ * files at startup. The JSON tree stays authoritative: the snapshot is
+ * removed before any file is written and entries older than their file
+ * or directory are ignored.
+ */
+#define SNAPSHOT_FILE     ".snapshot"
+#define SNAPSHOT_MAGIC    "TVHSNAP"
+#define SNAPSHOT_VERSION  1
+#define SNAPSHOT_DELAY    5
+#define SNAPSHOT_MAX_FILE (1024 * 1024)
+
+typedef struct snapshot_hdr {
+  char     sh_magic[8];
+  uint32_t sh_version;
+  uint32_t sh_files;
+  int64_t  sh_walktime;   /* us spent on parsing the JSON tree */
+} snapshot_hdr_t;
+
+static int             snapshot_enabled;
+static pthread_mutex_t snapshot_mutex;
+static pthread_cond_t  snapshot_cond;
+static htsmsg_t       *snapshot;          /* "dirs" and "partial" maps */
+static time_t          snapshot_mtime;
+static int64_t         snapshot_walktime;
+static int             snapshot_on_disk;
+static int             snapshot_gen;
+static time_t          snapshot_due;
+
+static int             snapshot_hits;
+static int             snapshot_misses;
+static int64_t         snapshot_hit_time;
+static int64_t         snapshot_miss_time;
+
+static void      snapshot_load(void);
+static htsmsg_t *_hts_settings_load(const char *fullpath);
+
 /**
  *
  */
@@ -48,7 +90,7 @@ hts_settings_get_root(void)
  *
  */
 void
-hts_settings_init(const char *confpath)
+hts_settings_init(const char *confpath, int use_snapshot)
 {
   char buf[256];
   const char *homedir = getenv("HOME");
@@ -75,6 +117,13 @@ hts_settings_init(const char *confpath)
 	   settingspath, getuid(), getgid(), strerror(errno));
     settingspath = NULL;
   }
+
+  if (use_snapshot && settingspath) {
+    pthread_mutex_init(&snapshot_mutex, NULL);
+    pthread_cond_init(&snapshot_cond, NULL);
+    snapshot_enabled = 1;
+    snapshot_load();
+  }
 }
 
 /**
@@ -132,6 +181,382 @@ hts_settings_buildpath
   return 0;
 }
 
+/**
+ * Split a path below the settings root into the snapshot key of its
+ * directory and the file name
+ */
+static const char *
+snapshot_key(const char *path, char *dir, size_t dirsize)
+{
+  size_t l = strlen(settingspath);
+  const char *name;
+
+  if (strncmp(path, settingspath, l) || path[l] != '/')
+    return NULL;
+  path += l + 1;
+  if ((name = strrchr(path, '/')) == NULL) {
+    snprintf(dir, dirsize, ".");
+    return path;
+  }
+  snprintf(dir, dirsize, "%.*s", (int)(name - path), path);
+  return name + 1;
+}
+
+/**
+ * Forget about the snapshot entries of a path that is about to change
+ */
+static void
+hts_settings_snapshot_invalidate(const char *path)
+{
+  char dir[256];
+  const char *name;
+  htsmsg_t *m;
+
+  if (!snapshot_enabled)
+    return;
+
+  pthread_mutex_lock(&snapshot_mutex);
+  snapshot_gen++;
+  if (snapshot_on_disk) {
+    hts_settings_buildpath(dir, sizeof(dir), SNAPSHOT_FILE);
+    unlink(dir);
+    snapshot_on_disk = 0;
+  }
+  if (snapshot && (name = snapshot_key(path, dir, sizeof(dir)))) {
+    m = htsmsg_get_map(snapshot, "dirs");
+    htsmsg_delete_field(m, dir);
+    snprintf(dir + strlen(dir), sizeof(dir) - strlen(dir), "/%s", name);
+    htsmsg_delete_field(m, dir[0] == '.' && dir[1] == '/' ? dir + 2 : dir);
+  }
+  snapshot_due = dispatch_clock + SNAPSHOT_DELAY;
+  pthread_cond_signal(&snapshot_cond);
+  pthread_mutex_unlock(&snapshot_mutex);
+}
+
+/**
+ * Editing a file in place leaves the mtime of its directory alone, so
+ * every file of a cached directory is checked against the snapshot
+ */
+static int
+snapshot_dir_stale(const char *fullpath, htsmsg_t *m)
+{
+  char path[PATH_MAX];
+  htsmsg_field_t *f;
+  struct stat st;
+
+  HTSMSG_FOREACH(f, m) {
+    if (snprintf(path, sizeof(path), "%s/%s", fullpath, f->hmf_name)
+          >= sizeof(path) ||
+        stat(path, &st) || st.st_mtime >= snapshot_mtime)
+      return 1;
+  }
+  return 0;
+}
+
+/**
+ * Look up a file or directory in the loaded snapshot
+ *
+ * Returns non-zero if the snapshot does not cover the path
+ */
+static int
+hts_settings_snapshot_get(const char *fullpath, htsmsg_t **r)
+{
+  char dir[256];
+  const char *name;
+  htsmsg_t *m = NULL, *dirs;
+  htsmsg_field_t *f;
+  struct stat st;
+  int64_t t = getmonoclock();
+
+  *r = NULL;
+  if (stat(fullpath, &st) || st.st_mtime >= snapshot_mtime)
+    return 1;
+
+  pthread_mutex_lock(&snapshot_mutex);
+  if (snapshot && (name = snapshot_key(fullpath, dir, sizeof(dir)))) {
+    dirs = htsmsg_get_map(snapshot, "dirs");
+    if (S_ISDIR(st.st_mode)) {
+      name = fullpath + strlen(settingspath) + 1;
+      if (!htsmsg_get_map(htsmsg_get_map(snapshot, "partial"), name) &&
+          (m = htsmsg_get_map(dirs, name)) != NULL)
+        *r = htsmsg_copy(m);
+    } else if ((m = htsmsg_get_map(dirs, dir)) != NULL &&
+               (f = htsmsg_field_find(m, name)) != NULL &&
+               (f->hmf_type == HMF_MAP || f->hmf_type == HMF_LIST)) {
+      *r = htsmsg_copy(&f->hmf_msg);
+    }
+  }
+  pthread_mutex_unlock(&snapshot_mutex);
+
+  if (*r && S_ISDIR(st.st_mode) && snapshot_dir_stale(fullpath, *r)) {
+    htsmsg_destroy(*r);
+    *r = NULL;
+  }
+  if (*r) {
+    pthread_mutex_lock(&snapshot_mutex);
+    snapshot_hits++;
+    snapshot_hit_time += getmonoclock() - t;
+    pthread_mutex_unlock(&snapshot_mutex);
+  }
+  return *r == NULL;
+}
+
+/**
+ * Load from the JSON tree, accounted for the startup report
+ */
+static htsmsg_t *
+hts_settings_snapshot_json(const char *fullpath)
+{
+  int64_t t = getmonoclock();
+  htsmsg_t *r = _hts_settings_load(fullpath);
+
+  pthread_mutex_lock(&snapshot_mutex);
+  snapshot_misses++;
+  snapshot_miss_time += getmonoclock() - t;
+  pthread_mutex_unlock(&snapshot_mutex);
+  return r;
+}
+
+/**
+ * Parse one directory of the JSON tree (and its subdirectories) into
+ * the snapshot
+ */
+static int
+snapshot_walk(const char *rel, htsmsg_t *dirs, htsmsg_t *partial)
+{
+  char path[PATH_MAX], child[PATH_MAX];
+  struct dirent *de;
+  struct stat st;
+  htsmsg_t *files, *c;
+  DIR *dp;
+  char *mem;
+  int fd, n, count = 0, ok = 1;
+
+  if (*rel)
+    snprintf(path, sizeof(path), "%s/%s", settingspath, rel);
+  else
+    snprintf(path, sizeof(path), "%s", settingspath);
+  if ((dp = opendir(path)) == NULL)
+    return 0;
+
+  files = htsmsg_create_map();
+  while ((de = readdir(dp)) != NULL) {
+    if (de->d_name[0] == '.')
+      continue;
+    /* Never store an entry under a truncated key */
+    if ((*rel ? snprintf(child, sizeof(child), "%s/%s", rel, de->d_name)
+              : snprintf(child, sizeof(child), "%s", de->d_name))
+          >= sizeof(child) ||
+        snprintf(path, sizeof(path), "%s/%s", settingspath, child)
+          >= sizeof(path)) {
+      ok = 0;
+      continue;
+    }
+    if (stat(path, &st))
+      continue;
+
+    if (S_ISDIR(st.st_mode)) {
+      count += snapshot_walk(child, dirs, partial);
+      continue;
+    }
+    if (st.st_size > SNAPSHOT_MAX_FILE || strlen(de->d_name) > 255) {
+      ok = 0;
+      continue;
+    }
+
+    if ((fd = tvh_open(path, O_RDONLY, 0)) < 0) {
+      ok = 0;
+      continue;
+    }
+    mem = malloc(st.st_size + 1);
+    n   = read(fd, mem, st.st_size);
+    close(fd);
+    if (n != st.st_size) {
+      ok = 0;
+    } else {
+      mem[n] = 0;
+      if ((c = htsmsg_json_deserialize(mem)) != NULL) {
+        htsmsg_add_msg(files, de->d_name, c);
+        count++;
+      }
+    }
+    free(mem);
+  }
+  closedir(dp);
+
+  if (!*rel)
+    rel = ".";
+  if (strlen(rel) > 255) {
+    htsmsg_destroy(files);
+    return count;
+  }
+  if (!ok)
+    htsmsg_add_u32(partial, rel, 1);
+  htsmsg_add_msg(dirs, rel, files);
+  return count;
+}
+
+/**
+ * Rebuild the snapshot file, discarded if anything was saved meanwhile
+ */
+static void
+snapshot_write(int gen)
+{
+  char path[256], tmppath[PATH_MAX];
+  snapshot_hdr_t hdr;
+  htsmsg_t *m, *dirs, *partial;
+  void *data;
+  size_t len;
+  int64_t t;
+  int fd, files, ok;
+
+  t = getmonoclock();
+  dirs    = htsmsg_create_map();
+  partial = htsmsg_create_map();
+  files   = snapshot_walk("", dirs, partial);
+  m = htsmsg_create_map();
+  htsmsg_add_msg(m, "dirs", dirs);
+  htsmsg_add_msg(m, "partial", partial);
+
+  memset(&hdr, 0, sizeof(hdr));
+  memcpy(hdr.sh_magic, SNAPSHOT_MAGIC, sizeof(SNAPSHOT_MAGIC));
+  hdr.sh_version  = SNAPSHOT_VERSION;
+  hdr.sh_files    = files;
+  hdr.sh_walktime = getmonoclock() - t;
+
+  ok = !htsmsg_binary_serialize(m, &data, &len, INT32_MAX);
+  htsmsg_destroy(m);
+  if (!ok)
+    return;
+
+  hts_settings_buildpath(path, sizeof(path), SNAPSHOT_FILE);
+  if (snprintf(tmppath, sizeof(tmppath), "%s.tmp", path) >= sizeof(tmppath) ||
+      (fd = tvh_open(tmppath, O_CREAT | O_TRUNC | O_WRONLY, 0600)) < 0) {
+    free(data);
+    return;
+  }
+  ok = !tvh_write(fd, &hdr, sizeof(hdr)) && !tvh_write(fd, data, len);
+  close(fd);
+  free(data);
+
+  pthread_mutex_lock(&snapshot_mutex);
+  if (ok && gen == snapshot_gen && !rename(tmppath, path)) {
+    snapshot_on_disk = 1;
+    tvhlog(LOG_INFO, "settings", "snapshot of %d files (%zu bytes) written, "
+           "parsing the JSON tree took %"PRId64"ms",
+           files, len, hdr.sh_walktime / 1000);
+  } else {
+    unlink(tmppath);
+  }
+  pthread_mutex_unlock(&snapshot_mutex);
+}
+
+/**
+ *
+ */
+static void *
+snapshot_thread(void *aux)
+{
+  struct timespec ts;
+  int gen;
+
+  pthread_mutex_lock(&snapshot_mutex);
+  while (1) {
+    if (!snapshot_due) {
+      pthread_cond_wait(&snapshot_cond, &snapshot_mutex);
+      continue;
+    }
+    if (dispatch_clock < snapshot_due) {
+      ts.tv_sec  = snapshot_due;
+      ts.tv_nsec = 0;
+      pthread_cond_timedwait(&snapshot_cond, &snapshot_mutex, &ts);
+      continue;
+    }
+    snapshot_due = 0;
+    gen = snapshot_gen;
+    pthread_mutex_unlock(&snapshot_mutex);
+    snapshot_write(gen);
+    pthread_mutex_lock(&snapshot_mutex);
+  }
+  return NULL;
+}
+
+/**
+ * Map the snapshot written by a previous run
+ */
+static void
+snapshot_load(void)
+{
+  char path[256];
+  const snapshot_hdr_t *hdr;
+  struct stat st;
+  void *mem;
+  int fd;
+
+  hts_settings_buildpath(path, sizeof(path), SNAPSHOT_FILE);
+  if ((fd = tvh_open(path, O_RDONLY, 0)) < 0)
+    return;
+  if (fstat(fd, &st) || st.st_size < sizeof(snapshot_hdr_t) + 4) {
+    close(fd);
+    return;
+  }
+  mem = mmap(NULL, st.st_size, PROT_READ, MAP_SHARED, fd, 0);
+  close(fd);
+  if (mem == MAP_FAILED)
+    return;
+
+  hdr = mem;
+  if (memcmp(hdr->sh_magic, SNAPSHOT_MAGIC, sizeof(SNAPSHOT_MAGIC)) ||
+      hdr->sh_version != SNAPSHOT_VERSION) {
+    tvhlog(LOG_INFO, "settings", "ignoring snapshot of another version");
+  } else {
+    snapshot = htsmsg_binary_deserialize((uint8_t *)(hdr + 1) + 4,
+                                         st.st_size - sizeof(*hdr) - 4,
+                                         NULL);
+    if (snapshot == NULL || !htsmsg_get_map(snapshot, "dirs") ||
+        !htsmsg_get_map(snapshot, "partial")) {
+      tvhlog(LOG_ERR, "settings", "snapshot is corrupt, ignoring");
+      if (snapshot)
+        htsmsg_destroy(snapshot);
+      snapshot = NULL;
+    } else {
+      snapshot_mtime    = st.st_mtime;
+      snapshot_walktime = hdr->sh_walktime;
+      snapshot_on_disk  = 1;
+    }
+  }
+  munmap(mem, st.st_size);
+}
+
+/**
+ * Startup is complete, report and start maintaining the snapshot
+ */
+void
+hts_settings_startup_done(void)
+{
+  pthread_t tid;
+
+  if (!snapshot_enabled)
+    return;
+
+  pthread_mutex_lock(&snapshot_mutex);
+  if (snapshot) {
+    tvhlog(LOG_INFO, "settings",
+           "loaded %d entries from snapshot in %"PRId64"ms, %d from JSON "
+           "in %"PRId64"ms (whole JSON tree took %"PRId64"ms)",
+           snapshot_hits, snapshot_hit_time / 1000,
+           snapshot_misses, snapshot_miss_time / 1000,
+           snapshot_walktime / 1000);
+    htsmsg_destroy(snapshot);
+    snapshot = NULL;
+  }
+  if (!snapshot_on_disk && !snapshot_due)
+    snapshot_due = dispatch_clock;
+  pthread_mutex_unlock(&snapshot_mutex);
+
+  pthread_create(&tid, NULL, snapshot_thread, NULL);
+}
+
 /**
  *
  */
@@ -157,6 +582,8 @@ hts_settings_save(htsmsg_t *record, const char *pathfmt, ...)
   /* Create directories */
   if (hts_settings_makedirs(path)) return;
 
+  hts_settings_snapshot_invalidate(path);
+
   /* Create tmp file */
   snprintf(tmppath, sizeof(tmppath), "%s.tmp", path);
   if((fd = tvh_open(tmppath, O_CREAT | O_TRUNC | O_RDWR, 0700)) < 0) {
@@ -276,7 +703,10 @@ hts_settings_load(const char *pathfmt, ...)
   _hts_settings_buildpath(fullpath, sizeof(fullpath), 
                           pathfmt, ap, settingspath);
   va_end(ap);
-  ret = _hts_settings_load(fullpath);
+  if (!snapshot)
+    ret = _hts_settings_load(fullpath);
+  else if (hts_settings_snapshot_get(fullpath, &ret))
+    ret = hts_settings_snapshot_json(fullpath);
 
   /* Try bundle path */
   if (!ret && *pathfmt != '/') {
@@ -305,6 +735,7 @@ hts_settings_remove(const char *pathfmt, ...)
                           pathfmt, ap, settingspath);
   va_end(ap);
   if (stat(fullpath, &st) == 0) {
+    hts_settings_snapshot_invalidate(fullpath);
     if (S_ISDIR(st.st_mode))
       rmdir(fullpath);
     else
@@ -22,7 +22,9 @@
 #include "htsmsg.h"
 #include <stdarg.h>
 
-void hts_settings_init(const char *confpath);
+void hts_settings_init(const char *confpath, int use_snapshot);
+
+void hts_settings_startup_done(void);
 
 void hts_settings_save(htsmsg_t *record, const char *pathfmt, ...);
 
@@ -146,14 +146,13 @@ spawn_enq(const char *name, int pid)
 
 
 /**
- * Execute the given program and return its output in a malloc()ed buffer
- * 
- * *outp will point to the allocated buffer
- * The function will return the size of the buffer
+ * Execute the given program and return a pipe to its output
+ *
+ * The caller reads and closes the returned descriptor, -1 on error
  */
 
 int
-spawn_and_store_stdout(const char *prog, char *argv[], char **outp)
+spawn_with_stdout(const char *prog, char *argv[])
 {
   pid_t p;
   int fd[2], f;
@@ -215,7 +214,26 @@ spawn_and_store_stdout(const char *prog, char *argv[], char **outp)
 
   close(fd[1]);
 
-  return file_readall(fd[0], outp);
+  return fd[0];
+}
+
+
+/**
+ * Execute the given program and return its output in a malloc()ed buffer
+ * 
+ * *outp will point to the allocated buffer
+ * The function will return the size of the buffer
+ */
+
+int
+spawn_and_store_stdout(const char *prog, char *argv[], char **outp)
+{
+  int fd;
+
+  if((fd = spawn_with_stdout(prog, argv)) < 0)
+    return -1;
+
+  return file_readall(fd, outp);
 }
 
 
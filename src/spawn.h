@@ -21,6 +21,8 @@
 
 int find_exec ( const char *name, char *out, size_t len );
 
+int spawn_with_stdout(const char *prog, char *argv[]);
+
 int spawn_and_store_stdout(const char *prog, char *argv[], char **outp);
 
 int spawnv(const char *prog, char *argv[]);
@@ -24,6 +24,19 @@
 #include "atomic.h"
 #include "service.h"
 #include "timeshift.h"
+#include "mempool.h"
+
+static mempool_t *streaming_msg_pool;
+
+/**
+ *
+ */
+void
+streaming_init(void)
+{
+  streaming_msg_pool = mempool_create("streaming_message_t",
+                                      sizeof(streaming_message_t));
+}
 
 void
 streaming_pad_init(streaming_pad_t *sp)
@@ -136,7 +149,7 @@ streaming_target_disconnect(streaming_pad_t *sp, streaming_target_t *st)
 streaming_message_t *
 streaming_msg_create(streaming_message_type_t type)
 {
-  streaming_message_t *sm = malloc(sizeof(streaming_message_t));
+  streaming_message_t *sm = mempool_alloc(streaming_msg_pool);
   sm->sm_type = type;
 #if ENABLE_TIMESHIFT
   sm->sm_time      = 0;
@@ -189,7 +202,7 @@ streaming_msg_create_code(streaming_message_type_t type, int code)
 streaming_message_t *
 streaming_msg_clone(streaming_message_t *src)
 {
-  streaming_message_t *dst = malloc(sizeof(streaming_message_t));
+  streaming_message_t *dst = mempool_alloc(streaming_msg_pool);
   streaming_start_t *ss;
 
   dst->sm_type      = src->sm_type;
@@ -304,7 +317,7 @@ streaming_msg_free(streaming_message_t *sm)
   default:
     abort();
   }
-  free(sm);
+  mempool_free(streaming_msg_pool, sm);
 }
 
 /**
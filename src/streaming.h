@@ -65,6 +65,8 @@ typedef struct streaming_start {
 /**
  *
  */
+void streaming_init(void);
+
 void streaming_pad_init(streaming_pad_t *sp);
 
 void streaming_target_init(streaming_target_t *st,
@@ -40,6 +40,9 @@
 #include "notify.h"
 #include "atomic.h"
 #include "dvb/dvb.h"
+#if ENABLE_LIBAV
+#include "plumbing/transcoding.h"
+#endif
 
 struct th_subscription_list subscriptions;
 static gtimer_t subscription_reschedule_timer;
@@ -104,6 +107,10 @@ subscription_link_service(th_subscription_t *s, service_t *t)
     sm = streaming_msg_create_code(SMT_SERVICE_STATUS, 
 				   t->s_streaming_status);
     streaming_target_deliver(s->ths_output, sm);
+
+    // Start with the last GOP instead of waiting for the next I-frame
+    if(!(s->ths_flags & SUBSCRIPTION_RAW_MPEGTS))
+      service_gop_prime(t, &s->ths_input);
   }
 
   pthread_mutex_unlock(&t->s_stream_mutex);
@@ -609,6 +616,7 @@ static void
 every_sec_cb(void *aux)
 {
   th_subscription_t *s;
+  service_t *t;
   gtimer_arm(&every_sec, every_sec_cb, NULL, 1);
 
   LIST_FOREACH(s, &subscriptions, ths_global_link) {
@@ -619,6 +627,16 @@ every_sec_cb(void *aux)
     htsmsg_delete_field(m, "errors");
     htsmsg_add_u32(m, "errors", errors);
     htsmsg_add_u32(m, "bw", bw);
+    if((t = s->ths_service) != NULL) {
+      htsmsg_add_u32(m, "csa_queue", t->s_descramble_queue);
+      htsmsg_add_u32(m, "csa_bw",
+                     avgstat_read(&t->s_descramble_rate, 10,
+                                  dispatch_clock) / 10);
+    }
+#if ENABLE_LIBAV
+    if(s->ths_transcoder != NULL)
+      transcoder_get_stats(s->ths_transcoder, m);
+#endif
     htsmsg_add_u32(m, "updateEntry", 1);
     notify_by_msg("subscriptions", m);
   }
@@ -57,6 +57,8 @@ typedef struct th_subscription {
 
   streaming_target_t *ths_output;
 
+  streaming_target_t *ths_transcoder; /* For statistics, may be NULL */
+
   int ths_flags;
 
   streaming_message_t *ths_start_message;
@@ -381,6 +381,7 @@ typedef struct tcp_server {
   tcp_server_callback_t *start;
   void *opaque;
   int serverfd;
+  int threaded;
 } tcp_server_t;
 
 typedef struct tcp_server_launch_t {
@@ -395,38 +396,48 @@ typedef struct tcp_server_launch_t {
 /**
  *
  */
-static void *
-tcp_server_start(void *aux)
+static void
+tcp_server_setup(int fd)
 {
-  tcp_server_launch_t *tsl = aux;
   struct timeval to;
   int val;
 
   val = 1;
-  setsockopt(tsl->fd, SOL_SOCKET, SO_KEEPALIVE, &val, sizeof(val));
+  setsockopt(fd, SOL_SOCKET, SO_KEEPALIVE, &val, sizeof(val));
   
 #ifdef TCP_KEEPIDLE
   val = 30;
-  setsockopt(tsl->fd, IPPROTO_TCP, TCP_KEEPIDLE, &val, sizeof(val));
+  setsockopt(fd, IPPROTO_TCP, TCP_KEEPIDLE, &val, sizeof(val));
 #endif
 
 #ifdef TCP_KEEPINVL
   val = 15;
-  setsockopt(tsl->fd, IPPROTO_TCP, TCP_KEEPINTVL, &val, sizeof(val));
+  setsockopt(fd, IPPROTO_TCP, TCP_KEEPINTVL, &val, sizeof(val));
 #endif
 
 #ifdef TCP_KEEPCNT
   val = 5;
-  setsockopt(tsl->fd, IPPROTO_TCP, TCP_KEEPCNT, &val, sizeof(val));
+  setsockopt(fd, IPPROTO_TCP, TCP_KEEPCNT, &val, sizeof(val));
 #endif
 
   val = 1;
-  setsockopt(tsl->fd, IPPROTO_TCP, TCP_NODELAY, &val, sizeof(val));
+  setsockopt(fd, IPPROTO_TCP, TCP_NODELAY, &val, sizeof(val));
 
   to.tv_sec  = 30;
   to.tv_usec =  0;
-  setsockopt(tsl->fd, SOL_SOCKET, SO_SNDTIMEO, &to, sizeof(to));
+  setsockopt(fd, SOL_SOCKET, SO_SNDTIMEO, &to, sizeof(to));
+}
+
+
+/**
+ *
+ */
+static void *
+tcp_server_start(void *aux)
+{
+  tcp_server_launch_t *tsl = aux;
 
+  tcp_server_setup(tsl->fd);
   tsl->start(tsl->fd, tsl->opaque, &tsl->peer, &tsl->self);
   free(tsl);
 
@@ -490,6 +501,13 @@ tcp_server_loop(void *aux)
         continue;
      	}
 
+      if(!ts->threaded) {
+        tcp_server_setup(tsl->fd);
+        tsl->start(tsl->fd, tsl->opaque, &tsl->peer, &tsl->self);
+        free(tsl);
+        continue;
+      }
+
      	pthread_create(&tid, &attr, tcp_server_start, tsl);
     }
   }
@@ -499,8 +517,9 @@ tcp_server_loop(void *aux)
 /**
  *
  */
-void *
-tcp_server_create(const char *bindaddr, int port, tcp_server_callback_t *start, void *opaque)
+static void *
+tcp_server_create0(const char *bindaddr, int port, tcp_server_callback_t *start,
+                   void *opaque, int threaded)
 {
   int fd, x;
   tvhpoll_event_t ev;
@@ -563,12 +582,13 @@ tcp_server_create(const char *bindaddr, int port, tcp_server_callback_t *start,
     return NULL;
   }
 
-  listen(fd, 1);
+  listen(fd, SOMAXCONN);
 
   ts = malloc(sizeof(tcp_server_t));
   ts->serverfd = fd;
   ts->start = start;
   ts->opaque = opaque;
+  ts->threaded = threaded;
 
   ev.fd       = fd;
   ev.events   = TVHPOLL_IN;
@@ -578,6 +598,25 @@ tcp_server_create(const char *bindaddr, int port, tcp_server_callback_t *start,
   return ts;
 }
 
+/**
+ *
+ */
+void *
+tcp_server_create(const char *bindaddr, int port, tcp_server_callback_t *start, void *opaque)
+{
+  return tcp_server_create0(bindaddr, port, start, opaque, 1);
+}
+
+/**
+ *
+ */
+void *
+tcp_server_create_inline(const char *bindaddr, int port,
+                         tcp_server_callback_t *start, void *opaque)
+{
+  return tcp_server_create0(bindaddr, port, start, opaque, 0);
+}
+
 /**
  *
  */
@@ -34,6 +34,13 @@ typedef void (tcp_server_callback_t)(int fd, void *opaque,
 
 void *tcp_server_create(const char *bindaddr, int port, tcp_server_callback_t *start, void *opaque);
 
+/**
+ * As tcp_server_create() but the callback is invoked from the accept
+ * thread, it must hand the connection off without blocking
+ */
+void *tcp_server_create_inline(const char *bindaddr, int port,
+                               tcp_server_callback_t *start, void *opaque);
+
 int tcp_read(int fd, void *buf, size_t len);
 
 int tcp_read_line(int fd, char *buf, const size_t bufsize, 
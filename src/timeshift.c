@@ -23,6 +23,7 @@
 #include "config2.h"
 #include "settings.h"
 #include "atomic.h"
+#include "channels.h"
 
 #include <sys/types.h>
 #include <sys/stat.h>
@@ -34,6 +35,8 @@
 
 static int timeshift_index = 0;
 
+static LIST_HEAD(,timeshift_buffer) timeshift_buffers;
+
 uint32_t  timeshift_enabled;
 int       timeshift_ondemand;
 char     *timeshift_path;
@@ -41,6 +44,7 @@ int       timeshift_unlimited_period;
 uint32_t  timeshift_max_period;
 int       timeshift_unlimited_size;
 uint64_t  timeshift_max_size;
+uint64_t  timeshift_ram_size;
 
 /*
  * Intialise global file manager
@@ -61,6 +65,7 @@ void timeshift_init ( void )
   timeshift_max_period       = 3600;                    // 1Hr
   timeshift_unlimited_size   = 0;
   timeshift_max_size         = 10000 * (size_t)1048576; // 10G
+  timeshift_ram_size         = 0;                       // Disabled
 
   /* Load settings */
   if ((m = hts_settings_load("timeshift/config"))) {
@@ -77,6 +82,8 @@ void timeshift_init ( void )
       timeshift_unlimited_size = u32 ? 1 : 0;
     if (!htsmsg_get_u32(m, "max_size", &u32))
       timeshift_max_size = 1048576LL * u32;
+    if (!htsmsg_get_u32(m, "ram_size", &u32))
+      timeshift_ram_size = 1048576LL * u32;
     htsmsg_destroy(m);
   }
 }
@@ -105,18 +112,198 @@ void timeshift_save ( void )
   htsmsg_add_u32(m, "max_period", timeshift_max_period);
   htsmsg_add_u32(m, "unlimited_size", timeshift_unlimited_size);
   htsmsg_add_u32(m, "max_size", timeshift_max_size / 1048576);
+  htsmsg_add_u32(m, "ram_size", timeshift_ram_size / 1048576);
 
   hts_settings_save(m, "timeshift/config");
 }
 
+/* **************************************************************************
+ * Buffer sharing
+ * *************************************************************************/
+
+static timeshift_buffer_t *timeshift_buffer_create ( int id, int chid );
+
+/*
+ * Hand recording over to another instance (feed_mutex must be held)
+ */
+static void timeshift_handover ( timeshift_buffer_t *tsb, timeshift_t *ts )
+{
+  timeshift_t *t;
+
+  tsb->feeder = NULL;
+  LIST_FOREACH(t, &tsb->instances, buf_link)
+    if (t != ts && t->pts_offset != PTS_UNSET && t->state != TS_EXIT) {
+      tsb->feeder = t;
+      break;
+    }
+  tvhlog(LOG_DEBUG, "timeshift", "ts %d feeder %d -> %d", tsb->id, ts->id,
+         tsb->feeder ? tsb->feeder->id : -1);
+}
+
+/*
+ * Find the offset to the buffer PTS (feed_mutex must be held)
+ *
+ * All instances of a channel receive the same payload buffers, the DTS
+ * difference on a common packet gives the (constant) offset.
+ */
+static void timeshift_sync ( timeshift_t *ts, th_pkt_t *pkt )
+{
+  timeshift_buffer_t *tsb = ts->buf;
+  timeshift_t *f = tsb->feeder, *t;
+
+  if (!pkt->pkt_payload || pkt->pkt_dts == PTS_UNSET)
+    return;
+  if (ts->sync_pb)
+    pktbuf_ref_dec(ts->sync_pb);
+  pktbuf_ref_inc(pkt->pkt_payload);
+  ts->sync_pb  = pkt->pkt_payload;
+  ts->sync_dts = pkt->pkt_dts;
+
+  if (f == ts) {
+    LIST_FOREACH(t, &tsb->instances, buf_link)
+      if (t->pts_offset == PTS_UNSET && t->sync_pb == ts->sync_pb)
+        t->pts_offset = t->sync_dts - (ts->sync_dts - ts->pts_offset);
+
+  } else if (ts->pts_offset == PTS_UNSET) {
+    if (f && f->sync_pb == ts->sync_pb) {
+      ts->pts_offset = ts->sync_dts - (f->sync_dts - f->pts_offset);
+
+    /* Nobody left to compare with, estimate from the clock */
+    } else if (!f) {
+      if (tsb->pts_delta != PTS_UNSET && ts->pts_delta != PTS_UNSET)
+        ts->pts_offset = ((tsb->pts_delta - ts->pts_delta) * 9) / 100;
+      else
+        ts->pts_offset = 0;
+      tsb->feeder = ts;
+      tvhlog(LOG_DEBUG, "timeshift", "ts %d feeder %d (estimated)",
+             tsb->id, ts->id);
+    }
+  }
+}
+
+/*
+ * Check where a shared instance is fed from (state_mutex must be held)
+ *
+ * Instances fed by another service than the feeder never see the same
+ * payload buffers and so can never sync, they get a private buffer.
+ */
+static timeshift_buffer_t *timeshift_source
+  ( timeshift_t *ts, streaming_start_t *ss )
+{
+  timeshift_buffer_t *tsb = ts->buf;
+  source_info_t *si = &ss->ss_si;
+  timeshift_t *f;
+  char src[512];
+  int move = 0;
+
+  snprintf(src, sizeof(src), "%s/%s/%s", si->si_adapter ?: "",
+           si->si_mux ?: "", si->si_service ?: "");
+
+  pthread_mutex_lock(&tsb->feed_mutex);
+  free(ts->source);
+  ts->source = strdup(src);
+  f = tsb->feeder;
+  if (f && f != ts && f->source && ts->pts_offset == PTS_UNSET &&
+      strcmp(f->source, ts->source)) {
+    LIST_REMOVE(ts, buf_link);
+    tsb->refcount--;
+    move = 1;
+  }
+  pthread_mutex_unlock(&tsb->feed_mutex);
+  if (!move)
+    return tsb;
+
+  tvhlog(LOG_DEBUG, "timeshift", "ts %d fed by another service, leaving "
+         "buffer %d", ts->id, tsb->id);
+  tsb = timeshift_buffer_create(ts->id, 0);
+  tsb->max_time  = ts->max_time;
+  tsb->refcount  = 1;
+  tsb->feeder    = ts;
+  LIST_INSERT_HEAD(&tsb->instances, ts, buf_link);
+  if (ts->sync_pb)
+    pktbuf_ref_dec(ts->sync_pb);
+  ts->sync_pb    = NULL;
+  ts->pts_offset = 0;
+  ts->buf        = tsb;
+  return tsb;
+}
+
+/*
+ * Translate a packet to the buffer PTS
+ */
+static streaming_message_t *timeshift_rebase
+  ( streaming_message_t *sm, int64_t off )
+{
+  streaming_message_t *sm2;
+  th_pkt_t *pkt = pkt_copy_shallow(sm->sm_data);
+  if (pkt->pkt_pts != PTS_UNSET)
+    pkt->pkt_pts -= off;
+  if (pkt->pkt_dts != PTS_UNSET)
+    pkt->pkt_dts -= off;
+  sm2 = streaming_msg_create_pkt(pkt);
+  sm2->sm_time = sm->sm_time;
+  pkt_ref_dec(pkt);
+  streaming_msg_free(sm);
+  return sm2;
+}
+
+/*
+ * Create buffer (global_lock must be held for shared buffers)
+ */
+static timeshift_buffer_t *timeshift_buffer_create ( int id, int chid )
+{
+  timeshift_buffer_t *tsb = calloc(1, sizeof(timeshift_buffer_t));
+
+  TAILQ_INIT(&tsb->files);
+  LIST_INIT(&tsb->instances);
+  tsb->id        = id;
+  tsb->chid      = chid;
+  tsb->vididx    = -1;
+  tsb->pts_delta = PTS_UNSET;
+  pthread_mutex_init(&tsb->rdwr_mutex, NULL);
+  pthread_mutex_init(&tsb->feed_mutex, NULL);
+  if (chid)
+    LIST_INSERT_HEAD(&timeshift_buffers, tsb, link);
+
+  streaming_queue_init(&tsb->wr_queue, 0);
+  pthread_create(&tsb->wr_thread, NULL, timeshift_writer, tsb);
+  return tsb;
+}
+
+/*
+ * Destroy buffer (global_lock must be held)
+ */
+static void timeshift_buffer_destroy ( timeshift_buffer_t *tsb )
+{
+  /* Stop the writer (private buffers were sent SMT_EXIT already) */
+  if (tsb->chid) {
+    streaming_target_deliver2(&tsb->wr_queue.sq_st,
+                              streaming_msg_create(SMT_EXIT));
+    LIST_REMOVE(tsb, link);
+  }
+  pthread_join(tsb->wr_thread, NULL);
+  streaming_queue_deinit(&tsb->wr_queue);
+
+  /* Flush files */
+  timeshift_filemgr_flush(tsb, NULL);
+
+  pthread_mutex_destroy(&tsb->rdwr_mutex);
+  pthread_mutex_destroy(&tsb->feed_mutex);
+  free(tsb->fidx);
+  free(tsb->path);
+  free(tsb);
+}
+
 /*
  * Receive data
  */
 static void timeshift_input
   ( void *opaque, streaming_message_t *sm )
 {
-  int exit = 0;
+  int exit = 0, feed = 1;
+  int64_t off = 0;
   timeshift_t *ts = opaque;
+  timeshift_buffer_t *tsb = ts->buf;
 
   pthread_mutex_lock(&ts->state_mutex);
 
@@ -135,6 +322,8 @@ static void timeshift_input
     if (sm->sm_type == SMT_START && ts->state == TS_INIT) {
       ts->state  = TS_LIVE;
     }
+    if (sm->sm_type == SMT_START && tsb->chid)
+      tsb = timeshift_source(ts, sm->sm_data);
 
     /* Pass-thru */
     if (ts->state <= TS_LIVE) {
@@ -159,10 +348,31 @@ static void timeshift_input
         ts->pts_delta = getmonoclock() - ts_rescale(pkt->pkt_pts, 1000000);
     }
 
+    /* Shared buffer, only the feeder is recorded */
+    if (tsb->chid) {
+      pthread_mutex_lock(&tsb->feed_mutex);
+      if (sm->sm_type == SMT_PACKET)
+        timeshift_sync(ts, sm->sm_data);
+      feed = tsb->feeder == ts;
+      off  = ts->pts_offset;
+      if (feed && tsb->pts_delta == PTS_UNSET && ts->pts_delta != PTS_UNSET)
+        tsb->pts_delta = ts->pts_delta + (off * 100) / 9;
+      if (feed && exit)
+        timeshift_handover(tsb, ts);
+      pthread_mutex_unlock(&tsb->feed_mutex);
+
+      /* The writer is stopped on destroy */
+      if (exit)
+        feed = 0;
+    }
+
     /* Buffer to disk */
-    if ((ts->state > TS_LIVE) || (!ts->ondemand && (ts->state == TS_LIVE))) {
+    if (feed &&
+        ((ts->state > TS_LIVE) || (!ts->ondemand && (ts->state == TS_LIVE)))) {
       sm->sm_time = getmonoclock();
-      streaming_target_deliver2(&ts->wr_queue.sq_st, sm);
+      if (off && sm->sm_type == SMT_PACKET)
+        sm = timeshift_rebase(sm, off);
+      streaming_target_deliver2(&tsb->wr_queue.sq_st, sm);
     } else
       streaming_msg_free(sm);
 
@@ -183,7 +393,9 @@ void
 timeshift_destroy(streaming_target_t *pad)
 {
   timeshift_t *ts = (timeshift_t*)pad;
+  timeshift_buffer_t *tsb;
   streaming_message_t *sm;
+  int last;
 
   /* Must hold global lock */
   lock_assert(&global_lock);
@@ -192,30 +404,38 @@ timeshift_destroy(streaming_target_t *pad)
   // Note: this is a workaround for the fact the Q might have been flushed
   //       in reader thread (VERY unlikely)
   pthread_mutex_lock(&ts->state_mutex);
-  sm = streaming_msg_create(SMT_EXIT);
-  streaming_target_deliver2(&ts->wr_queue.sq_st, sm);
+  tsb = ts->buf;
+  if (!tsb->chid) {
+    sm = streaming_msg_create(SMT_EXIT);
+    streaming_target_deliver2(&tsb->wr_queue.sq_st, sm);
+  }
   timeshift_write_exit(ts->rd_pipe.wr);
   pthread_mutex_unlock(&ts->state_mutex);
 
-  /* Wait for all threads */
+  /* Wait for the reader */
   pthread_join(ts->rd_thread, NULL);
-  pthread_join(ts->wr_thread, NULL);
 
   /* Shut stuff down */
-  streaming_queue_deinit(&ts->wr_queue);
-
   close(ts->rd_pipe.rd);
   close(ts->rd_pipe.wr);
 
-  /* Flush files */
-  timeshift_filemgr_flush(ts, NULL);
+  /* Detach from buffer */
+  pthread_mutex_lock(&tsb->feed_mutex);
+  LIST_REMOVE(ts, buf_link);
+  if (tsb->chid && tsb->feeder == ts)
+    timeshift_handover(tsb, ts);
+  if (ts->sync_pb)
+    pktbuf_ref_dec(ts->sync_pb);
+  last = --tsb->refcount == 0;
+  pthread_mutex_unlock(&tsb->feed_mutex);
+  if (last)
+    timeshift_buffer_destroy(tsb);
+  free(ts->source);
 
   /* Release SMT_START index */
   if (ts->smt_start)
     streaming_start_unref(ts->smt_start);
 
-  if (ts->path)
-    free(ts->path);
   free(ts);
 }
 
@@ -223,37 +443,57 @@ timeshift_destroy(streaming_target_t *pad)
  * Create timeshift buffer
  *
  * max_period of buffer in seconds (0 = unlimited)
- * max_size   of buffer in bytes   (0 = unlimited)
+ * ch         share the buffer with other subscriptions (NULL = private)
  */
 streaming_target_t *timeshift_create
-  (streaming_target_t *out, time_t max_time)
+  (streaming_target_t *out, time_t max_time, channel_t *ch)
 {
   timeshift_t *ts = calloc(1, sizeof(timeshift_t));
+  timeshift_buffer_t *tsb = NULL;
 
   /* Must hold global lock */
   lock_assert(&global_lock);
 
+  /* Find buffer (on-demand buffers follow the instance) */
+  if (timeshift_ondemand)
+    ch = NULL;
+  if (ch)
+    LIST_FOREACH(tsb, &timeshift_buffers, link)
+      if (tsb->chid == ch->ch_id)
+        break;
+  if (!tsb)
+    tsb = timeshift_buffer_create(timeshift_index, ch ? ch->ch_id : 0);
+
   /* Setup structure */
-  TAILQ_INIT(&ts->files);
   ts->output     = out;
-  ts->path       = NULL;
   ts->max_time   = max_time;
   ts->state      = TS_INIT;
-  ts->full       = 0;
-  ts->vididx     = -1;
   ts->id         = timeshift_index;
   ts->ondemand   = timeshift_ondemand;
   ts->pts_delta  = PTS_UNSET;
-  pthread_mutex_init(&ts->rdwr_mutex, NULL);
+  ts->buf        = tsb;
   pthread_mutex_init(&ts->state_mutex, NULL);
 
+  /* Attach to buffer */
+  pthread_mutex_lock(&tsb->feed_mutex);
+  if (!tsb->refcount || max_time > tsb->max_time)
+    tsb->max_time = max_time;
+  tsb->refcount++;
+  LIST_INSERT_HEAD(&tsb->instances, ts, buf_link);
+  if (!tsb->feeder) {
+    tsb->feeder    = ts;
+    ts->pts_offset = 0;
+  } else {
+    ts->pts_offset = PTS_UNSET;
+    tvhlog(LOG_DEBUG, "timeshift", "ts %d shares buffer %d", ts->id, tsb->id);
+  }
+  pthread_mutex_unlock(&tsb->feed_mutex);
+
   /* Initialise output */
   tvh_pipe(O_NONBLOCK, &ts->rd_pipe);
 
   /* Initialise input */
-  streaming_queue_init(&ts->wr_queue, 0);
   streaming_target_init(&ts->input, timeshift_input, ts, 0);
-  pthread_create(&ts->wr_thread, NULL, timeshift_writer, ts);
   pthread_create(&ts->rd_thread, NULL, timeshift_reader, ts);
 
   /* Update index */
@@ -26,6 +26,7 @@ extern int       timeshift_unlimited_period;
 extern uint32_t  timeshift_max_period;
 extern int       timeshift_unlimited_size;
 extern uint64_t  timeshift_max_size;
+extern uint64_t  timeshift_ram_size;
 extern uint64_t  timeshift_total_size;
 
 typedef struct timeshift_status
@@ -34,14 +35,17 @@ typedef struct timeshift_status
   int64_t shift;
   int64_t pts_start;
   int64_t pts_end;
+  int64_t index_size;
 } timeshift_status_t;
 
 void timeshift_init ( void );
 void timeshift_term ( void );
 void timeshift_save ( void );
 
+struct channel;
+
 streaming_target_t *timeshift_create
-  (streaming_target_t *out, time_t max_period);
+  (streaming_target_t *out, time_t max_period, struct channel *ch);
 
 void timeshift_destroy(streaming_target_t *pad);
 
@@ -19,21 +19,72 @@
 #ifndef __TVH_TIMESHIFT_PRIVATE_H__
 #define __TVH_TIMESHIFT_PRIVATE_H__
 
+#include <sys/uio.h>
+
 #define TIMESHIFT_PLAY_BUF    2000000 // us to buffer in TX
 #define TIMESHIFT_FILE_PERIOD      60 // number of secs in each buffer file
 
+#define TIMESHIFT_WBUF_IOV        256 // max. iovecs in one writev()
+#define TIMESHIFT_WBUF_STAGE    16384 // staging area for small data
+#define TIMESHIFT_WBUF_FLUSH   262144 // bytes pending before flush
+#define TIMESHIFT_WBUF_COPY       512 // payloads smaller are copied
+#define TIMESHIFT_RBUF_SIZE    131072 // reader block size
+#define TIMESHIFT_RAM_BLOCK    524288 // RAM segment block size
+
 /**
- * Indexes of import data in the stream
+ * Buffer file record (native byte order, files don't outlive the process)
+ */
+typedef struct timeshift_record
+{
+  uint32_t                            size;   ///< Record size (0 = EOF)
+  uint32_t                            type;   ///< Message type
+  int64_t                             time;   ///< Message time
+} __attribute__((packed)) timeshift_record_t;
+
+/**
+ * SMT_PACKET record body, followed by header and payload data
+ */
+typedef struct timeshift_record_pkt
+{
+  int64_t                             pts;
+  int64_t                             dts;
+  int32_t                             duration;
+  uint32_t                            hdrlen;
+  uint32_t                            datalen;
+  uint16_t                            aspect_num;
+  uint16_t                            aspect_den;
+  uint8_t                             commercial;
+  uint8_t                             componentindex;
+  uint8_t                             frametype;
+  uint8_t                             field;
+  uint8_t                             channels;
+  uint8_t                             sri;
+  uint8_t                             err;
+} __attribute__((packed)) timeshift_record_pkt_t;
+
+/**
+ * Pending writes, small data is copied to the staging area while larger
+ * payloads are referenced, all are written out with a single writev()
+ */
+typedef struct timeshift_wbuf
+{
+  struct iovec                        iov[TIMESHIFT_WBUF_IOV];
+  pktbuf_t                           *ref[TIMESHIFT_WBUF_IOV];
+  int                                 iovcnt;
+  size_t                              len;    ///< Bytes pending
+  size_t                              stage_len;
+  uint8_t                             stage[TIMESHIFT_WBUF_STAGE];
+} timeshift_wbuf_t;
+
+/**
+ * Video I-frame (seek point), kept in time order per file
  */
 typedef struct timeshift_index_iframe
 {
   off_t                               pos;    ///< Position in the file
   int64_t                             time;   ///< Packet time
-  TAILQ_ENTRY(timeshift_index_iframe) link;   ///< List entry
 } timeshift_index_iframe_t;
 
-typedef TAILQ_HEAD(timeshift_index_iframe_list,timeshift_index_iframe) timeshift_index_iframe_list_t;
-
 /**
  * Indexes of import data in the stream
  */
@@ -47,22 +98,32 @@ typedef struct timeshift_index_data
 typedef TAILQ_HEAD(timeshift_index_data_list,timeshift_index_data) timeshift_index_data_list_t;
 
 /**
- * Timeshift file
+ * Timeshift file (a disk file or a list of RAM blocks)
  */
 typedef struct timeshift_file
 {
   int                           fd;       ///< Write descriptor
+  timeshift_wbuf_t              *wbuf;    ///< Pending writes
   char                          *path;    ///< Full path to file
 
+  uint8_t                       ram;      ///< Stored in RAM
+  uint8_t                       **ram_blk;///< RAM blocks
+  int                           ram_cnt;  ///< RAM blocks in use
+  int                           ram_max;  ///< RAM block slots
+  size_t                        ram_len;  ///< RAM write position
+
   time_t                        time;     ///< Files coarse timestamp
   size_t                        size;     ///< Current file size;
   int64_t                       last;     ///< Latest timestamp
 
   uint8_t                       bad;      ///< File is broken
+  uint8_t                       closed;   ///< No more writes
 
   int                           refcount; ///< Reader ref count
 
-  timeshift_index_iframe_list_t iframes;  ///< I-frame indexing
+  timeshift_index_iframe_t      *iframes; ///< I-frame indexing
+  int                           iframes_cnt;
+  int                           iframes_max;
   timeshift_index_data_list_t   sstart;   ///< Stream start messages
 
   TAILQ_ENTRY(timeshift_file) link;     ///< List entry
@@ -70,6 +131,45 @@ typedef struct timeshift_file
 
 typedef TAILQ_HEAD(timeshift_file_list,timeshift_file) timeshift_file_list_t;
 
+struct timeshift;
+
+/**
+ * Buffer, written once and read by all timeshift instances attached
+ *
+ * Instances of the same channel share a buffer (unless on-demand or
+ * transcoded), each keeps its own read position. The stream of one
+ * instance (the feeder) is recorded, PTS/DTS in the buffer are those of
+ * the first feeder and translated with a per instance offset.
+ */
+typedef struct timeshift_buffer {
+  int                         id;         ///< Reference number
+  int                         chid;       ///< Shared channel (0 = private)
+  int                         refcount;   ///< Attached instances
+  LIST_ENTRY(timeshift_buffer) link;      ///< Shared buffers
+
+  char                        *path;      ///< Directory containing buffer
+  time_t                      max_time;   ///< Maximum period to shift
+  uint8_t                     full;       ///< Buffer is full
+  int                         vididx;     ///< Index of (current) video stream
+
+  streaming_queue_t           wr_queue;   ///< Writer queue
+  pthread_t                   wr_thread;  ///< Writer thread
+
+  pthread_mutex_t             rdwr_mutex; ///< Buffer protection
+  timeshift_file_list_t       files;      ///< List of files
+
+  timeshift_file_t            **fidx;     ///< Files with I-frames (time order)
+  int                         fidx_off;   ///< First used slot
+  int                         fidx_cnt;   ///< Used slots
+  int                         fidx_max;   ///< Allocated slots
+  size_t                      index_size; ///< Bytes used by the indexes
+
+  pthread_mutex_t             feed_mutex; ///< Protects the fields below
+  struct timeshift            *feeder;    ///< Instance being recorded
+  int64_t                     pts_delta;  ///< Delta between clock and buffer PTS
+  LIST_HEAD(,timeshift)       instances;  ///< Attached instances
+} timeshift_buffer_t;
+
 /**
  *
  */
@@ -79,7 +179,6 @@ typedef struct timeshift {
   streaming_target_t          *output;    ///< Output dest
 
   int                         id;         ///< Reference number
-  char                        *path;      ///< Directory containing buffer
   time_t                      max_time;   ///< Maximum period to shift
   int                         ondemand;   ///< Whether this is an on-demand timeshift
   int64_t                     pts_delta;  ///< Delta between system clock and PTS
@@ -92,37 +191,44 @@ typedef struct timeshift {
     TS_PLAY,
   }                           state;       ///< Play state
   pthread_mutex_t             state_mutex; ///< Protect state changes
-  uint8_t                     full;        ///< Buffer is full
   
   streaming_start_t          *smt_start;   ///< Current stream makeup
 
-  streaming_queue_t           wr_queue;   ///< Writer queue
-  pthread_t                   wr_thread;  ///< Writer thread
-
   pthread_t                   rd_thread;  ///< Reader thread
   th_pipe_t                   rd_pipe;    ///< Message passing to reader
 
-  pthread_mutex_t             rdwr_mutex; ///< Buffer protection
-  timeshift_file_list_t       files;      ///< List of files
+  timeshift_buffer_t          *buf;       ///< Buffer
+  LIST_ENTRY(timeshift)       buf_link;   ///< Buffer instances
 
-  int                         vididx;     ///< Index of (current) video stream
+  int64_t                     pts_offset; ///< Own PTS - buffer PTS (feed_mutex)
+  pktbuf_t                    *sync_pb;   ///< Last payload seen (feed_mutex)
+  int64_t                     sync_dts;   ///< DTS of the above
+  char                        *source;    ///< Service feeding it (feed_mutex)
 
 } timeshift_t;
 
 /*
- * Write functions
+ * Write functions (buffer file, rdwr_mutex must be held)
+ */
+ssize_t timeshift_write_sigstat
+  ( timeshift_file_t *tsf, int64_t time, signal_status_t *ss );
+ssize_t timeshift_write_packet
+  ( timeshift_file_t *tsf, int64_t time, th_pkt_t *pkt );
+ssize_t timeshift_write_mpegts
+  ( timeshift_file_t *tsf, int64_t time, void *data );
+ssize_t timeshift_write_eof     ( timeshift_file_t *tsf );
+int     timeshift_write_flush   ( timeshift_file_t *tsf );
+void    timeshift_write_discard ( timeshift_file_t *tsf );
+
+/*
+ * Write functions (control pipe, one write per message)
  */
-ssize_t timeshift_write_start   ( int fd, int64_t time, streaming_start_t *ss );
-ssize_t timeshift_write_sigstat ( int fd, int64_t time, signal_status_t *ss );
-ssize_t timeshift_write_packet  ( int fd, int64_t time, th_pkt_t *pkt );
-ssize_t timeshift_write_mpegts  ( int fd, int64_t time, void *data );
 ssize_t timeshift_write_skip    ( int fd, streaming_skip_t *skip );
 ssize_t timeshift_write_speed   ( int fd, int speed );
 ssize_t timeshift_write_stop    ( int fd, int code );
 ssize_t timeshift_write_exit    ( int fd );
-ssize_t timeshift_write_eof     ( int fd );
 
-void timeshift_writer_flush ( timeshift_t *ts );
+void timeshift_writer_flush ( timeshift_buffer_t *tsb );
 
 /*
  * Threads
@@ -133,23 +239,39 @@ void *timeshift_writer ( void *p );
 /*
  * File management
  */
+extern uint64_t timeshift_total_ram_size;
+
 void timeshift_filemgr_init     ( void );
 void timeshift_filemgr_term     ( void );
 int  timeshift_filemgr_makedirs ( int ts_index, char *buf, size_t len );
 
 timeshift_file_t *timeshift_filemgr_get
-  ( timeshift_t *ts, int create );
+  ( timeshift_buffer_t *tsb, int create );
 timeshift_file_t *timeshift_filemgr_oldest
-  ( timeshift_t *ts );
+  ( timeshift_buffer_t *tsb );
 timeshift_file_t *timeshift_filemgr_newest
-  ( timeshift_t *ts );
+  ( timeshift_buffer_t *tsb );
 timeshift_file_t *timeshift_filemgr_prev
   ( timeshift_file_t *ts, int *end, int keep );
 timeshift_file_t *timeshift_filemgr_next
   ( timeshift_file_t *ts, int *end, int keep );
 void timeshift_filemgr_remove
-  ( timeshift_t *ts, timeshift_file_t *tsf, int force );
-void timeshift_filemgr_flush ( timeshift_t *ts, timeshift_file_t *end );
+  ( timeshift_buffer_t *tsb, timeshift_file_t *tsf, int force );
+void timeshift_filemgr_flush ( timeshift_buffer_t *tsb, timeshift_file_t *end );
 void timeshift_filemgr_close ( timeshift_file_t *tsf );
+size_t timeshift_filemgr_read
+  ( timeshift_buffer_t *tsb, timeshift_file_t *tsf,
+    void *buf, size_t len, off_t off );
+
+/*
+ * Seek index (rdwr_mutex must be held)
+ */
+void timeshift_filemgr_index
+  ( timeshift_buffer_t *tsb, timeshift_file_t *tsf, off_t pos, int64_t time );
+int  timeshift_filemgr_seek
+  ( timeshift_buffer_t *tsb, int64_t time, int back,
+    timeshift_file_t **tsf, timeshift_index_iframe_t *ti );
+int  timeshift_filemgr_range
+  ( timeshift_buffer_t *tsb, int64_t *first, int64_t *last );
 
 #endif /* __TVH_TIMESHIFT_PRIVATE_H__ */
@@ -39,6 +39,7 @@ static pthread_mutex_t       timeshift_reaper_lock;
 static pthread_cond_t        timeshift_reaper_cond;
 
 uint64_t                     timeshift_total_size;
+uint64_t                     timeshift_total_ram_size;
 
 /* **************************************************************************
  * File reaper thread
@@ -48,9 +49,9 @@ static void* timeshift_reaper_callback ( void *p )
 {
   char *dpath;
   timeshift_file_t *tsf;
-  timeshift_index_iframe_t *ti;
   timeshift_index_data_t *tid;
   streaming_message_t *sm;
+  int i;
   pthread_mutex_lock(&timeshift_reaper_lock);
   while (timeshift_reaper_run) {
 
@@ -63,21 +64,26 @@ static void* timeshift_reaper_callback ( void *p )
     TAILQ_REMOVE(&timeshift_reaper_list, tsf, link);
     pthread_mutex_unlock(&timeshift_reaper_lock);
 
-    tvhtrace("timeshift", "remove file %s", tsf->path);
-
     /* Remove */
-    unlink(tsf->path);
-    dpath = dirname(tsf->path);
-    if (rmdir(dpath) == -1)
-      if (errno != ENOTEMPTY)
-        tvhlog(LOG_ERR, "timeshift", "failed to remove %s [e=%s]",
-               dpath, strerror(errno));
+    if (tsf->ram) {
+      tvhtrace("timeshift", "remove ram segment %"PRItime_t, tsf->time);
+      for (i = 0; i < tsf->ram_cnt; i++)
+        free(tsf->ram_blk[i]);
+      free(tsf->ram_blk);
+      atomic_add_u64(&timeshift_total_ram_size,
+                     -(int64_t)tsf->ram_cnt * TIMESHIFT_RAM_BLOCK);
+    } else {
+      tvhtrace("timeshift", "remove file %s", tsf->path);
+      unlink(tsf->path);
+      dpath = dirname(tsf->path);
+      if (rmdir(dpath) == -1)
+        if (errno != ENOTEMPTY)
+          tvhlog(LOG_ERR, "timeshift", "failed to remove %s [e=%s]",
+                 dpath, strerror(errno));
+    }
 
     /* Free memory */
-    while ((ti = TAILQ_FIRST(&tsf->iframes))) {
-      TAILQ_REMOVE(&tsf->iframes, ti, link);
-      free(ti);
-    }
+    free(tsf->iframes);
     while ((tid = TAILQ_FIRST(&tsf->sstart))) {
       TAILQ_REMOVE(&tsf->sstart, tid, link);
       sm = tid->data;
@@ -94,7 +100,7 @@ static void* timeshift_reaper_callback ( void *p )
 
 static void timeshift_reaper_remove ( timeshift_file_t *tsf )
 {
-  tvhtrace("timeshift", "queue file for removal %s", tsf->path);
+  tvhtrace("timeshift", "queue file for removal %s", tsf->path ?: "(ram)");
   pthread_mutex_lock(&timeshift_reaper_lock);
   TAILQ_INSERT_TAIL(&timeshift_reaper_list, tsf, link);
   pthread_cond_signal(&timeshift_reaper_cond);
@@ -131,31 +137,194 @@ int timeshift_filemgr_makedirs ( int index, char *buf, size_t len )
   return makedirs(buf, 0700);
 }
 
+/* **************************************************************************
+ * Seek index
+ * *************************************************************************/
+
+/*
+ * Add I-frame, the first one also adds the file to the buffer index
+ */
+void timeshift_filemgr_index
+  ( timeshift_buffer_t *tsb, timeshift_file_t *tsf, off_t pos, int64_t time )
+{
+  timeshift_index_iframe_t *ti;
+
+  if (tsf->iframes_cnt == tsf->iframes_max) {
+    tsf->iframes_max = MAX(64, tsf->iframes_max * 2);
+    tsf->iframes = realloc(tsf->iframes,
+                           tsf->iframes_max * sizeof(timeshift_index_iframe_t));
+    tsb->index_size += (tsf->iframes_max - tsf->iframes_cnt) *
+                       sizeof(timeshift_index_iframe_t);
+  }
+  ti = &tsf->iframes[tsf->iframes_cnt++];
+  ti->pos  = pos;
+  ti->time = time;
+
+  if (tsf->iframes_cnt > 1)
+    return;
+  if (tsb->fidx_off + tsb->fidx_cnt == tsb->fidx_max) {
+    if (tsb->fidx_off) {
+      memmove(tsb->fidx, tsb->fidx + tsb->fidx_off,
+              tsb->fidx_cnt * sizeof(timeshift_file_t*));
+      tsb->fidx_off = 0;
+    } else {
+      tsb->index_size -= tsb->fidx_max * sizeof(timeshift_file_t*);
+      tsb->fidx_max    = MAX(16, tsb->fidx_max * 2);
+      tsb->fidx        = realloc(tsb->fidx,
+                                 tsb->fidx_max * sizeof(timeshift_file_t*));
+      tsb->index_size += tsb->fidx_max * sizeof(timeshift_file_t*);
+    }
+  }
+  tsb->fidx[tsb->fidx_off + tsb->fidx_cnt++] = tsf;
+}
+
+/*
+ * Drop file from the buffer index (files go from the head)
+ */
+static void timeshift_filemgr_unindex
+  ( timeshift_buffer_t *tsb, timeshift_file_t *tsf )
+{
+  timeshift_file_t **fidx = tsb->fidx + tsb->fidx_off;
+  int i;
+
+  tsb->index_size -= tsf->iframes_max * sizeof(timeshift_index_iframe_t);
+  if (!tsf->iframes_cnt)
+    return;
+  for (i = 0; i < tsb->fidx_cnt; i++)
+    if (fidx[i] == tsf)
+      break;
+  if (i == tsb->fidx_cnt)
+    return;
+  if (i == 0)
+    tsb->fidx_off++;
+  else
+    memmove(fidx + i, fidx + i + 1,
+            (tsb->fidx_cnt - i - 1) * sizeof(timeshift_file_t*));
+  if (--tsb->fidx_cnt == 0)
+    tsb->fidx_off = 0;
+}
+
+/*
+ * Number of I-frames at or before time
+ */
+static int timeshift_filemgr_bsearch ( timeshift_file_t *tsf, int64_t time )
+{
+  int lo = 0, hi = tsf->iframes_cnt, mid;
+  while (lo < hi) {
+    mid = (lo + hi) / 2;
+    if (tsf->iframes[mid].time <= time)
+      lo = mid + 1;
+    else
+      hi = mid;
+  }
+  return lo;
+}
+
+/*
+ * Find the I-frame at/before (back) or at/after time
+ *
+ * Returns -1/1 if time is beyond the start/end of the buffer (the first/
+ * last I-frame is returned then). The file is referenced.
+ */
+int timeshift_filemgr_seek
+  ( timeshift_buffer_t *tsb, int64_t time, int back,
+    timeshift_file_t **tsfp, timeshift_index_iframe_t *ti )
+{
+  timeshift_file_t *tsf, **fidx = tsb->fidx + tsb->fidx_off;
+  int lo = 0, hi = tsb->fidx_cnt, mid, i, end = 0;
+
+  *tsfp = NULL;
+  if (!tsb->fidx_cnt)
+    return back ? -1 : 1;
+
+  /* Last file starting at/before time */
+  while (lo < hi) {
+    mid = (lo + hi) / 2;
+    if (fidx[mid]->iframes[0].time <= time)
+      lo = mid + 1;
+    else
+      hi = mid;
+  }
+
+  /* Before the first I-frame */
+  if (lo == 0) {
+    tsf = fidx[0];
+    i   = 0;
+    if (back)
+      end = -1;
+
+  /* Within the file or the start of the next */
+  } else {
+    tsf = fidx[lo - 1];
+    i   = timeshift_filemgr_bsearch(tsf, time);
+    if (back || tsf->iframes[i - 1].time == time) {
+      i--;
+    } else if (i == tsf->iframes_cnt) {
+      if (lo < tsb->fidx_cnt) {
+        tsf = fidx[lo];
+        i   = 0;
+      } else {
+        i   = tsf->iframes_cnt - 1;
+        end = 1;
+      }
+    }
+  }
+
+  tsf->refcount++;
+  *tsfp = tsf;
+  *ti   = tsf->iframes[i];
+  return end;
+}
+
+/*
+ * Time of the first and last I-frame, returns the number of
+ * I-frames (up to 2)
+ */
+int timeshift_filemgr_range
+  ( timeshift_buffer_t *tsb, int64_t *first, int64_t *last )
+{
+  timeshift_file_t *fst, *lst;
+
+  if (!tsb->fidx_cnt)
+    return 0;
+  fst    = tsb->fidx[tsb->fidx_off];
+  lst    = tsb->fidx[tsb->fidx_off + tsb->fidx_cnt - 1];
+  *first = fst->iframes[0].time;
+  *last  = lst->iframes[lst->iframes_cnt - 1].time;
+  return (fst != lst || fst->iframes_cnt > 1) ? 2 : 1;
+}
+
 /*
  * Close file
  */
 void timeshift_filemgr_close ( timeshift_file_t *tsf )
 {
-  ssize_t r = timeshift_write_eof(tsf->fd);
+  ssize_t r = timeshift_write_eof(tsf);
   if (r > 0)
   {
     tsf->size += r;
     atomic_add_u64(&timeshift_total_size, r);
   }
-  close(tsf->fd);
-  tsf->fd = -1;
+  timeshift_write_discard(tsf);
+  if (tsf->fd != -1)
+    close(tsf->fd);
+  tsf->fd     = -1;
+  tsf->closed = 1;
 }
 
 /*
  * Remove file
  */
 void timeshift_filemgr_remove
-  ( timeshift_t *ts, timeshift_file_t *tsf, int force )
+  ( timeshift_buffer_t *tsb, timeshift_file_t *tsf, int force )
 {
+  timeshift_write_discard(tsf);
   if (tsf->fd != -1)
     close(tsf->fd);
-  tvhlog(LOG_DEBUG, "timeshift", "ts %d remove %s", ts->id, tsf->path);
-  TAILQ_REMOVE(&ts->files, tsf, link);
+  tvhlog(LOG_DEBUG, "timeshift", "ts %d remove %s", tsb->id,
+         tsf->path ?: "(ram)");
+  TAILQ_REMOVE(&tsb->files, tsf, link);
+  timeshift_filemgr_unindex(tsb, tsf);
   atomic_add_u64(&timeshift_total_size, -tsf->size);
   timeshift_reaper_remove(tsf);
 }
@@ -163,19 +332,52 @@ void timeshift_filemgr_remove
 /*
  * Flush all files
  */
-void timeshift_filemgr_flush ( timeshift_t *ts, timeshift_file_t *end )
+void timeshift_filemgr_flush ( timeshift_buffer_t *tsb, timeshift_file_t *end )
 {
   timeshift_file_t *tsf;
-  while ((tsf = TAILQ_FIRST(&ts->files))) {
+  while ((tsf = TAILQ_FIRST(&tsb->files))) {
     if (tsf == end) break;
-    timeshift_filemgr_remove(ts, tsf, 1);
+    timeshift_filemgr_remove(tsb, tsf, 1);
   }
 }
 
+/*
+ * Read from a RAM segment (rdwr_mutex must NOT be held)
+ */
+size_t timeshift_filemgr_read
+  ( timeshift_buffer_t *tsb, timeshift_file_t *tsf,
+    void *buf, size_t len, off_t off )
+{
+  size_t r = 0, o, n;
+
+  pthread_mutex_lock(&tsb->rdwr_mutex);
+  if (off < tsf->size)
+    len = MIN(len, tsf->size - off);
+  else
+    len = 0;
+  while (r < len) {
+    o = (off + r) % TIMESHIFT_RAM_BLOCK;
+    n = MIN(len - r, TIMESHIFT_RAM_BLOCK - o);
+    memcpy(buf + r, tsf->ram_blk[(off + r) / TIMESHIFT_RAM_BLOCK] + o, n);
+    r += n;
+  }
+  pthread_mutex_unlock(&tsb->rdwr_mutex);
+  return r;
+}
+
+/*
+ * RAM budget exhausted
+ */
+static inline int timeshift_filemgr_ram_full ( void )
+{
+  return atomic_pre_add_u64(&timeshift_total_ram_size, 0) +
+         TIMESHIFT_RAM_BLOCK > timeshift_ram_size;
+}
+
 /*
  * Get current / new file
  */
-timeshift_file_t *timeshift_filemgr_get ( timeshift_t *ts, int create )
+timeshift_file_t *timeshift_filemgr_get ( timeshift_buffer_t *tsb, int create )
 {
   int fd;
   struct timespec tp;
@@ -186,33 +388,45 @@ timeshift_file_t *timeshift_filemgr_get ( timeshift_t *ts, int create )
 
   /* Return last file */
   if (!create)
-    return timeshift_filemgr_newest(ts);
+    return timeshift_filemgr_newest(tsb);
 
   /* No space */
-  if (ts->full)
-    return NULL;
+  if (tsb->full) {
+    if (!tsb->chid)
+      return NULL;
+
+    /* Shared, resume once the oldest file is released */
+    tsf_hd = TAILQ_FIRST(&tsb->files);
+    if (tsf_hd && tsf_hd->refcount)
+      return NULL;
+    if (tsf_hd)
+      timeshift_filemgr_remove(tsb, tsf_hd, 0);
+    tvhlog(LOG_DEBUG, "timeshift", "ts %d buffer resumed", tsb->id);
+    tsb->full = 0;
+  }
 
   /* Store to file */
   clock_gettime(CLOCK_MONOTONIC_COARSE, &tp);
   time   = tp.tv_sec / TIMESHIFT_FILE_PERIOD;
-  tsf_tl = TAILQ_LAST(&ts->files, timeshift_file_list);
-  if (!tsf_tl || tsf_tl->time != time) {
-    tsf_hd = TAILQ_FIRST(&ts->files);
+  tsf_tl = TAILQ_LAST(&tsb->files, timeshift_file_list);
+  if (!tsf_tl || tsf_tl->time != time || tsf_tl->closed ||
+      (tsf_tl->ram && timeshift_filemgr_ram_full())) {
+    tsf_hd = TAILQ_FIRST(&tsb->files);
 
     /* Close existing */
-    if (tsf_tl && tsf_tl->fd != -1)
+    if (tsf_tl && !tsf_tl->closed)
       timeshift_filemgr_close(tsf_tl);
 
     /* Check period */
-    if (ts->max_time && tsf_hd && tsf_tl) {
+    if (tsb->max_time && tsf_hd && tsf_tl) {
       time_t d = (tsf_tl->time - tsf_hd->time) * TIMESHIFT_FILE_PERIOD;
-      if (d > (ts->max_time+5)) {
+      if (d > (tsb->max_time+5)) {
         if (!tsf_hd->refcount) {
-          timeshift_filemgr_remove(ts, tsf_hd, 0);
+          timeshift_filemgr_remove(tsb, tsf_hd, 0);
           tsf_hd = NULL;
-        } else {
-          tvhlog(LOG_DEBUG, "timeshift", "ts %d buffer full", ts->id);
-          ts->full = 1;
+        } else if (!tsb->chid) {
+          tvhlog(LOG_DEBUG, "timeshift", "ts %d buffer full", tsb->id);
+          tsb->full = 1;
         }
       }
     }
@@ -223,44 +437,58 @@ timeshift_file_t *timeshift_filemgr_get ( timeshift_t *ts, int create )
 
       /* Remove the last file (if we can) */
       if (tsf_hd && !tsf_hd->refcount) {
-        timeshift_filemgr_remove(ts, tsf_hd, 0);
+        timeshift_filemgr_remove(tsb, tsf_hd, 0);
 
       /* Full */
       } else {
-        tvhlog(LOG_DEBUG, "timeshift", "ts %d buffer full", ts->id);
-        ts->full = 1;
+        tvhlog(LOG_DEBUG, "timeshift", "ts %d buffer full", tsb->id);
+        tsb->full = 1;
       }
     }
       
     /* Create new file */
     tsf_tmp = NULL;
-    if (!ts->full) {
+    if (!tsb->full) {
 
-      /* Create directories */
-      if (!ts->path) {
-        if (timeshift_filemgr_makedirs(ts->id, path, sizeof(path)))
-          return NULL;
-        ts->path = strdup(path);
+      /* RAM segment */
+      if (!timeshift_filemgr_ram_full()) {
+        tvhtrace("timeshift", "ts %d create ram segment %"PRItime_t,
+                 tsb->id, time);
+        tsf_tmp = calloc(1, sizeof(timeshift_file_t));
+        tsf_tmp->fd       = -1;
+        tsf_tmp->ram      = 1;
+
+      /* File */
+      } else {
+
+        /* Create directories */
+        if (!tsb->path) {
+          if (timeshift_filemgr_makedirs(tsb->id, path, sizeof(path)))
+            return NULL;
+          tsb->path = strdup(path);
+        }
+
+        /* Create File */
+        snprintf(path, sizeof(path), "%s/tvh-%"PRItime_t, tsb->path, time);
+        tvhtrace("timeshift", "ts %d create file %s", tsb->id, path);
+        if ((fd = open(path, O_WRONLY | O_CREAT, 0600)) > 0) {
+          tsf_tmp = calloc(1, sizeof(timeshift_file_t));
+          tsf_tmp->fd       = fd;
+          tsf_tmp->path     = strdup(path);
+        }
       }
 
-      /* Create File */
-      snprintf(path, sizeof(path), "%s/tvh-%"PRItime_t, ts->path, time);
-      tvhtrace("timeshift", "ts %d create file %s", ts->id, path);
-      if ((fd = open(path, O_WRONLY | O_CREAT, 0600)) > 0) {
-        tsf_tmp = calloc(1, sizeof(timeshift_file_t));
+      if (tsf_tmp) {
         tsf_tmp->time     = time;
-        tsf_tmp->fd       = fd;
-        tsf_tmp->path     = strdup(path);
         tsf_tmp->refcount = 0;
         tsf_tmp->last     = getmonoclock();
-        TAILQ_INIT(&tsf_tmp->iframes);
         TAILQ_INIT(&tsf_tmp->sstart);
-        TAILQ_INSERT_TAIL(&ts->files, tsf_tmp, link);
+        TAILQ_INSERT_TAIL(&tsb->files, tsf_tmp, link);
 
         /* Copy across last start message */
         if (tsf_tl && (ti = TAILQ_LAST(&tsf_tl->sstart, timeshift_index_data_list))) {
           tvhtrace("timeshift", "ts %d copy smt_start to new file",
-                   ts->id);
+                   tsb->id);
           timeshift_index_data_t *ti2 = calloc(1, sizeof(timeshift_index_data_t));
           ti2->data = streaming_msg_clone(ti->data);
           TAILQ_INSERT_TAIL(&tsf_tmp->sstart, ti2, link);
@@ -302,9 +530,9 @@ timeshift_file_t *timeshift_filemgr_prev
 /*
  * Get the oldest file
  */
-timeshift_file_t *timeshift_filemgr_oldest ( timeshift_t *ts )
+timeshift_file_t *timeshift_filemgr_oldest ( timeshift_buffer_t *tsb )
 {
-  timeshift_file_t *tsf = TAILQ_FIRST(&ts->files);
+  timeshift_file_t *tsf = TAILQ_FIRST(&tsb->files);
   if (tsf)
     tsf->refcount++;
   return tsf;
@@ -313,9 +541,9 @@ timeshift_file_t *timeshift_filemgr_oldest ( timeshift_t *ts )
 /*
  * Get the newest file
  */
-timeshift_file_t *timeshift_filemgr_newest ( timeshift_t *ts )
+timeshift_file_t *timeshift_filemgr_newest ( timeshift_buffer_t *tsb )
 {
-  timeshift_file_t *tsf = TAILQ_LAST(&ts->files, timeshift_file_list);
+  timeshift_file_t *tsf = TAILQ_LAST(&tsb->files, timeshift_file_list);
   if (tsf)
     tsf->refcount++;
   return tsf;
@@ -41,144 +41,217 @@
  * File Reading
  * *************************************************************************/
 
-static ssize_t _read_pktbuf ( int fd, pktbuf_t **pktbuf )
+/*
+ * Block buffer (file data at off .. off + len)
+ */
+typedef struct timeshift_rbuf
 {
-  ssize_t r, cnt = 0;
-  size_t sz;
+  uint8_t *data;
+  size_t   alloc;
+  size_t   len;
+  off_t    off;
+} timeshift_rbuf_t;
 
-  /* Size */
-  r = read(fd, &sz, sizeof(sz));
-  if (r < 0) return -1;
-  if (r != sizeof(sz)) return 0;
-  cnt += r;
+/*
+ * Build a message from a record
+ */
+static int _parse_msg
+  ( const timeshift_record_t *rec, const uint8_t *data, size_t sz,
+    streaming_message_t **sm )
+{
+  const timeshift_record_pkt_t *rp;
+  th_pkt_t *pkt;
+  void *copy;
+  int code;
 
-  /* Empty */
-  if (!sz) {
-    *pktbuf = NULL;
-    return cnt;
-  }
+  switch (rec->type) {
 
-  /* Data */
-  *pktbuf = pktbuf_alloc(NULL, sz);
-  r = read(fd, (*pktbuf)->pb_data, sz);
-  if (r != sz) {
-    free((*pktbuf)->pb_data);
-    free(*pktbuf);
-    return r < 0 ? -1 : 0;
+    /* Code */
+    case SMT_STOP:
+    case SMT_EXIT:
+    case SMT_SPEED:
+      if (sz != sizeof(code)) return -1;
+      memcpy(&code, data, sz);
+      *sm = streaming_msg_create_code(rec->type, code);
+      break;
+
+    /* Packet */
+    case SMT_PACKET:
+      rp = (const timeshift_record_pkt_t*)data;
+      if (sz < sizeof(*rp) || sz != sizeof(*rp) + rp->hdrlen + rp->datalen)
+        return -1;
+      data += sizeof(*rp);
+      pkt = pkt_alloc(data + rp->hdrlen, rp->datalen, rp->pts, rp->dts);
+      if (rp->hdrlen)
+        pkt->pkt_header       = pktbuf_alloc(data, rp->hdrlen);
+      pkt->pkt_duration       = rp->duration;
+      pkt->pkt_aspect_num     = rp->aspect_num;
+      pkt->pkt_aspect_den     = rp->aspect_den;
+      pkt->pkt_commercial     = rp->commercial;
+      pkt->pkt_componentindex = rp->componentindex;
+      pkt->pkt_frametype      = rp->frametype;
+      pkt->pkt_field          = rp->field;
+      pkt->pkt_channels       = rp->channels;
+      pkt->pkt_sri            = rp->sri;
+      pkt->pkt_err            = rp->err;
+      *sm = streaming_msg_create_pkt(pkt);
+      pkt_ref_dec(pkt);
+      break;
+
+    /* Data */
+    case SMT_SKIP:
+    case SMT_SIGNAL_STATUS:
+    case SMT_MPEGTS:
+      copy = malloc(sz);
+      memcpy(copy, data, sz);
+      *sm = streaming_msg_create_data(rec->type, copy);
+      break;
+
+    /* Unhandled */
+    default:
+      return -1;
   }
-  cnt += r;
 
-  return cnt;
+  (*sm)->sm_time = rec->time;
+  return 0;
 }
 
-
+/*
+ * Read a control message from the pipe
+ */
 static ssize_t _read_msg ( int fd, streaming_message_t **sm )
 {
-  ssize_t r, cnt = 0;
+  timeshift_record_t rec;
+  uint8_t data[64];
+  ssize_t r;
   size_t sz;
-  streaming_message_type_t type;
-  int64_t time;
-  void *data;
-  int code;
 
   /* Clear */
   *sm = NULL;
 
-  /* Size */
-  r = read(fd, &sz, sizeof(sz));
+  /* Header */
+  r = read(fd, &rec, sizeof(rec));
   if (r < 0) return -1;
-  if (r != sizeof(sz)) return 0;
-  cnt += r;
-
-  /* EOF */
-  if (sz == 0) return cnt;
+  if (r != sizeof(rec)) return 0;
+  if (rec.size < sizeof(rec)) return -1;
 
-  /* Type */
-  r = read(fd, &type, sizeof(type));
-  if (r < 0) return -1;
-  if (r != sizeof(type)) return 0;
-  cnt += r;
+  /* Data */
+  sz = rec.size - sizeof(rec);
+  if (sz > sizeof(data)) return -1;
+  r = read(fd, data, sz);
+  if (r != sz) return r < 0 ? -1 : 0;
+
+  if (_parse_msg(&rec, data, sz, sm))
+    return -1;
+  return rec.size;
+}
 
-  /* Time */
-  r = read(fd, &time, sizeof(time));
-  if (r < 0) return -1;
-  if (r != sizeof(time)) return 0;
-  cnt += r;
+/*
+ * Make (at least) len bytes at off available
+ */
+static int _read_block
+  ( timeshift_buffer_t *tsb, timeshift_file_t *tsf, int fd,
+    timeshift_rbuf_t *rb, off_t off, size_t len )
+{
+  ssize_t r;
 
-  /* Adjust size */
-  sz -= sizeof(type) + sizeof(time);
-  cnt += sz;
+  if (off >= rb->off && off + len <= rb->off + rb->len)
+    return 0;
 
-  /* Standard messages */
-  switch (type) {
+  len = MAX(len, TIMESHIFT_RBUF_SIZE);
+  if (len > rb->alloc) {
+    rb->alloc = len;
+    rb->data  = realloc(rb->data, len);
+  }
+  if (tsf->ram)
+    r = timeshift_filemgr_read(tsb, tsf, rb->data, len, off);
+  else
+    r = pread(fd, rb->data, len, off);
+  if (r < 0) {
+    rb->len = 0;
+    return -1;
+  }
+  rb->off = off;
+  rb->len = r;
+  return 0;
+}
 
-    /* Unhandled */
-    case SMT_START:
-    case SMT_NOSTART:
-    case SMT_SERVICE_STATUS:
-      return -1;
-      break;
+/*
+ * Read a record from the buffer file
+ *
+ * Returns the record size, 0 if incomplete (yet), sm is left NULL at EOF
+ */
+static ssize_t _read_rec
+  ( timeshift_buffer_t *tsb, timeshift_file_t *tsf, int fd,
+    timeshift_rbuf_t *rb, off_t off, streaming_message_t **sm )
+{
+  timeshift_record_t rec;
+  const uint8_t *p;
 
-    /* Code */
-    case SMT_STOP:
-    case SMT_EXIT:
-    case SMT_SPEED:
-      if (sz != sizeof(code)) return -1;
-      r = read(fd, &code, sz);
-      if (r != sz) {
-        if (r < 0) return -1;
-        return 0;
-      }
-      *sm = streaming_msg_create_code(type, code);
-      break;
+  /* Clear */
+  *sm = NULL;
 
-    /* Data */
-    case SMT_SKIP:
-    case SMT_SIGNAL_STATUS:
-    case SMT_MPEGTS:
-    case SMT_PACKET:
-      data = malloc(sz);
-      r = read(fd, data, sz);
-      if (r != sz) {
-        free(data);
-        if (r < 0) return -1;
-        return 0;
-      }
-      if (type == SMT_PACKET) {
-        th_pkt_t *pkt = data;
-        pkt->pkt_payload  = pkt->pkt_header = NULL;
-        pkt->pkt_refcount = 0;
-        *sm = streaming_msg_create_pkt(pkt);
-        r   = _read_pktbuf(fd, &pkt->pkt_header);
-        if (r < 0) {
-          streaming_msg_free(*sm);
-          return r;
-        }
-        cnt += r;
-        r   = _read_pktbuf(fd, &pkt->pkt_payload);
-        if (r < 0) {
-          streaming_msg_free(*sm);
-          return r;
-        }
-        cnt += r;
-      } else {
-        *sm = streaming_msg_create_data(type, data);
-      }
-      (*sm)->sm_time = time;
-      break;
+  /* Header */
+  if (_read_block(tsb, tsf, fd, rb, off, sizeof(rec)))
+    return -1;
+  if (off + sizeof(rec) > rb->off + rb->len)
+    return 0;
+  memcpy(&rec, rb->data + (off - rb->off), sizeof(rec));
 
-    default:
-      return -1;
-  }
+  /* EOF */
+  if (rec.size == 0)
+    return sizeof(rec);
+  if (rec.size < sizeof(rec))
+    return -1;
 
-  /* OK */
-  return cnt;
+  /* Data */
+  if (_read_block(tsb, tsf, fd, rb, off, rec.size))
+    return -1;
+  if (off + rec.size > rb->off + rb->len)
+    return 0;
+  p = rb->data + (off - rb->off);
+
+  /* Control messages are not stored */
+  if (rec.type == SMT_START || rec.type == SMT_NOSTART ||
+      rec.type == SMT_SERVICE_STATUS)
+    return -1;
+  if (_parse_msg(&rec, p + sizeof(rec), rec.size - sizeof(rec), sm))
+    return -1;
+  return rec.size;
 }
 
 /* **************************************************************************
  * Utilities
  * *************************************************************************/
 
+/*
+ * Own PTS - buffer PTS, PTS_UNSET until the input is synchronised
+ */
+static int64_t _timeshift_offset ( timeshift_t *ts )
+{
+  int64_t r;
+  pthread_mutex_lock(&ts->buf->feed_mutex);
+  r = ts->pts_offset;
+  pthread_mutex_unlock(&ts->buf->feed_mutex);
+  return r;
+}
+
+/*
+ * Stream makeup unchanged (shared buffers hold the feeder's start message)
+ */
+static int _timeshift_sstart_equal
+  ( streaming_start_t *a, streaming_start_t *b )
+{
+  int i;
+  if (!a || !b || a->ss_num_components != b->ss_num_components)
+    return 0;
+  for (i = 0; i < a->ss_num_components; i++)
+    if (a->ss_components[i].ssc_index != b->ss_components[i].ssc_index ||
+        a->ss_components[i].ssc_type  != b->ss_components[i].ssc_type)
+      return 0;
+  return 1;
+}
+
 static streaming_message_t *_timeshift_find_sstart
   ( timeshift_file_t *tsf, int64_t time )
 {
@@ -192,144 +265,29 @@ static streaming_message_t *_timeshift_find_sstart
   return ti ? ti->data : NULL;
 }
 
-static timeshift_index_iframe_t *_timeshift_first_frame
-  ( timeshift_t *ts )
-{ 
-  int end;
-  timeshift_index_iframe_t *tsi = NULL;
-  timeshift_file_t *tsf = timeshift_filemgr_oldest(ts);
-  while (tsf && !tsi) {
-    if (!(tsi = TAILQ_FIRST(&tsf->iframes))) {
-      tsf = timeshift_filemgr_next(tsf, &end, 0);
-    }
-  }
-  if (tsf)
-    tsf->refcount--;
-  return tsi;
-}
-
-static timeshift_index_iframe_t *_timeshift_last_frame
-  ( timeshift_t *ts )
-{
-  int end;
-  timeshift_index_iframe_t *tsi = NULL;
-  timeshift_file_t *tsf = timeshift_filemgr_get(ts, 0);
-  while (tsf && !tsi) {
-    if (!(tsi = TAILQ_LAST(&tsf->iframes, timeshift_index_iframe_list))) {
-      tsf = timeshift_filemgr_prev(tsf, &end, 0);
-    }
-  }
-  if (tsf)
-    tsf->refcount--;
-  return tsi;
-}
-
-static int _timeshift_skip
-  ( timeshift_t *ts, int64_t req_time, int64_t cur_time,
-    timeshift_file_t *cur_file, timeshift_file_t **new_file,
-    timeshift_index_iframe_t **iframe )
-{
-  timeshift_index_iframe_t *tsi  = *iframe;
-  timeshift_file_t         *tsf  = cur_file;
-  int64_t                   sec  = req_time / (1000000 * TIMESHIFT_FILE_PERIOD);
-  int                       back = (req_time < cur_time) ? 1 : 0;
-  int                       end  = 0;
-  
-  /* Hold local ref */
-  if (cur_file)
-    cur_file->refcount++;
-
-  /* Coarse search */
-  if (!tsi) {
-    while (tsf && !end) {
-      if (back) {
-        if ((tsf->time <= sec) &&
-            (tsi = TAILQ_LAST(&tsf->iframes, timeshift_index_iframe_list)))
-          break;
-        tsf = timeshift_filemgr_prev(tsf, &end, 1);
-      } else {
-        if ((tsf->time >= sec) &&
-            (tsi = TAILQ_FIRST(&tsf->iframes)))
-          break;
-        tsf = timeshift_filemgr_next(tsf, &end, 0);
-      }
-      tsi = NULL;
-    }
-  }
-
-  /* Fine search */
-  if (back) {
-    while (!end && tsf && tsi && (tsi->time > req_time)) {
-      tsi = TAILQ_PREV(tsi, timeshift_index_iframe_list, link);
-      while (!end && tsf && !tsi) {
-        if ((tsf = timeshift_filemgr_prev(tsf, &end, 1)))
-          tsi = TAILQ_LAST(&tsf->iframes, timeshift_index_iframe_list);
-      }
-    }
-  } else {
-    while (!end && tsf && tsi && (tsi->time < req_time)) {
-      tsi = TAILQ_NEXT(tsi, link);
-      while (!end && tsf && !tsi) {
-        if ((tsf = timeshift_filemgr_next(tsf, &end, 0)))
-          tsi = TAILQ_FIRST(&tsf->iframes);
-      }
-    }
-  }
-
-  /* End */
-  if (!tsf || !tsi)
-    end = 1;
-
-  /* Find start/end of buffer */
-  if (end) {
-    if (back) {
-      tsf = timeshift_filemgr_oldest(ts);
-      tsi = NULL;
-      while (tsf && !tsi) {
-        if (!(tsi = TAILQ_FIRST(&tsf->iframes)))
-          tsf = timeshift_filemgr_next(tsf, &end, 0);
-      }
-      end = -1;
-    } else {
-      tsf = timeshift_filemgr_get(ts, 0);
-      tsi = NULL;
-      while (tsf && !tsi) {
-        if (!(tsi = TAILQ_LAST(&tsf->iframes, timeshift_index_iframe_list)))
-          tsf = timeshift_filemgr_prev(tsf, &end, 0);
-      }
-      end = 1;
-    }
-  }
-
-  if (cur_file)
-    cur_file->refcount--;
-
-  /* Done */
-  *new_file = tsf;
-  *iframe   = tsi;
-  return end;
-}
-
 /*
  * Output packet
  */
 static int _timeshift_read
   ( timeshift_t *ts, timeshift_file_t **cur_file, off_t *cur_off, int *fd,
-    streaming_message_t **sm, int *wait )
+    timeshift_rbuf_t *rb, int64_t pts_offset, streaming_message_t **sm,
+    int *wait )
 {
+  timeshift_buffer_t *tsb = ts->buf;
+
   if (*cur_file) {
 
     /* Open file */
-    if (*fd == -1) {
+    if (*fd == -1 && !(*cur_file)->ram) {
       tvhtrace("timeshift", "ts %d open file %s",
                ts->id, (*cur_file)->path);
       *fd = open((*cur_file)->path, O_RDONLY);
+      rb->len = 0;
     }
-    tvhtrace("timeshift", "ts %d seek to %"PRIoff_t, ts->id, *cur_off);
-    lseek(*fd, *cur_off, SEEK_SET);
+    tvhtrace("timeshift", "ts %d read at %"PRIoff_t, ts->id, *cur_off);
 
     /* Read msg */
-    ssize_t r = _read_msg(*fd, sm);
+    ssize_t r = _read_rec(tsb, *cur_file, *fd, rb, *cur_off, sm);
     if (r < 0) {
       streaming_message_t *e = streaming_msg_create_code(SMT_STOP, SM_CODE_UNDEFINED_ERROR);
       streaming_target_deliver2(ts->output, e);
@@ -340,28 +298,36 @@ static int _timeshift_read
              ts->id, *sm, r);
 
     /* Incomplete */
-    if (r == 0) {
-      lseek(*fd, *cur_off, SEEK_SET);
+    if (r == 0)
       return 0;
-    }
 
     /* Update */
     *cur_off += r;
 
     /* Special case - EOF */
-    if (r == sizeof(size_t) || *cur_off > (*cur_file)->size) {
-      close(*fd);
+    if (!*sm || *cur_off > (*cur_file)->size) {
+      if (*fd != -1)
+        close(*fd);
       *fd       = -1;
-      pthread_mutex_lock(&ts->rdwr_mutex);
+      rb->len   = 0;
+      pthread_mutex_lock(&tsb->rdwr_mutex);
       *cur_file = timeshift_filemgr_next(*cur_file, NULL, 0);
-      pthread_mutex_unlock(&ts->rdwr_mutex);
+      pthread_mutex_unlock(&tsb->rdwr_mutex);
       *cur_off  = 0; // reset
       *wait     = 0;
 
     /* Check SMT_START index */
     } else {
+      if (pts_offset && (*sm)->sm_type == SMT_PACKET) {
+        th_pkt_t *pkt = (*sm)->sm_data;
+        if (pkt->pkt_pts != PTS_UNSET)
+          pkt->pkt_pts += pts_offset;
+        if (pkt->pkt_dts != PTS_UNSET)
+          pkt->pkt_dts += pts_offset;
+      }
       streaming_message_t *ssm = _timeshift_find_sstart(*cur_file, (*sm)->sm_time);
-      if (ssm && ssm->sm_data != ts->smt_start) {
+      if (ssm && ssm->sm_data != ts->smt_start &&
+          (!tsb->chid || !_timeshift_sstart_equal(ssm->sm_data, ts->smt_start))) {
         streaming_target_deliver2(ts->output, streaming_msg_clone(ssm));
         if (ts->smt_start)
           streaming_start_unref(ts->smt_start);
@@ -379,11 +345,13 @@ static int _timeshift_read
  */
 static int _timeshift_flush_to_live
   ( timeshift_t *ts, timeshift_file_t **cur_file, off_t *cur_off, int *fd,
-    streaming_message_t **sm, int *wait )
+    timeshift_rbuf_t *rb, int64_t pts_offset, streaming_message_t **sm,
+    int *wait )
 {
   time_t pts = 0;
   while (*cur_file) {
-    if (_timeshift_read(ts, cur_file, cur_off, fd, sm, wait) == -1)
+    if (_timeshift_read(ts, cur_file, cur_off, fd, rb, pts_offset,
+                        sm, wait) == -1)
       return -1;
     if (!*sm) break;
     if ((*sm)->sm_type == SMT_PACKET) {
@@ -407,14 +375,15 @@ static int _timeshift_flush_to_live
 void *timeshift_reader ( void *p )
 {
   timeshift_t *ts = p;
+  timeshift_buffer_t *tsb = ts->buf;
   int nfds, end, fd = -1, run = 1, wait = -1;
   timeshift_file_t *cur_file = NULL;
   off_t cur_off = 0;
+  timeshift_rbuf_t rb = { NULL, 0, 0, 0 };
   int cur_speed = 100, keyframe_mode = 0;
   int64_t pause_time = 0, play_time = 0, last_time = 0;
-  int64_t now, deliver, skip_time = 0;
+  int64_t now, deliver, skip_time = 0, pts_offset = PTS_UNSET;
   streaming_message_t *sm = NULL, *ctrl = NULL;
-  timeshift_index_iframe_t *tsi = NULL;
   streaming_skip_t *skip = NULL;
   time_t last_status = 0;
   tvhpoll_t *pd;
@@ -443,8 +412,9 @@ void *timeshift_reader ( void *p )
     skip      = NULL;
     now       = getmonoclock();
 
-    /* Control */
+    /* Control (the buffer only changes under state_mutex) */
     pthread_mutex_lock(&ts->state_mutex);
+    tsb = ts->buf;
     if (nfds == 1) {
       if (_read_msg(ts->rd_pipe.rd, &ctrl) > 0) {
 
@@ -480,18 +450,24 @@ void *timeshift_reader ( void *p )
                        ts->id);
                 speed = 100;
 
+              /* Not in sync with the (shared) buffer yet */
+              } else if ((pts_offset = _timeshift_offset(ts)) == PTS_UNSET) {
+                tvhlog(LOG_DEBUG, "timeshift", "ts %d reject, buffer not in sync",
+                       ts->id);
+                speed = 100;
+
               /* Set position */
               } else {
                 tvhlog(LOG_DEBUG, "timeshift", "ts %d enter timeshift mode",
                        ts->id);
-                timeshift_writer_flush(ts);
-                pthread_mutex_lock(&ts->rdwr_mutex);
-                if ((cur_file   = timeshift_filemgr_get(ts, 1))) {
+                timeshift_writer_flush(tsb);
+                pthread_mutex_lock(&tsb->rdwr_mutex);
+                if ((cur_file   = timeshift_filemgr_get(tsb, 1))) {
                   cur_off    = cur_file->size;
                   pause_time = cur_file->last;
                   last_time  = pause_time;
                 }
-                pthread_mutex_unlock(&ts->rdwr_mutex);
+                pthread_mutex_unlock(&tsb->rdwr_mutex);
               }
 
             /* Buffer playback */
@@ -508,9 +484,6 @@ void *timeshift_reader ( void *p )
               tvhlog(LOG_DEBUG, "timeshift", "using keyframe mode? %s",
                      keyframe ? "yes" : "no");
               keyframe_mode = keyframe;
-              if (keyframe) {
-                tsi = NULL;
-              }
             }
 
             /* Update */
@@ -534,12 +507,12 @@ void *timeshift_reader ( void *p )
             case SMT_SKIP_LIVE:
               if (ts->state != TS_LIVE) {
 
-                /* Reset */
-                if (ts->full) {
-                  pthread_mutex_lock(&ts->rdwr_mutex);
-                  timeshift_filemgr_flush(ts, NULL);
-                  ts->full = 0;
-                  pthread_mutex_unlock(&ts->rdwr_mutex);
+                /* Reset (shared buffers recover in the writer) */
+                if (tsb->full && !tsb->chid) {
+                  pthread_mutex_lock(&tsb->rdwr_mutex);
+                  timeshift_filemgr_flush(tsb, NULL);
+                  tsb->full = 0;
+                  pthread_mutex_unlock(&tsb->rdwr_mutex);
                 }
 
                 /* Release */
@@ -567,15 +540,20 @@ void *timeshift_reader ( void *p )
 
               /* Live playback (stage1) */
               if (ts->state == TS_LIVE) {
-                pthread_mutex_lock(&ts->rdwr_mutex);
-                if ((cur_file   = timeshift_filemgr_get(ts, !ts->ondemand))) {
-                  cur_off    = cur_file->size;
-                  last_time  = cur_file->last;
-                } else {
-                  tvhlog(LOG_ERR, "timeshift", "ts %d failed to get current file", ts->id);
+                if ((pts_offset = _timeshift_offset(ts)) == PTS_UNSET) {
+                  tvhlog(LOG_DEBUG, "timeshift", "ts %d skip failed, buffer not in sync", ts->id);
                   skip = NULL;
+                } else {
+                  pthread_mutex_lock(&tsb->rdwr_mutex);
+                  if ((cur_file   = timeshift_filemgr_get(tsb, !ts->ondemand))) {
+                    cur_off    = cur_file->size;
+                    last_time  = cur_file->last;
+                  } else {
+                    tvhlog(LOG_ERR, "timeshift", "ts %d failed to get current file", ts->id);
+                    skip = NULL;
+                  }
+                  pthread_mutex_unlock(&tsb->rdwr_mutex);
                 }
-                pthread_mutex_unlock(&ts->rdwr_mutex);
               }
 
               /* May have failed */
@@ -601,7 +579,6 @@ void *timeshift_reader ( void *p )
                 /* Adjust time */
                 play_time  = now;
                 pause_time = skip_time;
-                tsi        = NULL;
 
                 /* Clear existing packet */
                 if (sm)
@@ -634,15 +611,18 @@ void *timeshift_reader ( void *p )
     if (now >= (last_status + 1000000)) {
       streaming_message_t *tsm;
       timeshift_status_t *status;
-      timeshift_index_iframe_t *fst, *lst;
+      int64_t fst, lst;
+      int frames;
       status = calloc(1, sizeof(timeshift_status_t));
-      fst    = _timeshift_first_frame(ts);
-      lst    = _timeshift_last_frame(ts);
-      status->full  = ts->full;
+      pthread_mutex_lock(&tsb->rdwr_mutex);
+      frames = timeshift_filemgr_range(tsb, &fst, &lst);
+      status->index_size = tsb->index_size;
+      pthread_mutex_unlock(&tsb->rdwr_mutex);
+      status->full  = tsb->full;
       status->shift = ts->state <= TS_LIVE ? 0 : ts_rescale_i(now - last_time, 1000000);
-      if (lst && fst && lst != fst && ts->pts_delta != PTS_UNSET) {
-        status->pts_start = ts_rescale_i(fst->time - ts->pts_delta, 1000000);
-        status->pts_end   = ts_rescale_i(lst->time - ts->pts_delta, 1000000);
+      if (frames > 1 && ts->pts_delta != PTS_UNSET) {
+        status->pts_start = ts_rescale_i(fst - ts->pts_delta, 1000000);
+        status->pts_end   = ts_rescale_i(lst - ts->pts_delta, 1000000);
       } else {
         status->pts_start = PTS_UNSET;
         status->pts_end   = PTS_UNSET;
@@ -669,6 +649,7 @@ void *timeshift_reader ( void *p )
       /* Rewind or Fast forward (i-frame only) */
       if (skip || keyframe_mode) {
         timeshift_file_t *tsf = NULL;
+        timeshift_index_iframe_t tsi;
         int64_t req_time;
 
         /* Time */
@@ -679,31 +660,34 @@ void *timeshift_reader ( void *p )
         tvhlog(LOG_DEBUG, "timeshift", "ts %d skip to %"PRId64" from %"PRId64, ts->id, req_time, last_time);
 
         /* Find */
-        pthread_mutex_lock(&ts->rdwr_mutex);
-        end = _timeshift_skip(ts, req_time, last_time,
-                              cur_file, &tsf, &tsi);
-        pthread_mutex_unlock(&ts->rdwr_mutex);
-        if (tsi)
-          tvhlog(LOG_DEBUG, "timeshift", "ts %d skip found pkt @ %"PRId64, ts->id, tsi->time);
+        pthread_mutex_lock(&tsb->rdwr_mutex);
+        end = timeshift_filemgr_seek(tsb, req_time, req_time < last_time,
+                                     &tsf, &tsi);
+        if (cur_file)
+          cur_file->refcount--;
+        pthread_mutex_unlock(&tsb->rdwr_mutex);
+        if (tsf)
+          tvhlog(LOG_DEBUG, "timeshift", "ts %d skip found pkt @ %"PRId64, ts->id, tsi.time);
 
         /* File changed (close) */
-        if ((tsf != cur_file) && (fd != -1)) {
-          close(fd);
-          fd = -1;
+        if (tsf != cur_file) {
+          if (fd != -1)
+            close(fd);
+          fd     = -1;
+          rb.len = 0;
         }
 
         /* Position */
-        if (cur_file)
-          cur_file->refcount--;
         cur_file = tsf;
-        if (tsi)
-          cur_off = tsi->pos;
+        if (tsf)
+          cur_off = tsi.pos;
         else
           cur_off = 0;
       }
 
       /* Find packet */
-      if (_timeshift_read(ts, &cur_file, &cur_off, &fd, &sm, &wait) == -1) {
+      if (_timeshift_read(ts, &cur_file, &cur_off, &fd, &rb, pts_offset,
+                          &sm, &wait) == -1) {
         pthread_mutex_unlock(&ts->state_mutex);
         break;
       }
@@ -762,7 +746,7 @@ void *timeshift_reader ( void *p )
         end = (cur_speed > 0) ? 1 : -1;
 
       /* Back to live (unless buffer is full) */
-      if (end == 1 && !ts->full) {
+      if (end == 1 && !tsb->full) {
         tvhlog(LOG_DEBUG, "timeshift", "ts %d eob revert to live mode", ts->id);
         ts->state = TS_LIVE;
         cur_speed = 100;
@@ -770,7 +754,8 @@ void *timeshift_reader ( void *p )
         streaming_target_deliver2(ts->output, ctrl);
 
         /* Flush timeshift buffer to live */
-        if (_timeshift_flush_to_live(ts, &cur_file, &cur_off, &fd, &sm, &wait) == -1)
+        if (_timeshift_flush_to_live(ts, &cur_file, &cur_off, &fd, &rb,
+                                     pts_offset, &sm, &wait) == -1)
           break;
 
         /* Close file (if open) */
@@ -778,10 +763,11 @@ void *timeshift_reader ( void *p )
           close(fd);
           fd = -1;
         }
+        rb.len = 0;
 
         /* Flush ALL files */
         if (ts->ondemand)
-          timeshift_filemgr_flush(ts, NULL);
+          timeshift_filemgr_flush(tsb, NULL);
 
       /* Pause */
       } else {
@@ -801,9 +787,9 @@ void *timeshift_reader ( void *p )
 
     /* Flush unwanted */
     } else if (ts->ondemand && cur_file) {
-      pthread_mutex_lock(&ts->rdwr_mutex);
-      timeshift_filemgr_flush(ts, cur_file);
-      pthread_mutex_unlock(&ts->rdwr_mutex);
+      pthread_mutex_lock(&tsb->rdwr_mutex);
+      timeshift_filemgr_flush(tsb, cur_file);
+      pthread_mutex_unlock(&tsb->rdwr_mutex);
     }
 
     pthread_mutex_unlock(&ts->state_mutex);
@@ -812,6 +798,12 @@ void *timeshift_reader ( void *p )
   /* Cleanup */
   tvhpoll_destroy(pd);
   if (fd != -1) close(fd);
+  if (cur_file) {
+    pthread_mutex_lock(&tsb->rdwr_mutex);
+    cur_file->refcount--;
+    pthread_mutex_unlock(&tsb->rdwr_mutex);
+  }
+  free(rb.data);
   if (sm)       streaming_msg_free(sm);
   if (ctrl)     streaming_msg_free(ctrl);
   tvhtrace("timeshift", "ts %d exit reader thread", ts->id);
@@ -30,7 +30,7 @@
 #include <assert.h>
 
 /* **************************************************************************
- * File Writing
+ * Control pipe
  * *************************************************************************/
 
 /*
@@ -55,124 +55,275 @@ static ssize_t _write
 }
 
 /*
- * Write message
+ * Write message (header and data in one go)
  */
 static ssize_t _write_msg
   ( int fd, streaming_message_type_t type, int64_t time,
     const void *buf, size_t len )
 {
-  size_t len2 = len + sizeof(type) + sizeof(time);
-  ssize_t err, ret;
-  ret = err = _write(fd, &len2, sizeof(len2));
-  if (err < 0) return err;
-  err = _write(fd, &type, sizeof(type));
-  if (err < 0) return err;
-  ret += err;
-  err = _write(fd, &time, sizeof(time));
-  if (err < 0) return err;
-  ret += err;
-  if (len) {
-    err = _write(fd, buf, len);
-    if (err < 0) return err;
-    ret += err;
-  }
-  return ret;
+  uint8_t tmp[sizeof(timeshift_record_t) + 64];
+  timeshift_record_t *rec = (timeshift_record_t*)tmp;
+  assert(len <= sizeof(tmp) - sizeof(*rec));
+  rec->size = sizeof(*rec) + len;
+  rec->type = type;
+  rec->time = time;
+  memcpy(tmp + sizeof(*rec), buf, len);
+  return _write(fd, tmp, rec->size);
+}
+
+/*
+ * Write skip message
+ */
+ssize_t timeshift_write_skip ( int fd, streaming_skip_t *skip )
+{
+  return _write_msg(fd, SMT_SKIP, 0, skip, sizeof(streaming_skip_t));
 }
 
 /*
- * Write packet buffer
+ * Write speed message
  */
-static int _write_pktbuf ( int fd, pktbuf_t *pktbuf )
+ssize_t timeshift_write_speed ( int fd, int speed )
 {
-  ssize_t ret, err;
-  if (pktbuf) {
-    ret = err = _write(fd, &pktbuf->pb_size, sizeof(pktbuf->pb_size));
-    if (err < 0) return err;
-    err = _write(fd, pktbuf->pb_data, pktbuf->pb_size);
-    if (err < 0) return err;
-    ret += err;
-  } else {
-    size_t sz = 0;
-    ret = _write(fd, &sz, sizeof(sz));
+  return _write_msg(fd, SMT_SPEED, 0, &speed, sizeof(speed));
+}
+
+/*
+ * Stop
+ */
+ssize_t timeshift_write_stop ( int fd, int code )
+{
+  return _write_msg(fd, SMT_STOP, 0, &code, sizeof(code));
+}
+
+/*
+ * Exit
+ */
+ssize_t timeshift_write_exit ( int fd )
+{
+  int code = 0;
+  return _write_msg(fd, SMT_EXIT, 0, &code, sizeof(code));
+}
+
+/* **************************************************************************
+ * File Writing
+ * *************************************************************************/
+
+/*
+ * Write out everything pending
+ */
+int timeshift_write_flush ( timeshift_file_t *tsf )
+{
+  timeshift_wbuf_t *wb = tsf->wbuf;
+  int i, err = 0;
+
+  if (!wb || !wb->iovcnt)
+    return 0;
+  if (tsf->fd == -1 || tvh_writev(tsf->fd, wb->iov, wb->iovcnt))
+    err = -1;
+  for (i = 0; i < wb->iovcnt; i++)
+    if (wb->ref[i]) {
+      pktbuf_ref_dec(wb->ref[i]);
+      wb->ref[i] = NULL;
+    }
+  wb->iovcnt    = 0;
+  wb->len       = 0;
+  wb->stage_len = 0;
+  return err;
+}
+
+/*
+ * Drop everything pending (file is being removed)
+ */
+void timeshift_write_discard ( timeshift_file_t *tsf )
+{
+  int fd = tsf->fd;
+  if (!tsf->wbuf) return;
+  tsf->fd = -1;
+  timeshift_write_flush(tsf);
+  tsf->fd = fd;
+  free(tsf->wbuf);
+  tsf->wbuf = NULL;
+}
+
+/*
+ * Append to a RAM segment
+ */
+static int _ram_append ( timeshift_file_t *tsf, const void *buf, size_t len )
+{
+  size_t o, n;
+  int i;
+
+  while (len) {
+    i = tsf->ram_len / TIMESHIFT_RAM_BLOCK;
+    o = tsf->ram_len % TIMESHIFT_RAM_BLOCK;
+    if (i == tsf->ram_cnt) {
+      if (tsf->ram_cnt == tsf->ram_max) {
+        tsf->ram_max = MAX(16, tsf->ram_max * 2);
+        tsf->ram_blk = realloc(tsf->ram_blk, tsf->ram_max * sizeof(uint8_t*));
+      }
+      tsf->ram_blk[tsf->ram_cnt++] = malloc(TIMESHIFT_RAM_BLOCK);
+      atomic_add_u64(&timeshift_total_ram_size, TIMESHIFT_RAM_BLOCK);
+    }
+    n = MIN(len, TIMESHIFT_RAM_BLOCK - o);
+    memcpy(tsf->ram_blk[i] + o, buf, n);
+    tsf->ram_len += n;
+    buf += n;
+    len -= n;
   }
-  return ret;
+  return 0;
 }
 
 /*
- * Write signal status
+ * Copy small data to the staging area
  */
-ssize_t timeshift_write_sigstat
-  ( int fd, int64_t time, signal_status_t *sigstat )
+static int _wbuf_copy ( timeshift_file_t *tsf, const void *buf, size_t len )
 {
-  return _write_msg(fd, SMT_SIGNAL_STATUS, time, sigstat,
-                    sizeof(signal_status_t));
+  timeshift_wbuf_t *wb = tsf->wbuf;
+  struct iovec *iov;
+
+  if (tsf->ram)
+    return _ram_append(tsf, buf, len);
+  if (!wb)
+    wb = tsf->wbuf = calloc(1, sizeof(timeshift_wbuf_t));
+  if (wb->stage_len + len > TIMESHIFT_WBUF_STAGE ||
+      wb->iovcnt == TIMESHIFT_WBUF_IOV)
+    if (timeshift_write_flush(tsf))
+      return -1;
+
+  /* Extend the last iovec if it ends in the staging area */
+  iov = wb->iovcnt ? &wb->iov[wb->iovcnt - 1] : NULL;
+  if (!iov || wb->ref[wb->iovcnt - 1] ||
+      iov->iov_base + iov->iov_len != (void*)wb->stage + wb->stage_len) {
+    iov = &wb->iov[wb->iovcnt++];
+    iov->iov_base = wb->stage + wb->stage_len;
+    iov->iov_len  = 0;
+  }
+  memcpy(wb->stage + wb->stage_len, buf, len);
+  iov->iov_len  += len;
+  wb->stage_len += len;
+  wb->len       += len;
+  return 0;
 }
 
 /*
- * Write packet
+ * Reference packet data (written without copy)
  */
-ssize_t timeshift_write_packet ( int fd, int64_t time, th_pkt_t *pkt )
+static int _wbuf_pktbuf ( timeshift_file_t *tsf, pktbuf_t *pb )
 {
-  ssize_t ret = 0, err;
-  ret = err = _write_msg(fd, SMT_PACKET, time, pkt, sizeof(th_pkt_t));
-  if (err <= 0) return err;
-  err = _write_pktbuf(fd, pkt->pkt_header);
-  if (err <= 0) return err;
-  ret += err;
-  err = _write_pktbuf(fd, pkt->pkt_payload);
-  if (err <= 0) return err;
-  ret += err;
-  return ret;
+  timeshift_wbuf_t *wb;
+
+  if (!pb || !pb->pb_size)
+    return 0;
+  if (pb->pb_size < TIMESHIFT_WBUF_COPY || tsf->ram)
+    return _wbuf_copy(tsf, pb->pb_data, pb->pb_size);
+
+  if (!(wb = tsf->wbuf))
+    wb = tsf->wbuf = calloc(1, sizeof(timeshift_wbuf_t));
+  if (wb->iovcnt == TIMESHIFT_WBUF_IOV)
+    if (timeshift_write_flush(tsf))
+      return -1;
+  wb->iov[wb->iovcnt].iov_base = pb->pb_data;
+  wb->iov[wb->iovcnt].iov_len  = pb->pb_size;
+  wb->ref[wb->iovcnt++]        = pb;
+  wb->len += pb->pb_size;
+  pktbuf_ref_inc(pb);
+  return 0;
 }
 
 /*
- * Write MPEGTS data
+ * Record queued, flush if enough is pending
  */
-ssize_t timeshift_write_mpegts ( int fd, int64_t time, void *data )
+static ssize_t _write_done ( timeshift_file_t *tsf, ssize_t size )
 {
-  return _write_msg(fd, SMT_MPEGTS, time, data, 188);
+  if (tsf->wbuf && tsf->wbuf->len >= TIMESHIFT_WBUF_FLUSH &&
+      timeshift_write_flush(tsf))
+    return -1;
+  return size;
 }
 
 /*
- * Write skip message
+ * Queue a record, returns the record size
  */
-ssize_t timeshift_write_skip ( int fd, streaming_skip_t *skip )
+static ssize_t _write_rec
+  ( timeshift_file_t *tsf, streaming_message_type_t type, int64_t time,
+    const void *buf, size_t len )
 {
-  return _write_msg(fd, SMT_SKIP, 0, skip, sizeof(streaming_skip_t));
+  timeshift_record_t rec;
+  rec.size = sizeof(rec) + len;
+  rec.type = type;
+  rec.time = time;
+  if (_wbuf_copy(tsf, &rec, sizeof(rec)))
+    return -1;
+  if (len && _wbuf_copy(tsf, buf, len))
+    return -1;
+  return _write_done(tsf, rec.size);
 }
 
 /*
- * Write speed message
+ * Write signal status
  */
-ssize_t timeshift_write_speed ( int fd, int speed )
+ssize_t timeshift_write_sigstat
+  ( timeshift_file_t *tsf, int64_t time, signal_status_t *sigstat )
 {
-  return _write_msg(fd, SMT_SPEED, 0, &speed, sizeof(speed));
+  return _write_rec(tsf, SMT_SIGNAL_STATUS, time, sigstat,
+                    sizeof(signal_status_t));
 }
 
 /*
- * Stop
+ * Write packet
  */
-ssize_t timeshift_write_stop ( int fd, int code )
+ssize_t timeshift_write_packet
+  ( timeshift_file_t *tsf, int64_t time, th_pkt_t *pkt )
 {
-  return _write_msg(fd, SMT_STOP, 0, &code, sizeof(code));
+  timeshift_record_t rec;
+  timeshift_record_pkt_t rp;
+
+  rp.pts            = pkt->pkt_pts;
+  rp.dts            = pkt->pkt_dts;
+  rp.duration       = pkt->pkt_duration;
+  rp.hdrlen         = pkt->pkt_header  ? pkt->pkt_header->pb_size  : 0;
+  rp.datalen        = pkt->pkt_payload ? pkt->pkt_payload->pb_size : 0;
+  rp.aspect_num     = pkt->pkt_aspect_num;
+  rp.aspect_den     = pkt->pkt_aspect_den;
+  rp.commercial     = pkt->pkt_commercial;
+  rp.componentindex = pkt->pkt_componentindex;
+  rp.frametype      = pkt->pkt_frametype;
+  rp.field          = pkt->pkt_field;
+  rp.channels       = pkt->pkt_channels;
+  rp.sri            = pkt->pkt_sri;
+  rp.err            = pkt->pkt_err;
+
+  rec.size = sizeof(rec) + sizeof(rp) + rp.hdrlen + rp.datalen;
+  rec.type = SMT_PACKET;
+  rec.time = time;
+
+  if (_wbuf_copy(tsf, &rec, sizeof(rec)) ||
+      _wbuf_copy(tsf, &rp, sizeof(rp)) ||
+      _wbuf_pktbuf(tsf, pkt->pkt_header) ||
+      _wbuf_pktbuf(tsf, pkt->pkt_payload))
+    return -1;
+  return _write_done(tsf, rec.size);
 }
 
 /*
- * Exit
+ * Write MPEGTS data
  */
-ssize_t timeshift_write_exit ( int fd )
+ssize_t timeshift_write_mpegts
+  ( timeshift_file_t *tsf, int64_t time, void *data )
 {
-  int code = 0;
-  return _write_msg(fd, SMT_EXIT, 0, &code, sizeof(code));
+  return _write_rec(tsf, SMT_MPEGTS, time, data, 188);
 }
 
 /*
- * Write end of file (special internal message)
+ * Write end of file (special internal message) and flush
  */
-ssize_t timeshift_write_eof ( int fd )
+ssize_t timeshift_write_eof ( timeshift_file_t *tsf )
 {
-  size_t sz = 0;
-  return _write(fd, &sz, sizeof(sz));
+  timeshift_record_t rec;
+  memset(&rec, 0, sizeof(rec));
+  if (_wbuf_copy(tsf, &rec, sizeof(rec)) || timeshift_write_flush(tsf))
+    return -1;
+  return sizeof(rec);
 }
 
 /* **************************************************************************
@@ -180,7 +331,7 @@ ssize_t timeshift_write_eof ( int fd )
  * *************************************************************************/
 
 static inline ssize_t _process_msg0
-  ( timeshift_t *ts, timeshift_file_t *tsf, streaming_message_t **smp )
+  ( timeshift_buffer_t *tsb, timeshift_file_t *tsf, streaming_message_t **smp )
 {
   int i;
   ssize_t err;
@@ -198,25 +349,21 @@ static inline ssize_t _process_msg0
     ss = sm->sm_data;
     for (i = 0; i < ss->ss_num_components; i++)
       if (SCT_ISVIDEO(ss->ss_components[i].ssc_type))
-        ts->vididx = ss->ss_components[i].ssc_index;
+        tsb->vididx = ss->ss_components[i].ssc_index;
   } else if (sm->sm_type == SMT_SIGNAL_STATUS)
-    err = timeshift_write_sigstat(tsf->fd, sm->sm_time, sm->sm_data);
+    err = timeshift_write_sigstat(tsf, sm->sm_time, sm->sm_data);
   else if (sm->sm_type == SMT_PACKET) {
-    err = timeshift_write_packet(tsf->fd, sm->sm_time, sm->sm_data);
+    err = timeshift_write_packet(tsf, sm->sm_time, sm->sm_data);
     if (err > 0) {
       th_pkt_t *pkt = sm->sm_data;
 
       /* Index video iframes */
-      if (pkt->pkt_componentindex == ts->vididx &&
-          pkt->pkt_frametype      == PKT_I_FRAME) {
-        timeshift_index_iframe_t *ti = calloc(1, sizeof(timeshift_index_iframe_t));
-        ti->pos  = tsf->size;
-        ti->time = sm->sm_time;
-        TAILQ_INSERT_TAIL(&tsf->iframes, ti, link);
-      }
+      if (pkt->pkt_componentindex == tsb->vididx &&
+          pkt->pkt_frametype      == PKT_I_FRAME)
+        timeshift_filemgr_index(tsb, tsf, tsf->size, sm->sm_time);
     }
   } else if (sm->sm_type == SMT_MPEGTS)
-    err = timeshift_write_mpegts(tsf->fd, sm->sm_time, sm->sm_data);
+    err = timeshift_write_mpegts(tsf, sm->sm_time, sm->sm_data);
   else
     err = 0;
 
@@ -230,7 +377,7 @@ static inline ssize_t _process_msg0
 }
 
 static void _process_msg
-  ( timeshift_t *ts, streaming_message_t *sm, int *run )
+  ( timeshift_buffer_t *tsb, streaming_message_t *sm, int *run )
 {
   int err;
   timeshift_file_t *tsf;
@@ -263,16 +410,16 @@ static void _process_msg
     case SMT_START:
     case SMT_MPEGTS:
     case SMT_PACKET:
-      pthread_mutex_lock(&ts->rdwr_mutex);
-      if ((tsf = timeshift_filemgr_get(ts, 1)) && (tsf->fd != -1)) {
-        if ((err = _process_msg0(ts, tsf, &sm)) < 0) {
+      pthread_mutex_lock(&tsb->rdwr_mutex);
+      if ((tsf = timeshift_filemgr_get(tsb, 1)) && !tsf->closed) {
+        if ((err = _process_msg0(tsb, tsf, &sm)) < 0) {
           timeshift_filemgr_close(tsf);
           tsf->bad = 1;
-          ts->full = 1; ///< Stop any more writing
+          tsb->full = 1; ///< Stop any more writing
         }
         tsf->refcount--;
       }
-      pthread_mutex_unlock(&ts->rdwr_mutex);
+      pthread_mutex_unlock(&tsb->rdwr_mutex);
       break;
   }
 
@@ -281,27 +428,48 @@ static void _process_msg
     streaming_msg_free(sm);
 }
 
+/*
+ * Only the newest file can have pending writes, the others are closed
+ */
+static void _flush_pending ( timeshift_buffer_t *tsb )
+{
+  timeshift_file_t *tsf;
+
+  pthread_mutex_lock(&tsb->rdwr_mutex);
+  tsf = TAILQ_LAST(&tsb->files, timeshift_file_list);
+  if (tsf && !tsf->closed && timeshift_write_flush(tsf) < 0) {
+    timeshift_filemgr_close(tsf);
+    tsf->bad = 1;
+    tsb->full = 1;
+  }
+  pthread_mutex_unlock(&tsb->rdwr_mutex);
+}
+
 void *timeshift_writer ( void *aux )
 {
   int run = 1;
-  timeshift_t *ts = aux;
-  streaming_queue_t *sq = &ts->wr_queue;
+  timeshift_buffer_t *tsb = aux;
+  streaming_queue_t *sq = &tsb->wr_queue;
   streaming_message_t *sm;
 
   pthread_mutex_lock(&sq->sq_mutex);
 
   while (run) {
 
-    /* Get message */
+    /* Get message (write out pending data before going idle) */
     sm = TAILQ_FIRST(&sq->sq_queue);
     if (sm == NULL) {
-      pthread_cond_wait(&sq->sq_cond, &sq->sq_mutex);
+      pthread_mutex_unlock(&sq->sq_mutex);
+      _flush_pending(tsb);
+      pthread_mutex_lock(&sq->sq_mutex);
+      if (TAILQ_FIRST(&sq->sq_queue) == NULL)
+        pthread_cond_wait(&sq->sq_cond, &sq->sq_mutex);
       continue;
     }
     TAILQ_REMOVE(&sq->sq_queue, sm, sm_link);
     pthread_mutex_unlock(&sq->sq_mutex);
 
-    _process_msg(ts, sm, &run);
+    _process_msg(tsb, sm, &run);
 
     pthread_mutex_lock(&sq->sq_mutex);
   }
@@ -314,17 +482,18 @@ void *timeshift_writer ( void *aux )
  * Utilities
  * *************************************************************************/
 
-void timeshift_writer_flush ( timeshift_t *ts )
+void timeshift_writer_flush ( timeshift_buffer_t *tsb )
 
 {
   streaming_message_t *sm;
-  streaming_queue_t *sq = &ts->wr_queue;
+  streaming_queue_t *sq = &tsb->wr_queue;
 
   pthread_mutex_lock(&sq->sq_mutex);
   while ((sm = TAILQ_FIRST(&sq->sq_queue))) {
     TAILQ_REMOVE(&sq->sq_queue, sm, sm_link);
-    _process_msg(ts, sm, NULL);
+    _process_msg(tsb, sm, NULL);
   }
+  _flush_pending(tsb);
   pthread_mutex_unlock(&sq->sq_mutex);
 }
 
@@ -180,20 +180,17 @@ ts_extract_pcr(service_t *t, elementary_stream_t *st, const uint8_t *tsb,
 
 /**
  * Process service stream packets, extract PCR and optionally descramble
+ *
+ * s_stream_mutex must be held
  */
-void
-ts_recv_packet1(service_t *t, const uint8_t *tsb, int64_t *pcrp)
+static void
+ts_recv_packet_st(service_t *t, elementary_stream_t *st, const uint8_t *tsb,
+                  int64_t *pcrp)
 {
-  elementary_stream_t *st;
-  int pid, n, m, r;
+  int n, m, r;
   th_descrambler_t *td;
   int error = 0;
 
-  if(t->s_status != SERVICE_RUNNING)
-    return;
-
-  pthread_mutex_lock(&t->s_stream_mutex);
-
   service_set_streaming_status_flags(t, TSS_INPUT_HARDWARE);
 
   if(tsb[1] & 0x80) {
@@ -203,18 +200,12 @@ ts_recv_packet1(service_t *t, const uint8_t *tsb, int64_t *pcrp)
     error = 1;
   }
 
-  pid = (tsb[1] & 0x1f) << 8 | tsb[2];
-
-  st = service_stream_find(t, pid);
-
   /* Extract PCR */
   if(tsb[3] & 0x20 && tsb[4] > 0 && tsb[5] & 0x10 && !error)
     ts_extract_pcr(t, st, tsb, pcrp);
 
-  if(st == NULL) {
-    pthread_mutex_unlock(&t->s_stream_mutex);
+  if(st == NULL)
     return;
-  }
 
   if(!error)
     service_set_streaming_status_flags(t, TSS_INPUT_SERVICE);
@@ -238,10 +229,8 @@ ts_recv_packet1(service_t *t, const uint8_t *tsb, int64_t *pcrp)
       n++;
       
       r = td->td_descramble(td, t, st, tsb);
-      if(r == 0) {
-	pthread_mutex_unlock(&t->s_stream_mutex);
+      if(r == 0)
 	return;
-      }
 
       if(r == 1)
 	m++;
@@ -258,7 +247,57 @@ ts_recv_packet1(service_t *t, const uint8_t *tsb, int64_t *pcrp)
   } else {
     ts_recv_packet0(t, st, tsb);
   }
+}
+
+/**
+ * Process service stream packets, extract PCR and optionally descramble
+ */
+void
+ts_recv_packet1(service_t *t, const uint8_t *tsb, int64_t *pcrp)
+{
+  int pid;
+
+  if(t->s_status != SERVICE_RUNNING)
+    return;
+
+  pthread_mutex_lock(&t->s_stream_mutex);
+
+  pid = (tsb[1] & 0x1f) << 8 | tsb[2];
+  ts_recv_packet_st(t, service_stream_find(t, pid), tsb, pcrp);
+
+  pthread_mutex_unlock(&t->s_stream_mutex);
+}
+
+/**
+ * As ts_recv_packet1() but for callers that have already resolved the
+ * elementary stream. 'gen' is the s_components_gen the stream was looked
+ * up against, if the components have changed since then the stream is
+ * searched for again.
+ *
+ * Returns 1 if the caller's lookup is stale and should be rebuilt
+ */
+int
+ts_recv_packet1_st(service_t *t, elementary_stream_t *st, int gen,
+                   const uint8_t *tsb)
+{
+  int pid, stale;
+
+  if(t->s_status != SERVICE_RUNNING)
+    return 0;
+
+  pthread_mutex_lock(&t->s_stream_mutex);
+
+  if((stale = (t->s_components_gen != gen))) {
+    pid = (tsb[1] & 0x1f) << 8 | tsb[2];
+    st = service_stream_find(t, pid);
+  }
+
+  ts_recv_packet_st(t, st, tsb, NULL);
+
+  stale |= t->s_components_gen != gen;
+
   pthread_mutex_unlock(&t->s_stream_mutex);
+  return stale;
 }
 
 
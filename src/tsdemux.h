@@ -23,6 +23,9 @@ int ts_resync ( const uint8_t *tsb, int *len, int *idx );
 
 void ts_recv_packet1(struct service *t, const uint8_t *tsb, int64_t *pcrp);
 
+int ts_recv_packet1_st(struct service *t, struct elementary_stream *st,
+                       int gen, const uint8_t *tsb);
+
 void ts_recv_packet2(struct service *t, const uint8_t *tsb);
 
 #endif /* TSDEMUX_H */
@@ -0,0 +1,434 @@
+/*
+ *  tvheadend, CSA descrambling worker pool
+ *  Copyright (C) 2013
+ *
+ *  This program is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include <pthread.h>
+#include <unistd.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "tvheadend.h"
+#include "service.h"
+#include "tsdemux.h"
+#include "tvhcsa.h"
+
+#if ENABLE_DVBCSA
+#include <dvbcsa/dvbcsa.h>
+#else
+#include "ffdecsa/FFdecsa.h"
+#endif
+
+/* Max. number of full clusters waiting per service */
+#define TVHCSA_MAX_QUEUE 64
+
+typedef struct tvhcsa_cluster {
+  TAILQ_ENTRY(tvhcsa_cluster) tcc_link;
+  int     tcc_fill;
+  uint8_t tcc_cw[16];
+  int     tcc_cw_set;        // bit0 even, bit1 odd
+  uint8_t tcc_tsb[0];
+} tvhcsa_cluster_t;
+
+TAILQ_HEAD(tvhcsa_cluster_queue, tvhcsa_cluster);
+
+struct tvhcsa {
+  struct service *csa_service;
+  int             csa_cluster_size;
+
+  /* Input side, protected via s_stream_mutex */
+  tvhcsa_cluster_t *csa_fill;
+  uint8_t           csa_cw[16];
+  int               csa_cw_set;
+  loglimiter_t      csa_loglimit;
+
+  /* Worker side, only touched by the worker owning the service */
+#if ENABLE_DVBCSA
+  struct dvbcsa_bs_key_s   *csa_key_even;
+  struct dvbcsa_bs_key_s   *csa_key_odd;
+  struct dvbcsa_bs_batch_s *csa_tsbbatch_even;
+  struct dvbcsa_bs_batch_s *csa_tsbbatch_odd;
+#else
+  void                     *csa_keys;
+#endif
+  uint8_t                   csa_cw_applied[16];
+  int                       csa_cw_applied_set;
+
+  /* Protected via tvhcsa_mutex */
+  struct tvhcsa_cluster_queue csa_queue;
+  struct tvhcsa_cluster_queue csa_free;
+  TAILQ_ENTRY(tvhcsa)         csa_ready_link;
+  int                         csa_ready;
+  int                         csa_busy;
+  int                         csa_dead;
+};
+
+TAILQ_HEAD(tvhcsa_queue, tvhcsa);
+
+static pthread_mutex_t     tvhcsa_mutex;
+static pthread_cond_t      tvhcsa_cond;
+static struct tvhcsa_queue tvhcsa_ready;
+
+/**
+ *
+ */
+static tvhcsa_cluster_t *
+tvhcsa_cluster_get(tvhcsa_t *csa)
+{
+  tvhcsa_cluster_t *tcc;
+
+  if((tcc = TAILQ_FIRST(&csa->csa_free)) != NULL)
+    TAILQ_REMOVE(&csa->csa_free, tcc, tcc_link);
+  else
+    tcc = malloc(sizeof(tvhcsa_cluster_t) + csa->csa_cluster_size * 188);
+  tcc->tcc_fill = 0;
+  return tcc;
+}
+
+/**
+ * tvhcsa_mutex must be held and no worker may own the service
+ */
+static void
+tvhcsa_free(tvhcsa_t *csa)
+{
+  tvhcsa_cluster_t *tcc;
+
+  while((tcc = TAILQ_FIRST(&csa->csa_queue)) != NULL) {
+    TAILQ_REMOVE(&csa->csa_queue, tcc, tcc_link);
+    free(tcc);
+  }
+  while((tcc = TAILQ_FIRST(&csa->csa_free)) != NULL) {
+    TAILQ_REMOVE(&csa->csa_free, tcc, tcc_link);
+    free(tcc);
+  }
+  free(csa->csa_fill);
+
+#if ENABLE_DVBCSA
+  dvbcsa_bs_key_free(csa->csa_key_odd);
+  dvbcsa_bs_key_free(csa->csa_key_even);
+  free(csa->csa_tsbbatch_odd);
+  free(csa->csa_tsbbatch_even);
+#else
+  free_key_struct(csa->csa_keys);
+#endif
+  service_unref(csa->csa_service);
+  free(csa);
+}
+
+/**
+ * Load the control words the cluster was started with
+ */
+static void
+tvhcsa_apply_keys(tvhcsa_t *csa, tvhcsa_cluster_t *tcc)
+{
+  if((tcc->tcc_cw_set & 1) &&
+     (!(csa->csa_cw_applied_set & 1) ||
+      memcmp(csa->csa_cw_applied, tcc->tcc_cw, 8))) {
+#if ENABLE_DVBCSA
+    dvbcsa_bs_key_set(tcc->tcc_cw, csa->csa_key_even);
+#else
+    set_even_control_word(csa->csa_keys, tcc->tcc_cw);
+#endif
+    memcpy(csa->csa_cw_applied, tcc->tcc_cw, 8);
+  }
+  if((tcc->tcc_cw_set & 2) &&
+     (!(csa->csa_cw_applied_set & 2) ||
+      memcmp(csa->csa_cw_applied + 8, tcc->tcc_cw + 8, 8))) {
+#if ENABLE_DVBCSA
+    dvbcsa_bs_key_set(tcc->tcc_cw + 8, csa->csa_key_odd);
+#else
+    set_odd_control_word(csa->csa_keys, tcc->tcc_cw + 8);
+#endif
+    memcpy(csa->csa_cw_applied + 8, tcc->tcc_cw + 8, 8);
+  }
+  csa->csa_cw_applied_set |= tcc->tcc_cw_set;
+}
+
+/**
+ * Decrypt a cluster in place, returns the number of usable packets
+ */
+#if ENABLE_DVBCSA
+static int
+tvhcsa_decrypt(tvhcsa_t *csa, tvhcsa_cluster_t *tcc)
+{
+  uint8_t *pkt;
+  int i, xc0, ev_od, len, offset;
+  int fill_even = 0, fill_odd = 0;
+
+  for(i = 0, pkt = tcc->tcc_tsb; i < tcc->tcc_fill; i++, pkt += 188) {
+    xc0 = pkt[3] & 0xc0;
+    if(xc0 != 0x80 && xc0 != 0xc0) // clear or reserved
+      continue;
+    ev_od = (xc0 & 0x40) >> 6; // 0 even, 1 odd
+    pkt[3] &= 0x3f;  // consider it decrypted now
+    if(pkt[3] & 0x20) { // incomplete packet
+      offset = 4 + pkt[4] + 1;
+      len = 188 - offset;
+      if((len >> 3) == 0) // decrypted==encrypted!
+        continue;
+    } else {
+      len = 184;
+      offset = 4;
+    }
+    if(ev_od == 0) {
+      csa->csa_tsbbatch_even[fill_even].data = pkt + offset;
+      csa->csa_tsbbatch_even[fill_even].len = len;
+      fill_even++;
+    } else {
+      csa->csa_tsbbatch_odd[fill_odd].data = pkt + offset;
+      csa->csa_tsbbatch_odd[fill_odd].len = len;
+      fill_odd++;
+    }
+  }
+
+  if(fill_even) {
+    csa->csa_tsbbatch_even[fill_even].data = NULL;
+    dvbcsa_bs_decrypt(csa->csa_key_even, csa->csa_tsbbatch_even, 184);
+  }
+  if(fill_odd) {
+    csa->csa_tsbbatch_odd[fill_odd].data = NULL;
+    dvbcsa_bs_decrypt(csa->csa_key_odd, csa->csa_tsbbatch_odd, 184);
+  }
+  return tcc->tcc_fill;
+}
+#else
+static int
+tvhcsa_decrypt(tvhcsa_t *csa, tvhcsa_cluster_t *tcc)
+{
+  unsigned char *vec[3];
+  int r, done = 0;
+
+  while(done < tcc->tcc_fill) {
+    vec[0] = tcc->tcc_tsb + done * 188;
+    vec[1] = tcc->tcc_tsb + tcc->tcc_fill * 188;
+    vec[2] = NULL;
+
+    r = decrypt_packets(csa->csa_keys, vec);
+    if(r <= 0)
+      break;
+    done += r;
+  }
+  return done;
+}
+#endif
+
+/**
+ * Worker thread
+ */
+static void *
+tvhcsa_thread(void *aux)
+{
+  tvhcsa_t *csa;
+  tvhcsa_cluster_t *tcc;
+  service_t *t;
+  uint8_t *pkt;
+  int i, n, dead;
+
+  pthread_mutex_lock(&tvhcsa_mutex);
+  while(1) {
+
+    if((csa = TAILQ_FIRST(&tvhcsa_ready)) == NULL) {
+      pthread_cond_wait(&tvhcsa_cond, &tvhcsa_mutex);
+      continue;
+    }
+
+    TAILQ_REMOVE(&tvhcsa_ready, csa, csa_ready_link);
+    csa->csa_ready = 0;
+    csa->csa_busy  = 1;
+
+    tcc = TAILQ_FIRST(&csa->csa_queue);
+    TAILQ_REMOVE(&csa->csa_queue, tcc, tcc_link);
+    t = csa->csa_service;
+    t->s_descramble_queue--;
+    pthread_mutex_unlock(&tvhcsa_mutex);
+
+    tvhcsa_apply_keys(csa, tcc);
+    n = tvhcsa_decrypt(csa, tcc);
+
+    /* Re-inject, the descrambler may have been stopped meanwhile */
+    pthread_mutex_lock(&t->s_stream_mutex);
+    pthread_mutex_lock(&tvhcsa_mutex);
+    dead = csa->csa_dead;
+    pthread_mutex_unlock(&tvhcsa_mutex);
+
+    if(!dead) {
+      for(i = 0, pkt = tcc->tcc_tsb; i < n; i++, pkt += 188)
+        ts_recv_packet2(t, pkt);
+      avgstat_add(&t->s_descramble_rate, n * 188, dispatch_clock);
+    }
+    pthread_mutex_unlock(&t->s_stream_mutex);
+
+    pthread_mutex_lock(&tvhcsa_mutex);
+    csa->csa_busy = 0;
+    if(csa->csa_dead) {
+      free(tcc);
+      tvhcsa_free(csa);
+      continue;
+    }
+    TAILQ_INSERT_HEAD(&csa->csa_free, tcc, tcc_link);
+    if(TAILQ_FIRST(&csa->csa_queue) != NULL) {
+      TAILQ_INSERT_TAIL(&tvhcsa_ready, csa, csa_ready_link);
+      csa->csa_ready = 1;
+    }
+  }
+  return NULL;
+}
+
+/**
+ *
+ */
+void
+tvhcsa_init(int threads)
+{
+  pthread_t ptid;
+  int i;
+
+  pthread_mutex_init(&tvhcsa_mutex, NULL);
+  pthread_cond_init(&tvhcsa_cond, NULL);
+  TAILQ_INIT(&tvhcsa_ready);
+
+  if(threads <= 0)
+    threads = sysconf(_SC_NPROCESSORS_ONLN);
+  if(threads <= 0)
+    threads = 1;
+
+  for(i = 0; i < threads; i++)
+    pthread_create(&ptid, NULL, tvhcsa_thread, NULL);
+
+  tvhlog(LOG_INFO, "CSA", "Using %d descrambler thread%s",
+         threads, threads == 1 ? "" : "s");
+}
+
+/**
+ *
+ */
+tvhcsa_t *
+tvhcsa_create(service_t *t)
+{
+  tvhcsa_t *csa = calloc(1, sizeof(tvhcsa_t));
+
+  csa->csa_service = t;
+  service_ref(t);
+
+#if ENABLE_DVBCSA
+  csa->csa_cluster_size  = dvbcsa_bs_batch_size();
+  csa->csa_tsbbatch_even = malloc((csa->csa_cluster_size + 1) *
+                                  sizeof(struct dvbcsa_bs_batch_s));
+  csa->csa_tsbbatch_odd  = malloc((csa->csa_cluster_size + 1) *
+                                  sizeof(struct dvbcsa_bs_batch_s));
+  csa->csa_key_even      = dvbcsa_bs_key_alloc();
+  csa->csa_key_odd       = dvbcsa_bs_key_alloc();
+#else
+  csa->csa_cluster_size  = get_suggested_cluster_size();
+  csa->csa_keys          = get_key_struct();
+#endif
+
+  TAILQ_INIT(&csa->csa_queue);
+  TAILQ_INIT(&csa->csa_free);
+  return csa;
+}
+
+/**
+ *
+ */
+void
+tvhcsa_destroy(tvhcsa_t *csa)
+{
+  service_t *t = csa->csa_service;
+  tvhcsa_cluster_t *tcc;
+
+  lock_assert(&t->s_stream_mutex);
+
+  pthread_mutex_lock(&tvhcsa_mutex);
+  while((tcc = TAILQ_FIRST(&csa->csa_queue)) != NULL) {
+    TAILQ_REMOVE(&csa->csa_queue, tcc, tcc_link);
+    t->s_descramble_queue--;
+    free(tcc);
+  }
+  if(csa->csa_ready) {
+    TAILQ_REMOVE(&tvhcsa_ready, csa, csa_ready_link);
+    csa->csa_ready = 0;
+  }
+  csa->csa_dead = 1;
+  if(!csa->csa_busy)
+    tvhcsa_free(csa);   // otherwise the worker frees it when done
+  pthread_mutex_unlock(&tvhcsa_mutex);
+}
+
+/**
+ *
+ */
+void
+tvhcsa_set_key_even(tvhcsa_t *csa, const uint8_t *even)
+{
+  memcpy(csa->csa_cw, even, 8);
+  csa->csa_cw_set |= 1;
+}
+
+void
+tvhcsa_set_key_odd(tvhcsa_t *csa, const uint8_t *odd)
+{
+  memcpy(csa->csa_cw + 8, odd, 8);
+  csa->csa_cw_set |= 2;
+}
+
+/**
+ *
+ */
+void
+tvhcsa_descramble(tvhcsa_t *csa, const uint8_t *tsb)
+{
+  service_t *t = csa->csa_service;
+  tvhcsa_cluster_t *tcc = csa->csa_fill;
+
+  lock_assert(&t->s_stream_mutex);
+
+  if(tcc == NULL) {
+    pthread_mutex_lock(&tvhcsa_mutex);
+    tcc = csa->csa_fill = tvhcsa_cluster_get(csa);
+    pthread_mutex_unlock(&tvhcsa_mutex);
+  }
+
+  /* Keys are picked up at the start of each cluster */
+  if(tcc->tcc_fill == 0) {
+    memcpy(tcc->tcc_cw, csa->csa_cw, 16);
+    tcc->tcc_cw_set = csa->csa_cw_set;
+  }
+
+  memcpy(tcc->tcc_tsb + tcc->tcc_fill * 188, tsb, 188);
+  if(++tcc->tcc_fill != csa->csa_cluster_size)
+    return;
+
+  csa->csa_fill = NULL;
+
+  pthread_mutex_lock(&tvhcsa_mutex);
+  if(t->s_descramble_queue >= TVHCSA_MAX_QUEUE) {
+    /* Workers can't keep up, drop rather than grow without bound */
+    TAILQ_INSERT_HEAD(&csa->csa_free, tcc, tcc_link);
+    pthread_mutex_unlock(&tvhcsa_mutex);
+    limitedlog(&csa->csa_loglimit, "CSA", service_nicename(t),
+               "Descrambler queue overflow");
+    return;
+  }
+  TAILQ_INSERT_TAIL(&csa->csa_queue, tcc, tcc_link);
+  t->s_descramble_queue++;
+  if(!csa->csa_ready && !csa->csa_busy) {
+    TAILQ_INSERT_TAIL(&tvhcsa_ready, csa, csa_ready_link);
+    csa->csa_ready = 1;
+    pthread_cond_signal(&tvhcsa_cond);
+  }
+  pthread_mutex_unlock(&tvhcsa_mutex);
+}
@@ -0,0 +1,57 @@
+/*
+ *  tvheadend, CSA descrambling worker pool
+ *  Copyright (C) 2013
+ *
+ *  This program is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef __TVH_CSA_H__
+#define __TVH_CSA_H__
+
+struct service;
+struct tvhcsa;
+
+typedef struct tvhcsa tvhcsa_t;
+
+/**
+ * Start the descrambler worker threads (0 = one per CPU)
+ */
+void tvhcsa_init ( int threads );
+
+/**
+ * Per descrambler CSA state
+ *
+ * Clusters of TS packets are collected on the input thread and handed
+ * over to the worker pool. A service is only ever processed by one
+ * worker at a time, so packets are re-injected in order.
+ */
+tvhcsa_t *tvhcsa_create  ( struct service *t );
+
+/**
+ * s_stream_mutex must be held
+ */
+void      tvhcsa_destroy ( tvhcsa_t *csa );
+
+/**
+ * New control words, applied from the next cluster
+ */
+void      tvhcsa_set_key_even ( tvhcsa_t *csa, const uint8_t *even );
+void      tvhcsa_set_key_odd  ( tvhcsa_t *csa, const uint8_t *odd );
+
+/**
+ * Queue a scrambled packet, s_stream_mutex must be held
+ */
+void      tvhcsa_descramble ( tvhcsa_t *csa, const uint8_t *tsb );
+
+#endif /* __TVH_CSA_H__ */
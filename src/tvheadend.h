@@ -502,8 +502,13 @@ int tvh_pipe(int flags, th_pipe_t *pipe);
 
 int tvh_write(int fd, const void *buf, size_t len);
 
+struct iovec;
+int tvh_writev(int fd, struct iovec *iov, int iovcnt);
+
 void hexdump(const char *pfx, const uint8_t *data, int len);
 
+void tvh_crc32_init(void);
+
 uint32_t tvh_crc32(uint8_t *data, size_t datalen, uint32_t crc);
 
 int base64_decode(uint8_t *out, const char *in, int out_size);
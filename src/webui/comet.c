@@ -194,8 +194,10 @@ comet_mailbox_poll(http_connection_t *hc, const char *remain, void *opaque)
   struct timespec ts;
   htsmsg_t *m;
 
-  if(!im)
+  if(!im) {
+    http_worker_detach(hc);  /* Long poll, do not hold up a worker */
     usleep(100000); /* Always sleep 0.1 sec to avoid comet storms */
+  }
 
   pthread_mutex_lock(&comet_mutex);
 
@@ -51,6 +51,9 @@
 #include "imagecache.h"
 #include "timeshift.h"
 #include "tvhtime.h"
+#if ENABLE_CWC
+#include "cwc.h"
+#endif
 
 /**
  *
@@ -359,6 +362,9 @@ extjs_channels_update(htsmsg_t *in)
     if((s = htsmsg_get_str(c, "number")) != NULL)
       channel_set_number(ch, atoi(s));
 
+    if((s = htsmsg_get_str(c, "gop_cache")) != NULL)
+      channel_set_gop_cache(ch, atoi(s));
+
     if((s = htsmsg_get_str(c, "epggrabsrc")) != NULL) {
       char *tmp = strdup(s);
       char *sptr = NULL, *sptr2 = NULL;
@@ -440,6 +446,7 @@ build_record_channel ( channel_t *ch )
   htsmsg_add_s32(c, "epg_pre_start", ch->ch_dvr_extra_time_pre);
   htsmsg_add_s32(c, "epg_post_end",  ch->ch_dvr_extra_time_post);
   htsmsg_add_s32(c, "number",        ch->ch_number);
+  htsmsg_add_s32(c, "gop_cache",     ch->ch_gop_cache);
 
   epggrabsrc = NULL;
   LIST_FOREACH(mod, &epggrab_modules, link) {
@@ -863,7 +870,7 @@ extjs_epg(http_connection_t *hc, const char *remain, void *opaque)
   epg_episode_t *ee = NULL;
   epg_genre_t *eg = NULL, genre;
   channel_t *ch;
-  int start = 0, end, limit, i;
+  int start = 0, limit, i;
   const char *s;
   char buf[100];
   const char *channel = http_arg_get(&hc->hc_req_args, "channel");
@@ -892,17 +899,11 @@ extjs_epg(http_connection_t *hc, const char *remain, void *opaque)
 
   pthread_mutex_lock(&global_lock);
 
-  epg_query(&eqr, channel, tag, eg, title, lang);
-
-  epg_query_sort(&eqr);
+  epg_query(&eqr, channel, tag, eg, title, lang, start, limit);
 
-  htsmsg_add_u32(out, "totalCount", eqr.eqr_entries);
+  htsmsg_add_u32(out, "totalCount", eqr.eqr_total);
 
-
-  start = MIN(start, eqr.eqr_entries);
-  end = MIN(start + limit, eqr.eqr_entries);
-
-  for(i = start; i < end; i++) {
+  for(i = 0; i < eqr.eqr_entries; i++) {
     e  = eqr.eqr_array[i];
     ee = e->episode;
     ch = e->channel;
@@ -1988,6 +1989,9 @@ extjs_config(http_connection_t *hc, const char *remain, void *opaque)
     /* Misc */
     pthread_mutex_lock(&global_lock);
     m = config_get_all();
+    htsmsg_delete_field(m, "descrambler_ecm_parallel");
+    htsmsg_add_u32(m, "descrambler_ecm_parallel",
+                   config_get_descrambler_ecm_parallel());
 
     /* Time */
     htsmsg_add_u32(m, "tvhtime_update_enabled", tvhtime_update_enabled);
@@ -2019,6 +2023,13 @@ extjs_config(http_connection_t *hc, const char *remain, void *opaque)
       save |= config_set_muxconfpath(str);
     if ((str = http_arg_get(&hc->hc_req_args, "language")))
       save |= config_set_language(str);
+    if ((str = http_arg_get(&hc->hc_req_args, "descrambler_threads")))
+      save |= config_set_descrambler_threads(atoi(str));
+    str = http_arg_get(&hc->hc_req_args, "descrambler_ecm_parallel");
+    save |= config_set_descrambler_ecm_parallel(!!str);
+#if ENABLE_CWC
+    cwc_set_ecm_parallel(!!str);
+#endif
     if (save)
       config_save();
 
@@ -2195,6 +2206,7 @@ extjs_timeshift(http_connection_t *hc, const char *remain, void *opaque)
     htsmsg_add_u32(m, "timeshift_max_period", timeshift_max_period / 60);
     htsmsg_add_u32(m, "timeshift_unlimited_size", timeshift_unlimited_size);
     htsmsg_add_u32(m, "timeshift_max_size", timeshift_max_size / 1048576);
+    htsmsg_add_u32(m, "timeshift_ram_size", timeshift_ram_size / 1048576);
     pthread_mutex_unlock(&global_lock);
     out = json_single_record(m, "config");
 
@@ -2214,6 +2226,8 @@ extjs_timeshift(http_connection_t *hc, const char *remain, void *opaque)
     timeshift_unlimited_size = http_arg_get(&hc->hc_req_args, "timeshift_unlimited_size") ? 1 : 0;
     if ((str = http_arg_get(&hc->hc_req_args, "timeshift_max_size")))
       timeshift_max_size   = atol(str) * 1048576LL;
+    if ((str = http_arg_get(&hc->hc_req_args, "timeshift_ram_size")))
+      timeshift_ram_size   = atol(str) * 1048576LL;
     timeshift_save();
     pthread_mutex_unlock(&global_lock);
 
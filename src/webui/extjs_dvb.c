@@ -160,6 +160,7 @@ extjs_dvbadapter(http_connection_t *hc, const char *remain, void *opaque)
     htsmsg_add_u32(r, "disable_pmt_monitor", tda->tda_disable_pmt_monitor);
     htsmsg_add_u32(r, "full_mux_rx", tda->tda_full_mux_rx+1);
     htsmsg_add_u32(r, "grace_period", tda->tda_grace_period);
+    htsmsg_add_u32(r, "dvr_bufsize", tda->tda_dvr_bufsize);
     htsmsg_add_str(r, "diseqcversion", 
 		   ((const char *[]){"DiSEqC 1.0 / 2.0",
 				       "DiSEqC 1.1 / 2.1"})
@@ -211,6 +212,9 @@ extjs_dvbadapter(http_connection_t *hc, const char *remain, void *opaque)
     s = http_arg_get(&hc->hc_req_args, "grace_period");
     dvb_adapter_set_grace_period(tda, atoi(s));
 
+    if((s = http_arg_get(&hc->hc_req_args, "dvr_bufsize")) != NULL)
+      dvb_adapter_set_dvr_bufsize(tda, atoi(s));
+
     if((s = http_arg_get(&hc->hc_req_args, "nitoid")) != NULL)
       dvb_adapter_set_nitoid(tda, atoi(s));
 
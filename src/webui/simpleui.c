@@ -88,12 +88,11 @@ page_simple(http_connection_t *hc,
 
   if(s != NULL) {
     
-    epg_query(&eqr, NULL, NULL, NULL, s, lang);
-    epg_query_sort(&eqr);
+    epg_query(&eqr, NULL, NULL, NULL, s, lang, 0, 25);
 
-    c = eqr.eqr_entries;
+    c = eqr.eqr_total;
 
-    if(eqr.eqr_entries == 0) {
+    if(eqr.eqr_total == 0) {
       htsbuf_qprintf(hq, "<b>No matching entries found</b>");
     } else {
 
@@ -486,6 +485,7 @@ page_epgsave(http_connection_t *hc,
   pthread_mutex_lock(&global_lock);
   epg_save(NULL);
   pthread_mutex_unlock(&global_lock);
+  epg_save_wait();
 
   http_output_content(hc, "text/xml");
 
@@ -30,6 +30,15 @@
 #include "epg.h"
 #include "psi.h"
 #include "channels.h"
+#include "mempool.h"
+#include "packet.h"
+#include "htsp_server.h"
+#if ENABLE_CWC
+#include "cwc.h"
+#endif
+#if ENABLE_LIBAV
+#include "plumbing/transcoding.h"
+#endif
 #if ENABLE_LINUXDVB
 #include "dvr/dvr.h"
 #include "dvb/dvb.h"
@@ -59,6 +68,7 @@ static void
 dumpchannels(htsbuf_queue_t *hq)
 {
   channel_t *ch;
+  service_t *t;
   outputtitle(hq, 0, "Channels");
 
   RB_FOREACH(ch, &channel_name_tree, ch_name_link) {
@@ -73,6 +83,19 @@ dumpchannels(htsbuf_queue_t *hq)
 		   ch->ch_zombie,
 		   ch->ch_number,
 		   ch->ch_icon ?: "<none set>");
+
+    if(!ch->ch_gop_cache)
+      continue;
+    htsbuf_qprintf(hq, "  GOP cache = %d kB\n", ch->ch_gop_cache);
+    LIST_FOREACH(t, &ch->ch_services, s_ch_link) {
+      pthread_mutex_lock(&t->s_stream_mutex);
+      htsbuf_qprintf(hq, "    %s: %d packets, %zu bytes, "
+                     "%d hits, %d misses, %d overflows\n",
+                     service_nicename(t), t->s_gop_packets, t->s_gop_bytes,
+                     t->s_gop_hits, t->s_gop_misses, t->s_gop_overflows);
+      pthread_mutex_unlock(&t->s_stream_mutex);
+    }
+    htsbuf_qprintf(hq, "\n");
   }
 }
 
@@ -128,6 +151,7 @@ dumpdvbadapters(htsbuf_queue_t *hq)
 {
   th_dvb_adapter_t *tda;
   th_dvb_mux_instance_t *tdmi;
+  th_dvb_table_t *tdt;
 
   outputtitle(hq, 0, "DVB Adapters");
 
@@ -140,6 +164,13 @@ dumpdvbadapters(htsbuf_queue_t *hq)
       dvb_mux_nicename(tdminame, sizeof(tdminame), tdmi);
       htsbuf_qprintf(hq, "      %s (%s)\n",
 		     tdminame, tdmi->tdmi_identifier);
+
+      LIST_FOREACH(tdt, &tdmi->tdmi_tables, tdt_link)
+	htsbuf_qprintf(hq, "        Table %-12s PID %-5d Sections %-8d "
+		       "Repeats dropped %u of %u\n",
+		       tdt->tdt_name, tdt->tdt_pid, tdt->tdt_count,
+		       tdt->tdt_dedup_hits,
+		       tdt->tdt_dedup_hits + tdt->tdt_dedup_misses);
       
       htsbuf_qprintf(hq, "\n");
       dumptransports(hq, &tdmi->tdmi_transports, 8);
@@ -182,6 +213,28 @@ page_statedump(http_connection_t *hc, const char *remain, void *opaque)
 		 tvh_binshasum[19]);
 
   dumpchannels(hq);
+
+  outputtitle(hq, 0, "Memory pools");
+  mempool_dump(hq);
+
+  outputtitle(hq, 0, "Shared packet conversions");
+  pkt_dump(hq);
+
+  outputtitle(hq, 0, "HTTP server");
+  http_server_dump(hq);
+
+  outputtitle(hq, 0, "HTSP connections");
+  htsp_dump(hq);
+
+#if ENABLE_CWC
+  outputtitle(hq, 0, "Code word clients");
+  cwc_dump(hq);
+#endif
+
+#if ENABLE_LIBAV
+  outputtitle(hq, 0, "Transcoder sessions");
+  transcoder_session_dump(hq);
+#endif
   
 #if ENABLE_LINUXDVB
   dumpdvbadapters(hq);
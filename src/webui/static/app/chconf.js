@@ -23,7 +23,7 @@ tvheadend.comet.on('channeltags', function(m) {
  */
 tvheadend.channelrec = new Ext.data.Record.create(
 	[ 'name', 'chid', 'epggrabsrc', 'tags', 'ch_icon', 'epg_pre_start',
-		'epg_post_end', 'number' ]);
+		'epg_post_end', 'number', 'gop_cache' ]);
 
 tvheadend.channels = new Ext.data.JsonStore({
 	autoLoad : true,
@@ -232,6 +232,23 @@ tvheadend.chconf = function() {
 			minValue : 0,
 			maxValue : 1440
 		})
+	}, {
+		header : "GOP Cache",
+		dataIndex : 'gop_cache',
+		width : 100,
+		renderer : function(value, metadata, record, row, col, store) {
+			if (!value) {
+				return '<span class="tvh-grid-unset">Disabled</span>';
+			}
+			else {
+				return value + ' kB';
+			}
+		},
+
+		editor : new fm.NumberField({
+			minValue : 0,
+			maxValue : 65536
+		})
 	}, actions ]);
 
 	function delSelected() {
@@ -41,7 +41,8 @@ tvheadend.miscconf = function() {
        'imagecache_enabled', 'imagecache_ok_period',
        'imagecache_fail_period', 'imagecache_ignore_sslcert',
        'tvhtime_update_enabled', 'tvhtime_ntp_enabled',
-       'tvhtime_tolerance']);
+       'tvhtime_tolerance', 'descrambler_threads',
+       'descrambler_ecm_parallel']);
 
 	/* ****************************************************************
 	 * Form Fields
@@ -103,6 +104,31 @@ tvheadend.miscconf = function() {
     items : [ tvhtimeUpdateEnabled, tvhtimeNtpEnabled, tvhtimeTolerance ]
   });
 
+  /*
+   * Descrambler
+   */
+  var descramblerThreads = new Ext.form.NumberField({
+    name: 'descrambler_threads',
+    fieldLabel: 'Threads (0 = one per CPU)',
+    allowNegative: false,
+    allowDecimals: false
+  });
+
+  var descramblerEcmParallel = new Ext.form.Checkbox({
+    name: 'descrambler_ecm_parallel',
+    fieldLabel: 'Send identical ECMs to all servers'
+  });
+
+  var descramblerPanel = new Ext.form.FieldSet({
+    title: 'Descrambler',
+    width: 700,
+    autoHeight: true,
+    collapsible: true,
+    items : [ descramblerThreads, descramblerEcmParallel ]
+  });
+  if (tvheadend.capabilities.indexOf('cwc') == -1)
+    descramblerPanel.hide();
+
   /*
    * Image cache
    */
@@ -168,7 +194,7 @@ tvheadend.miscconf = function() {
 		defaultType : 'textfield',
 		autoHeight : true,
 		items : [ language, dvbscanPath,
-              imagecachePanel, tvhtimePanel ],
+              imagecachePanel, tvhtimePanel, descramblerPanel ],
 		tbar : [ saveButton, '->', helpButton ]
 	});
 
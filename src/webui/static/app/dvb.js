@@ -1195,7 +1195,8 @@ tvheadend.dvb_adapter_general = function(adapterData, satConfStore) {
 	}, [ 'name', 'enabled', 'automux', 'skip_initialscan', 'idlescan', 'diseqcversion',
 		'diseqcrepeats', 'qmon', 'skip_checksubscr', 
 		'poweroff', 'sidtochan', 'nitoid', 'extrapriority',
-		,'disable_pmt_monitor', 'full_mux_rx', 'idleclose', 'grace_period' ]);
+		,'disable_pmt_monitor', 'full_mux_rx', 'idleclose', 'grace_period',
+		'dvr_bufsize' ]);
 
 	function saveConfForm() {
 		confform.getForm().submit({
@@ -1262,6 +1263,10 @@ tvheadend.dvb_adapter_general = function(adapterData, satConfStore) {
 			fieldLabel: 'Grace Period',
 			name: 'grace_period'
 		}),
+		new Ext.form.NumberField({
+			fieldLabel: 'DVR buffer size (KB)',
+			name: 'dvr_bufsize'
+		}),
 		new Ext.form.Checkbox({
 			fieldLabel : 'Disable PMT monitoring',
 			name : 'disable_pmt_monitor'
@@ -24,6 +24,16 @@ tvheadend.status_subs = function() {
 			name : 'errors'
 		}, {
 			name : 'bw'
+		}, {
+			name : 'csa_queue'
+		}, {
+			name : 'csa_bw'
+		}, {
+			name : 'tc_fps'
+		}, {
+			name : 'tc_latency'
+		}, {
+			name : 'tc_drops'
 		}, {
 			name : 'start',
 			type : 'date',
@@ -52,6 +62,11 @@ tvheadend.status_subs = function() {
 			r.data.state    = m.state;
 			r.data.errors   = m.errors;
 			r.data.bw       = m.bw
+			r.data.csa_queue = m.csa_queue;
+			r.data.csa_bw    = m.csa_bw;
+			r.data.tc_fps     = m.tc_fps;
+			r.data.tc_latency = m.tc_latency;
+			r.data.tc_drops   = m.tc_drops;
 
 			tvheadend.subsStore.afterEdit(r);
 			tvheadend.subsStore.fireEvent('updated', tvheadend.subsStore, r,
@@ -115,6 +130,32 @@ tvheadend.status_subs = function() {
 		header : "Bandwidth (kb/s)",
 		dataIndex : 'bw',
 		renderer: renderBw
+	}, {
+		width : 50,
+		id : 'csa_queue',
+		header : "Descrambler queue",
+		dataIndex : 'csa_queue'
+	}, {
+		width : 50,
+		id : 'csa_bw',
+		header : "Descrambled (kb/s)",
+		dataIndex : 'csa_bw',
+		renderer: renderBw
+	}, {
+		width : 50,
+		id : 'tc_fps',
+		header : "Transcoded (fps)",
+		dataIndex : 'tc_fps'
+	}, {
+		width : 50,
+		id : 'tc_latency',
+		header : "Transcoder latency (ms)",
+		dataIndex : 'tc_latency'
+	}, {
+		width : 50,
+		id : 'tc_drops',
+		header : "Transcoder drops",
+		dataIndex : 'tc_drops'
 	} ]);
 
 	var subs = new Ext.grid.GridPanel({
@@ -169,6 +210,14 @@ tvheadend.status_adapters = function() {
 		header : "Bandwidth (kb/s)",
 		dataIndex : 'bw',
 		renderer: renderBw
+        },{
+		width : 50,
+		header : "Packets/s",
+		dataIndex : 'pps'
+        },{
+		width : 50,
+		header : "Reads/s",
+		dataIndex : 'reads'
         },{
 		width : 50,
 		header : "Bit error rate",
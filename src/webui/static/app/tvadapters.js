@@ -7,7 +7,8 @@ tvheadend.tvAdapterStore = new Ext.data.JsonStore({
 	fields : [ 'identifier', 'type', 'name', 'path', 'devicename',
 		   'hostconnection', 'currentMux', 'services', 'muxes', 'initialMuxes',
 		   'satConf', 'deliverySystem', 'freqMin', 'freqMax', 'freqStep',
-		   'symrateMin', 'symrateMax',  'signal', 'snr', 'ber', 'unc', 'uncavg', 'bw'],
+		   'symrateMin', 'symrateMax',  'signal', 'snr', 'ber', 'unc', 'uncavg', 'bw',
+		   'pps', 'reads'],
 	url : 'tv/adapter'
 });
 
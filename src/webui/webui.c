@@ -176,6 +176,8 @@ http_stream_run(http_connection_t *hc, streaming_queue_t *sq,
   int err = 0;
   socklen_t errlen = sizeof(err);
 
+  http_worker_detach(hc);
+
   mux = muxer_create(mc);
   if(muxer_open_stream(mux, hc->hc_fd))
     run = 0;
@@ -705,12 +707,14 @@ static int
 http_stream_channel(http_connection_t *hc, channel_t *ch)
 {
   streaming_queue_t sq;
-  th_subscription_t *s;
+  th_subscription_t *s = NULL;
   streaming_target_t *gh;
   streaming_target_t *tsfix;
   streaming_target_t *st;
+  transcoder_client_t *tc = NULL;
 #if ENABLE_LIBAV
-  streaming_target_t *tr = NULL;
+  transcoder_props_t props;
+  int transcode = 0;
 #endif
   dvr_config_t *cfg;
   int priority = 100;
@@ -742,12 +746,10 @@ http_stream_channel(http_connection_t *hc, channel_t *ch)
     streaming_queue_init2(&sq, 0, qsize);
     gh = globalheaders_create(&sq.sq_st);
 #if ENABLE_LIBAV
-    transcoder_props_t props;
-    if(http_get_transcoder_properties(&hc->hc_req_args, &props)) {
-      tr = transcoder_create(gh);
-      transcoder_set_properties(tr, &props);
-      tsfix = tsfix_create(tr);
-    } else
+    transcode = http_get_transcoder_properties(&hc->hc_req_args, &props);
+    if(transcode)
+      tsfix = NULL;   // the shared session has one per client
+    else
 #endif
     tsfix = tsfix_create(gh);
     st = tsfix;
@@ -755,27 +757,35 @@ http_stream_channel(http_connection_t *hc, channel_t *ch)
   }
 
   tcp_get_ip_str((struct sockaddr*)hc->hc_peer, addrbuf, 50);
+#if ENABLE_LIBAV
+  if(transcode)
+    tc = transcoder_session_attach(ch, &props, priority, gh, addrbuf,
+                                   hc->hc_username,
+                                   http_arg_get(&hc->hc_args, "User-Agent"));
+  else
+#endif
   s = subscription_create_from_channel(ch, priority, "HTTP", st, flags,
                addrbuf,
                hc->hc_username,
                http_arg_get(&hc->hc_args, "User-Agent"));
 
-  if(s) {
+  if(s || tc) {
     name = tvh_strdupa(ch->ch_name);
     pthread_mutex_unlock(&global_lock);
     http_stream_run(hc, &sq, name, mc);
     pthread_mutex_lock(&global_lock);
+#if ENABLE_LIBAV
+    /* Detach before gh goes away, a transcoder worker feeds it */
+    if(tc)
+      transcoder_session_detach(tc);
+    else
+#endif
     subscription_unsubscribe(s);
   }
 
   if(gh)
     globalheaders_destroy(gh);
 
-#if ENABLE_LIBAV
-  if(tr)
-    transcoder_destroy(tr);
-#endif
-
   if(tsfix)
     tsfix_destroy(tsfix);
 
@@ -940,6 +950,7 @@ page_dvrfile(http_connection_t *hc, const char *remain, void *opaque)
        disposition[0] ? disposition : NULL);
 
   if(!hc->hc_no_output) {
+    http_worker_detach(hc);
     while(content_len > 0) {
       chunk = MIN(1024 * 1024 * 1024, content_len);
 #if defined(PLATFORM_LINUX)
@@ -2,6 +2,7 @@
 #include <sys/types.h>          /* See NOTES */
 #include <sys/socket.h>
 #include <unistd.h>
+#include <sys/uio.h>
 #include "tvheadend.h"
 
 int
@@ -69,3 +70,34 @@ tvh_write(int fd, const void *buf, size_t len)
 
   return len ? 1 : 0;
 }
+
+/*
+ * Note: iov is modified on partial writes
+ */
+int
+tvh_writev(int fd, struct iovec *iov, int iovcnt)
+{
+  ssize_t c;
+
+  while (iovcnt) {
+    c = writev(fd, iov, iovcnt);
+    if (c < 0) {
+      if (errno == EINTR || errno == EAGAIN || errno == EWOULDBLOCK) {
+        usleep(100);
+        continue;
+      }
+      break;
+    }
+    while (iovcnt && c >= iov->iov_len) {
+      c -= iov->iov_len;
+      iov++;
+      iovcnt--;
+    }
+    if (iovcnt) {
+      iov->iov_base += c;
+      iov->iov_len  -= c;
+    }
+  }
+
+  return iovcnt ? 1 : 0;
+}